@@ -0,0 +1,227 @@
+/*
+This example shows the following features:
+1. The C++ front end, a window and an image that free themselves.
+2. Drawing templates specialized on the pixel format, the blend mode and the clipping.
+3. A benchmark of the specialized drawing against one generic path that branches on them.
+
+usage: bench [--show]
+The benchmark draws offscreen, '--show' opens a window with the result.
+ */
+#include "../xwrap.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#define ESC 9
+
+#define WIDTH   1280
+#define HEIGHT  720
+#define SHAPES  4000
+#define REPEATS 5
+
+enum class format { xrgb8888, argb8888, rgb565 };
+enum class blend { copy, alpha, add };
+
+struct shape {
+    int x, y, width, height, r;
+    uint32_t color;
+};
+
+// The generic path, like a C function taking the format, blend and clipping as arguments
+static uint32_t generic_load(const void* pixels, size_t i, format f)
+{
+    switch (f) {
+        case format::xrgb8888:
+            return xw::xrgb8888::unpack(((const uint32_t*)pixels)[i]);
+        case format::argb8888:
+            return xw::argb8888::unpack(((const uint32_t*)pixels)[i]);
+        case format::rgb565:
+            return xw::rgb565::unpack(((const uint16_t*)pixels)[i]);
+    }
+    return 0;
+}
+
+static void generic_store(void* pixels, size_t i, format f, uint32_t argb)
+{
+    switch (f) {
+        case format::xrgb8888:
+            ((uint32_t*)pixels)[i] = xw::xrgb8888::pack(argb);
+            break;
+        case format::argb8888:
+            ((uint32_t*)pixels)[i] = xw::argb8888::pack(argb);
+            break;
+        case format::rgb565:
+            ((uint16_t*)pixels)[i] = xw::rgb565::pack(argb);
+            break;
+    }
+}
+
+static uint32_t generic_blend(uint32_t src, uint32_t dst, blend b)
+{
+    uint32_t out = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const uint32_t s = shift == 24 ? 0xFF : (src >> shift) & 0xFF;
+        const uint32_t d = (dst >> shift) & 0xFF;
+        uint32_t c       = s;
+        if (b == blend::alpha) {
+            const uint32_t a = src >> 24;
+            c                = s * a + d * (255 - a) + 128;
+            c                = (c + (c >> 8)) >> 8;
+        } else if (b == blend::add) {
+            c = shift == 24 ? (src >> 24) + d : s + d;
+            c = c > 255 ? 255 : c;
+        }
+        out |= c << shift;
+    }
+    return b == blend::copy ? src : out;
+}
+
+// Clips the span once like 'xw::fill_span', only the format and the blend branch per pixel
+static void generic_fill_span(void* pixels, int width, int height, size_t stride, format f,
+                              blend b, bool clip, int x0, int x1, int y, uint32_t color)
+{
+    if (clip) {
+        if (y < 0 || y >= height) {
+            return;
+        }
+        x0 = std::max(x0, 0);
+        x1 = std::min(x1, width);
+    }
+    for (int col = x0; col < x1; ++col) {
+        const size_t i = (size_t)y * stride + col;
+        generic_store(pixels, i, f, generic_blend(color, generic_load(pixels, i, f), b));
+    }
+}
+
+static void generic_fill_rect(void* pixels, int width, int height, size_t stride, format f,
+                              blend b, bool clip, int x, int y, int w, int h, uint32_t color)
+{
+    for (int row = y; row < y + h; ++row) {
+        generic_fill_span(pixels, width, height, stride, f, b, clip, x, x + w, row, color);
+    }
+}
+
+static void generic_fill_circle(void* pixels, int width, int height, size_t stride, format f,
+                                blend b, bool clip, int x, int y, int r, uint32_t color)
+{
+    int half = r;
+    for (int dy = 0; dy <= r; ++dy) {
+        while (half * half + dy * dy > r * r) {
+            --half;
+        }
+        generic_fill_span(pixels, width, height, stride, f, b, clip, x - half, x + half + 1,
+                          y + dy, color);
+        if (dy != 0) {
+            generic_fill_span(pixels, width, height, stride, f, b, clip, x - half, x + half + 1,
+                              y - dy, color);
+        }
+    }
+}
+
+template <typename Format, typename Blend>
+static void draw_specialized(const xw::surface<Format>& surface, const std::vector<shape>& shapes)
+{
+    for (const shape& s : shapes) {
+        xw::fill_rect<Format, Blend>(surface, s.x, s.y, s.width, s.height, s.color);
+        xw::fill_circle<Format, Blend>(surface, s.x, s.y, s.r, s.color);
+    }
+}
+
+static void draw_generic(void* pixels, size_t stride, format f, blend b,
+                         const std::vector<shape>& shapes)
+{
+    for (const shape& s : shapes) {
+        generic_fill_rect(pixels, WIDTH, HEIGHT, stride, f, b, true, s.x, s.y, s.width, s.height,
+                          s.color);
+        generic_fill_circle(pixels, WIDTH, HEIGHT, stride, f, b, true, s.x, s.y, s.r, s.color);
+    }
+}
+
+// Best of the repeats in milliseconds
+template <typename Draw>
+static double time_ms(Draw draw)
+{
+    double best = 1e9;
+    for (int i = 0; i < REPEATS; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        draw();
+        const auto end = std::chrono::steady_clock::now();
+
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+template <typename Format, typename Blend>
+static void bench(const char* name, format f, blend b, const std::vector<shape>& shapes)
+{
+    xw::image<Format> specialized(WIDTH, HEIGHT);
+    xw::image<Format> generic(WIDTH, HEIGHT);
+    const xw::surface<Format> s = specialized.view();
+    const xw::surface<Format> g = generic.view();
+
+    const double specialized_ms = time_ms([&] { draw_specialized<Format, Blend>(s, shapes); });
+    const double generic_ms     = time_ms([&] { draw_generic(g.pixels, g.stride, f, b, shapes); });
+
+    // Both drew the same shapes the same number of times
+    const size_t bytes = g.stride * HEIGHT * sizeof(typename Format::pixel);
+    const bool same    = memcmp(s.pixels, g.pixels, bytes) == 0;
+    printf("%-20s %10.2f %10.2f %8.1fx %s\n", name, generic_ms, specialized_ms,
+           generic_ms / specialized_ms, same ? "" : "MISMATCH");
+}
+
+int main(int argc, char const* argv[])
+{
+    // The same shapes for every run, some cross the borders
+    std::vector<shape> shapes(SHAPES);
+    uint32_t seed = 1;
+    for (shape& s : shapes) {
+        seed     = seed * 1664525 + 1013904223;
+        s.x      = (int)(seed >> 8) % (WIDTH + 100) - 50;
+        seed     = seed * 1664525 + 1013904223;
+        s.y      = (int)(seed >> 8) % (HEIGHT + 100) - 50;
+        s.width  = 8 + (seed >> 4) % 120;
+        s.height = 8 + (seed >> 12) % 80;
+        s.r      = 4 + (seed >> 20) % 40;
+        seed     = seed * 1664525 + 1013904223;
+        s.color  = seed;
+    }
+
+    printf("%-20s %10s %10s %9s\n", "format/blend", "generic ms", "templ. ms", "speedup");
+    bench<xw::xrgb8888, xw::blend_copy>("xrgb8888/copy", format::xrgb8888, blend::copy, shapes);
+    bench<xw::xrgb8888, xw::blend_alpha>("xrgb8888/alpha", format::xrgb8888, blend::alpha, shapes);
+    bench<xw::xrgb8888, xw::blend_add>("xrgb8888/add", format::xrgb8888, blend::add, shapes);
+    bench<xw::argb8888, xw::blend_alpha>("argb8888/alpha", format::argb8888, blend::alpha, shapes);
+    bench<xw::rgb565, xw::blend_copy>("rgb565/copy", format::rgb565, blend::copy, shapes);
+    bench<xw::rgb565, xw::blend_alpha>("rgb565/alpha", format::rgb565, blend::alpha, shapes);
+
+    if (argc < 2 || strcmp(argv[1], "--show") != 0) {
+        return 0;
+    }
+
+    xw::window window("bench", WIDTH, HEIGHT);
+    if (!window || !window.connect(xw::image<xw::xrgb8888>(WIDTH, HEIGHT))) {
+        return 1;
+    }
+    const xw::surface<xw::xrgb8888> surface = window.pixels();
+    draw_specialized<xw::xrgb8888, xw::blend_alpha>(surface, shapes);
+    for (const shape& s : shapes) {
+        xw::draw_circle<xw::xrgb8888, xw::blend_add>(surface, s.x, s.y, s.r, 0x404040);
+    }
+    xw::draw_rect(surface, 0, 0, WIDTH, HEIGHT, 0xFFFFFF);
+    xw::draw_line(surface, 0, 0, WIDTH - 1, HEIGHT - 1, 0xFFFFFF);
+
+    for (;;) {
+        xw_event event;
+        while (window.poll(event)) {
+            if (event.type == xw::key_press && event.button.key_code == ESC) {
+                return 0;
+            }
+        }
+        window.draw();
+        xw_sleep_ms(16);
+    }
+}
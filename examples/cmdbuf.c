@@ -0,0 +1,88 @@
+/*
+This example shows the following features:
+1. Recording draw commands from several threads without locks.
+2. Sending them from the window thread in a fixed order with `xw_draw`.
+ */
+#define XWRAP_IMPLEMENTATION
+#define XWRAP_AUTO_LINK
+#include "../xwrap.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define ESC 9
+
+#define WORKERS 4
+#define WIDTH   800
+#define HEIGHT  600
+
+typedef struct {
+    xw_cmdbuf* cmdbuf;
+    int index;
+    bool stop;
+} worker;
+
+// Every worker draws a band of the window
+static void* worker_run(void* arg)
+{
+    static const uint32_t colors[WORKERS] = {0xFF4040, 0x40FF40, 0x4040FF, 0xFFFF40};
+
+    worker* self         = (worker*)arg;
+    const int band       = HEIGHT / WORKERS;
+    const int top        = self->index * band;
+    const uint32_t color = colors[self->index];
+    for (uint32_t frame = 0; !__atomic_load_n(&self->stop, __ATOMIC_RELAXED); ++frame) {
+        xw_cmd_rectangle(self->cmdbuf, 0, top, WIDTH, band, true, 0x101010);
+        for (int i = 0; i < 200; ++i) {
+            const int x = (i * 37 + frame * (self->index + 1)) % WIDTH;
+            const int y = top + (i * 53) % band;
+            xw_cmd_rectangle(self->cmdbuf, x, y, 6, 6, true, color);
+        }
+        char text[32];
+        snprintf(text, sizeof(text), "worker %d frame %u", self->index, frame);
+        xw_cmd_text(self->cmdbuf, 10, top + 20, text, 0xFFFFFF);
+        xw_cmdbuf_submit(self->cmdbuf);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    xw_handle* handle = xw_create_window("cmdbuf", WIDTH, HEIGHT);
+
+    worker workers[WORKERS];
+    pthread_t threads[WORKERS];
+    for (int i = 0; i < WORKERS; ++i) {
+        workers[i] = (worker){.cmdbuf = xw_cmdbuf_create(handle, i), .index = i};
+        pthread_create(&threads[i], NULL, worker_run, &workers[i]);
+    }
+
+    for (;;) {
+        while (xw_event_pending(handle)) {
+            xw_event event;
+            xw_get_next_event(handle, &event);
+            if (event.type == KeyPress && event.button.key_code == ESC) {
+                goto shutdown;
+            }
+        }
+        xw_draw(handle);
+        xw_sleep_ms(16);
+    }
+
+shutdown:
+    for (int i = 0; i < WORKERS; ++i) {
+        __atomic_store_n(&workers[i].stop, true, __ATOMIC_RELAXED);
+    }
+    // A worker may wait in 'xw_cmdbuf_submit' for one more draw
+    for (int i = 0; i < WORKERS; ++i) {
+        xw_draw(handle);
+        pthread_join(threads[i], NULL);
+    }
+    for (int i = 0; i < WORKERS; ++i) {
+        xw_cmdbuf_free(workers[i].cmdbuf);
+    }
+    xw_free_window(handle);
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+This example shows the following features:
+1. Connecting an image with padded rows, like the frames of capture cards.
+2. Drawing a moving crop of a bigger image without copying it.
+ */
+#define XWRAP_IMPLEMENTATION
+#define XWRAP_AUTO_LINK
+#include "../xwrap.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ESC 9
+
+int main(void)
+{
+    const unsigned int width  = 640;
+    const unsigned int height = 480;
+    xw_handle* handle         = xw_create_window("crop", width, height);
+
+    // Twice the window, each row padded to 64 bytes
+    const unsigned int image_width  = width * 2;
+    const unsigned int image_height = height * 2;
+    const size_t stride             = (image_width * sizeof(uint32_t) + 63) & ~(size_t)63;
+    uint32_t* image_buffer          = (uint32_t*)malloc(stride * image_height);
+    if (!xw_image_connect_strided(handle, image_buffer, image_width, image_height, stride)) {
+        return 1;
+    }
+    for (size_t y = 0; y < image_height; ++y) {
+        uint32_t* row = (uint32_t*)((char*)image_buffer + y * stride);
+        for (size_t x = 0; x < image_width; ++x) {
+            row[x] = ((x / 32 + y / 32) & 1) ? (x & 0xFF) << 16 | (y & 0xFF) : 0x202020;
+        }
+    }
+
+    for (uint32_t frame = 0;; ++frame) {
+        while (xw_event_pending(handle)) {
+            xw_event event;
+            xw_get_next_event(handle, &event);
+            if (event.type == KeyPress && event.button.key_code == ESC) {
+                goto shutdown;
+            }
+        }
+
+        // Pan around the image, the X server reads the rows in place
+        const xw_rect crop = {
+            .x      = (int)(frame * 2 % width),
+            .y      = (int)(frame % height),
+            .width  = width,
+            .height = height,
+        };
+        xw_draw_region(handle, crop, 0, 0);
+        xw_sleep_ms(16);
+    }
+
+shutdown:
+    xw_free_window(handle);
+    free(image_buffer);
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+/*
+This example shows the following features:
+1. Mapping a float grid through a 256 color lookup table into the image.
+2. Automatic range and scaling of a small grid to the whole window.
+3. Splitting the rows across threads.
+ */
+#define XWRAP_IMPLEMENTATION
+#define XWRAP_AUTO_LINK
+#define XWRAP_THREADS
+#include "../xwrap.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ESC 9
+
+#define GRID_WIDTH  320
+#define GRID_HEIGHT 180
+
+int main(void)
+{
+    const unsigned int width  = 960;
+    const unsigned int height = 540;
+    xw_handle* handle         = xw_create_window("heatmap", width, height);
+
+    uint32_t* image_buffer = (uint32_t*)malloc(sizeof(uint32_t) * height * width);
+    if (!xw_image_connect(handle, image_buffer, width, height)) {
+        return 1;
+    }
+
+    uint32_t lut[256];
+    const uint32_t stops[] = {0x000004, 0x51127C, 0xB73779, 0xFC8961, 0xFCFDBF};
+    xw_colormap_gradient(lut, 256, stops, sizeof(stops) / sizeof(stops[0]));
+    const xw_colormap colormap = {.lut = lut, .size = 256, .auto_range = true};
+
+    // Heat spreading from a moving source
+    float* grid = (float*)calloc(GRID_WIDTH * GRID_HEIGHT, sizeof(float));
+    float* next = (float*)calloc(GRID_WIDTH * GRID_HEIGHT, sizeof(float));
+    for (uint32_t frame = 0;; ++frame) {
+        while (xw_event_pending(handle)) {
+            xw_event event;
+            xw_get_next_event(handle, &event);
+            if (event.type == KeyPress && event.button.key_code == ESC) {
+                goto shutdown;
+            }
+        }
+
+        const int source_x = GRID_WIDTH / 2 + (int)((frame * 3) % 200) - 100;
+        grid[(GRID_HEIGHT / 2) * GRID_WIDTH + source_x] += 400;
+        for (int y = 1; y < GRID_HEIGHT - 1; ++y) {
+            for (int x = 1; x < GRID_WIDTH - 1; ++x) {
+                const float* c = &grid[y * GRID_WIDTH + x];
+                next[y * GRID_WIDTH + x] =
+                    0.99f * (c[0] * 0.6f + (c[-1] + c[1] + c[-GRID_WIDTH] + c[GRID_WIDTH]) * 0.1f);
+            }
+        }
+        float* swap = grid;
+        grid        = next;
+        next        = swap;
+
+        const xw_scalar_grid values = {
+            .values = grid,
+            .type   = XW_SCALAR_F32,
+            .width  = GRID_WIDTH,
+            .height = GRID_HEIGHT,
+        };
+        xw_draw_colormap(handle, values, &colormap,
+                         (xw_rect){.x = 0, .y = 0, .width = width, .height = height});
+        xw_draw(handle);
+        xw_sleep_ms(16);
+    }
+
+shutdown:
+    xw_free_window(handle);
+    free(image_buffer);
+    free(grid);
+    free(next);
+
+    return 0;
+}
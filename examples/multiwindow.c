@@ -2,9 +2,15 @@
 This example opens 2 windows and show that:
 1. It can draw separately on each window.
 2. Get presses from the correct window.
+3. Query all the windows with one wait.
+4. Trace where the time goes, open multiwindow.json in Perfetto.
+5. Report X errors without exiting.
+6. Share one connection and send both windows with a single flush.
  */
 #define XWRAP_IMPLEMENTATION
 #define XWRAP_AUTO_LINK
+#define XWRAP_XCB
+#define XWRAP_TRACE
 #include "../xwrap.h"
 
 #include <stdint.h>
@@ -12,7 +18,7 @@ This example opens 2 windows and show that:
 
 #define ESC 9
 
-bool draw(xw_handle* handle, uint32_t color, bool draw_circle)
+void draw(xw_handle* handle, uint32_t color, bool draw_circle)
 {
     xw_draw_line(handle, 75, 100, 50, 10, 4, color);
     xw_draw_rectangle(handle, 75, 100, 50, 10, true, 0X00FF00);
@@ -20,8 +26,6 @@ bool draw(xw_handle* handle, uint32_t color, bool draw_circle)
         xw_draw_circle(handle, 100, 100, 50, 0, 0XFF0000);
     }
     xw_draw_triangle(handle, 100, 100, 90, 150, 130, 140, color);
-
-    xw_draw(handle);
 }
 
 bool check_events(xw_handle* handle, const char* name)
@@ -58,13 +62,34 @@ bool check_events(xw_handle* handle, const char* name)
     return false;
 }
 
+void report_errors(xw_handle* handle)
+{
+    xw_error errors[4];
+    const size_t count = xw_get_errors(handle, errors, 4);
+    for (size_t i = 0; i < count; ++i) {
+        char text[256];
+        xw_error_text(handle, &errors[i], text, sizeof(text));
+        printf("%s: %s\n", xw_get_window_name(handle), text);
+    }
+}
+
 int main(int argc, char const* argv[])
 {
     const unsigned int width  = 640;
     const unsigned int height = 480;
-    // Open 2 windows, dont forget to close them on end
+    xw_trace_dump_at_exit("multiwindow.json");
+    // Open 2 windows on one connection, dont forget to close them on end
     xw_handle* handle1 = xw_create_window("window1", width, height);
-    xw_handle* handle2 = xw_create_window("window2", width, height);
+    xw_handle* handle2 = xw_create_window_shared("window2", width, height, handle1);
+
+    xw_handle* handles[] = {handle1, handle2};
+    xw_dimensions dimensions[2];
+    if (xw_get_dimensions_many(handles, 2, dimensions)) {
+        for (size_t i = 0; i < 2; ++i) {
+            printf("%s: %dx%d at (%d, %d)\n", xw_get_window_name(handles[i]), dimensions[i].width,
+                   dimensions[i].height, dimensions[i].x_pos, dimensions[i].y_pos);
+        }
+    }
 
     for (;;) {
         // Check each window for clicks
@@ -73,8 +98,17 @@ int main(int argc, char const* argv[])
         }
 
         // Draws separately on each window
+        uint64_t begin = xw_trace_begin();
         draw(handle1, 0X00FFFF, true);
+        xw_trace_end(handle1, "draw", begin);
+        begin = xw_trace_begin();
         draw(handle2, 0X0000FF, false);
+        xw_trace_end(handle2, "draw", begin);
+        // Both windows update together
+        xw_draw_many(handles, 2);
+
+        report_errors(handle1);
+        report_errors(handle2);
 
         xw_sleep_ms(33);
     }
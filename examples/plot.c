@@ -0,0 +1,97 @@
+/*
+This example shows the following features:
+1. Drawing ten million samples as a line plot, one request per frame.
+2. Zooming with the mouse wheel and panning with the arrow keys over the min/max pyramid.
+ */
+#define XWRAP_IMPLEMENTATION
+#define XWRAP_AUTO_LINK
+#include "../xwrap.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ESC   9
+#define LEFT  113
+#define RIGHT 114
+
+#define SAMPLES 10000000
+
+int main(void)
+{
+    const unsigned int width  = 800;
+    const unsigned int height = 400;
+    xw_handle* handle         = xw_create_window("plot", width, height);
+
+    // A slow wave with noise and a few spikes, so every zoom level shows something
+    float* samples = (float*)malloc(sizeof(float) * SAMPLES);
+    uint32_t seed  = 1;
+    float wave = 0, speed = 0.001f;
+    for (size_t i = 0; i < SAMPLES; ++i) {
+        seed = seed * 1664525 + 1013904223;
+        speed -= wave * 0.000001f;
+        wave += speed;
+        samples[i] = wave * 40 + (float)(seed >> 24) / 16 - 8 + ((seed & 0xFFFFF) == 0 ? 30 : 0);
+    }
+    xw_plot* plot = xw_plot_create(samples, SAMPLES, true);
+    if (plot == NULL) {
+        return 1;
+    }
+
+    xw_plot_view view = {
+        .first = 0,
+        .last  = SAMPLES,
+        .low   = -64,
+        .high  = 64,
+        .area  = {.x = 0, .y = 0, .width = width, .height = height},
+    };
+    for (;;) {
+        while (xw_event_pending(handle)) {
+            xw_event event;
+            xw_get_next_event(handle, &event);
+            const double span = view.last - view.first;
+            switch (event.type) {
+                case KeyPress:
+                    switch (event.button.key_code) {
+                        case ESC:
+                            goto shutdown;
+                        case LEFT:
+                            view.first -= span / 4;
+                            view.last -= span / 4;
+                            break;
+                        case RIGHT:
+                            view.first += span / 4;
+                            view.last += span / 4;
+                            break;
+                    }
+                    break;
+                case ButtonPress: {
+                    if (event.mouse.button != Button4 && event.mouse.button != Button5) {
+                        break;
+                    }
+                    // Zoom around the sample under the mouse
+                    const double zoom  = event.mouse.button == Button4 ? 0.8 : 1.25;
+                    const double mouse = view.first + span * event.mouse.x / view.area.width;
+                    view.first         = mouse - (mouse - view.first) * zoom;
+                    view.last          = mouse + (view.last - mouse) * zoom;
+                    break;
+                }
+                case XW_EVENT_RESIZE:
+                    view.area.width  = event.configure.dimensions.width;
+                    view.area.height = event.configure.dimensions.height;
+                    break;
+            }
+        }
+
+        xw_draw_background(handle, 0x101010);
+        xw_draw_plot(handle, plot, view, 0x40C0FF);
+        xw_draw(handle);
+        xw_sleep_ms(16);
+    }
+
+shutdown:
+    xw_plot_free(plot);
+    xw_free_window(handle);
+    free(samples);
+
+    return 0;
+}
@@ -2,7 +2,10 @@
 This example is the game pong, it shows the following features:
 1. Inputs.
 2. Text.
-3. Drawing shapes.
+3. Retained scene, only the moving shapes are repainted.
+4. Recording the inputs and replaying them, to measure the same game again.
+
+usage: pong [--record <log> | --replay <log> | --replay-fast <log>]
  */
 #define XWRAP_IMPLEMENTATION
 #define XWRAP_AUTO_LINK
@@ -78,22 +81,58 @@ void game_update(Game* game)
     game->ball.y += game->ball.vy;
 }
 
-void ball_draw(xw_handle* handle, const Ball ball)
+typedef struct {
+    xw_scene* scene;
+    int ball;
+    int npc;
+    int player;
+} Shapes;
+
+xw_shape ball_shape(const Ball ball)
 {
-    xw_draw_circle(handle, ball.x, ball.y, ball.radius, true, ball.color);
+    return (xw_shape){.type    = XW_SHAPE_CIRCLE,
+                      .color   = ball.color,
+                      .fill    = true,
+                      .visible = true,
+                      .circle  = {.x = ball.x, .y = ball.y, .r = ball.radius}};
 }
 
-void player_draw(xw_handle* handle, const Player player)
+xw_shape player_shape(const Player player)
 {
-    xw_draw_rectangle(handle, player.x_start, player.y_pos, player.x_end - player.x_start,
-                      player.thickness, true, player.color);
+    return (xw_shape){.type      = XW_SHAPE_RECTANGLE,
+                      .color     = player.color,
+                      .fill      = true,
+                      .visible   = true,
+                      .rectangle = {.x      = player.x_start,
+                                    .y      = player.y_pos,
+                                    .width  = player.x_end - player.x_start,
+                                    .height = player.thickness}};
 }
 
-void game_draw(xw_handle* handle, const Game game)
+Shapes shapes_create(xw_handle* handle, const Game game)
 {
-    ball_draw(handle, game.ball);
-    player_draw(handle, game.npc);
-    player_draw(handle, game.player);
+    Shapes shapes = {.scene = xw_scene_create(handle, BACKGROUND)};
+
+    xw_shape shape = ball_shape(game.ball);
+    shapes.ball    = xw_scene_add(shapes.scene, &shape);
+    shape          = player_shape(game.npc);
+    shapes.npc     = xw_scene_add(shapes.scene, &shape);
+    shape          = player_shape(game.player);
+    shapes.player  = xw_scene_add(shapes.scene, &shape);
+    return shapes;
+}
+
+void game_draw(Shapes* shapes, const Game game)
+{
+    xw_shape shape = ball_shape(game.ball);
+    xw_scene_update(shapes->scene, shapes->ball, &shape);
+    shape = player_shape(game.npc);
+    xw_scene_update(shapes->scene, shapes->npc, &shape);
+    shape = player_shape(game.player);
+    xw_scene_update(shapes->scene, shapes->player, &shape);
+
+    // Repaints only where the ball and the players were and are now
+    xw_scene_draw(shapes->scene);
 }
 
 void player_move(Player* player, int width, int distance)
@@ -167,9 +206,23 @@ int main(int argc, char const* argv[])
     const unsigned int height = 480;
     xw_handle* handle         = xw_create_window("pong", width, height);
 
-    Game game = create_game(width, height, PLAYER_SIZE);
+    // The fast replay gives the recorded events to the same frames, without waiting
+    bool replay = false;
+    bool fast   = false;
+    if (argc == 3 && strcmp(argv[1], "--record") == 0) {
+        xw_input_record_start(handle, argv[2]);
+    } else if (argc == 3 && strncmp(argv[1], "--replay", 8) == 0) {
+        fast   = strcmp(argv[1], "--replay-fast") == 0;
+        replay = xw_input_replay_start(handle, argv[2], !fast);
+    }
+
+    Game game     = create_game(width, height, PLAYER_SIZE);
+    Shapes shapes = shapes_create(handle, game);
 
     for (;;) {
+        if (replay && !xw_input_replaying(handle)) {
+            goto shutdown;
+        }
         // TODO: make the movement linear
         while (xw_event_pending(handle)) {
             xw_event event;
@@ -197,6 +250,11 @@ int main(int argc, char const* argv[])
                     }
                 } break;
 
+                case Expose: {
+                    // The window lost these pixels, a resize is damaged by the scene itself
+                    xw_scene_damage(shapes.scene, event.expose.rect);
+                } break;
+
                 default:
                     break;
             }
@@ -209,23 +267,25 @@ int main(int argc, char const* argv[])
             player_move(&game.player, game.width, dist);
         }
 
-        xw_draw_background(handle, BACKGROUND);
-
         game_update(&game);
         if (game.w != NO_WINNER) {
             break;
         }
 
-        game_draw(handle, game);
+        game_draw(&shapes, game);
 
-        xw_draw(handle);
-        xw_sleep_ms(33);
+        if (!fast) {
+            xw_sleep_ms(33);
+        }
     }
 
     game_over(handle, game);
-    xw_wait_for_esc(handle, 0);
+    if (!replay) {
+        xw_wait_for_esc(handle, 0);
+    }
 
 shutdown:
+    xw_scene_free(shapes.scene);
     xw_free_window(handle);
 
     return 0;
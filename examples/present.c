@@ -0,0 +1,87 @@
+/*
+This example shows the following features:
+1. Vsync aligned presentation of an image.
+2. Present completion events with the vblank time.
+ */
+#define XWRAP_IMPLEMENTATION
+#define XWRAP_AUTO_LINK
+#define XWRAP_PRESENT
+#include "../xwrap.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ESC 9
+#define FRAMES 64
+
+uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+int main(int argc, char const* argv[])
+{
+    const unsigned int width  = 640;
+    const unsigned int height = 480;
+    xw_handle* handle         = xw_create_window("present", width, height);
+
+    uint32_t* image_buffer = (uint32_t*)malloc(sizeof(uint32_t) * height * width);
+    if (!xw_image_connect(handle, image_buffer, width, height)) {
+        return 1;
+    }
+    const bool vsync = xw_present_enable(handle);
+    if (!vsync) {
+        printf("Present is missing, frames are drawn without vsync\n");
+    }
+
+    // When each serial was submitted, to measure the latency to the screen
+    uint64_t submitted[FRAMES] = {0};
+    uint64_t last_msc          = 0;
+
+    for (uint32_t frame = 0;; ++frame) {
+        while (xw_event_pending(handle)) {
+            xw_event event;
+            xw_get_next_event(handle, &event);
+            switch (event.type) {
+                case KeyPress: {
+                    if (event.button.key_code == ESC) {
+                        goto shutdown;
+                    }
+                } break;
+                case XW_EVENT_PRESENT_COMPLETE: {
+                    // UST is CLOCK_MONOTONIC in microseconds on Linux
+                    const uint64_t start = submitted[event.present.serial % FRAMES];
+                    if (event.present.serial % 60 == 0) {
+                        printf("frame %u: msc %lu, latency %lu us, skipped %lu vblanks\n",
+                               event.present.serial, (unsigned long)event.present.msc,
+                               (unsigned long)(event.present.ust - start),
+                               (unsigned long)(event.present.msc - last_msc - 1));
+                    }
+                    last_msc = event.present.msc;
+                } break;
+            }
+        }
+
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                image_buffer[y * width + x] = ((x + frame * 4) & 0xFF) << 16 | (y & 0xFF);
+            }
+        }
+
+        uint32_t serial;
+        const uint64_t start = now_us();
+        xw_present(handle, 0, &serial);
+        submitted[serial % FRAMES] = start;
+        if (!vsync) {
+            xw_sleep_ms(16);
+        }
+    }
+
+shutdown:
+    xw_free_window(handle);
+    free(image_buffer);
+
+    return 0;
+}
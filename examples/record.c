@@ -0,0 +1,60 @@
+/*
+This example shows the following features:
+1. Recording the drawn frames to a Y4M video from a background thread.
+2. Counting the frames the recorder dropped.
+ */
+#define XWRAP_IMPLEMENTATION
+#define XWRAP_AUTO_LINK
+#define XWRAP_RECORD
+#include "../xwrap.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ESC 9
+
+int main(int argc, char const* argv[])
+{
+    const char* path          = argc > 1 ? argv[1] : "record.y4m";
+    const unsigned int width  = 640;
+    const unsigned int height = 480;
+    xw_handle* handle         = xw_create_window("record", width, height);
+
+    uint32_t* image_buffer = (uint32_t*)malloc(sizeof(uint32_t) * height * width);
+    if (!xw_image_connect(handle, image_buffer, width, height)) {
+        return 1;
+    }
+    if (!xw_record_start(handle, path, XW_RECORD_Y4M, 30, 0)) {
+        return 1;
+    }
+    printf("Recording to '%s', press ESC to stop\n", path);
+
+    for (uint32_t frame = 0;; ++frame) {
+        while (xw_event_pending(handle)) {
+            xw_event event;
+            xw_get_next_event(handle, &event);
+            if (event.type == KeyPress && event.button.key_code == ESC) {
+                goto shutdown;
+            }
+        }
+
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                image_buffer[y * width + x] = ((x + frame * 4) & 0xFF) << 16 | (y & 0xFF) << 8;
+            }
+        }
+        xw_draw(handle);
+        xw_sleep_ms(33);
+    }
+
+shutdown:;
+    uint64_t dropped = 0;
+    if (!xw_record_stop(handle, &dropped)) {
+        printf("The recording is incomplete\n");
+    }
+    printf("Dropped %lu frames\n", (unsigned long)dropped);
+    xw_free_window(handle);
+    free(image_buffer);
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+This example shows the following features:
+1. XRender alpha blending and antialiasing.
+2. Falling back to core drawing when XRender is missing.
+ */
+#define XWRAP_IMPLEMENTATION
+#define XWRAP_AUTO_LINK
+#define XWRAP_RENDER
+#include "../xwrap.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ESC 9
+#define BACKGROUND 0x181818
+
+int main(int argc, char const* argv[])
+{
+    const unsigned int width  = 640;
+    const unsigned int height = 480;
+    xw_handle* handle         = xw_create_window("render", width, height);
+
+    printf("XRender: %s\n", xw_render_available(handle) ? "available" : "missing");
+
+    // Premultiplied half transparent gradient
+    enum { IMAGE_SIZE = 128 };
+    uint32_t* image = (uint32_t*)malloc(sizeof(uint32_t) * IMAGE_SIZE * IMAGE_SIZE);
+    for (uint32_t y = 0; y < IMAGE_SIZE; ++y) {
+        for (uint32_t x = 0; x < IMAGE_SIZE; ++x) {
+            const uint32_t a = 0x80;
+            const uint32_t r = x * 2 * a / 255;
+            const uint32_t b = y * 2 * a / 255;
+            image[y * IMAGE_SIZE + x] = (a << 24) | (r << 16) | b;
+        }
+    }
+
+    for (int frame = 0;; ++frame) {
+        if (xw_wait_for_esc(handle, 1)) {
+            break;
+        }
+
+        xw_draw_background(handle, BACKGROUND);
+        for (int i = 0; i < 8; ++i) {
+            xw_draw_line_blend(handle, 20, 20 + i * 10, 300, 60 + i * 25, 1 + i, 0xC000FFFF);
+        }
+        xw_draw_rectangle_blend(handle, 320, 40, 200, 120, true, 0x80FF0000);
+        xw_draw_rectangle_blend(handle, 380, 80, 200, 120, true, 0x8000FF00);
+        xw_draw_circle_blend(handle, 160 + (frame % 200), 320, 80, true, 0x800000FF);
+        xw_draw_circle_blend(handle, 160, 320, 100, false, 0xFFFFFFFF);
+        xw_draw_triangle_blend(handle, 400, 250, 600, 300, 450, 450, 0xA0FFFF00);
+        xw_draw_image_blend(handle, image, IMAGE_SIZE, IMAGE_SIZE, 480, 300);
+
+        xw_draw(handle);
+        xw_sleep_ms(33);
+    }
+
+    free(image);
+    xw_free_window(handle);
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*
+This example shows the following features:
+1. A framebuffer in shared memory, rendered by another process.
+2. The ready/consumed handshake between the renderer and the window.
+3. Zero-copy drawing with MIT-SHM.
+ */
+#define XWRAP_IMPLEMENTATION
+#define XWRAP_AUTO_LINK
+#define XWRAP_SHM
+#include "../xwrap.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/wait.h>
+
+#define ESC 9
+
+// Runs in the child process, only touches the shared framebuffer
+void render(int fd)
+{
+    xw_shared* shared = xw_shared_open(fd);
+    if (shared == NULL) {
+        return;
+    }
+    uint16_t width, height;
+    uint32_t* pixels = xw_shared_pixels(shared, &width, &height);
+
+    for (uint32_t frame = 0;; ++frame) {
+        // The window stops releasing frames when it closes
+        if (!xw_shared_wait_consumed(shared, 1000 * 1000)) {
+            break;
+        }
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                pixels[y * width + x] = ((x + frame * 4) & 0xFF) << 16 | ((y + frame) & 0xFF);
+            }
+        }
+        xw_shared_submit(shared);
+    }
+    xw_shared_free(shared);
+}
+
+int main(int argc, char const* argv[])
+{
+    const unsigned int width  = 640;
+    const unsigned int height = 480;
+
+    xw_shared* shared = xw_shared_create(width, height);
+    if (shared == NULL) {
+        return 1;
+    }
+    // The child inherits the descriptor, other processes can get it with SCM_RIGHTS
+    const pid_t renderer = fork();
+    if (renderer == 0) {
+        render(xw_shared_fd(shared));
+        return 0;
+    }
+
+    xw_handle* handle = xw_create_window("shared", width, height);
+    if (!xw_image_connect_shared(handle, shared)) {
+        return 1;
+    }
+
+    for (;;) {
+        while (xw_event_pending(handle)) {
+            xw_event event;
+            xw_get_next_event(handle, &event);
+            if (event.type == KeyPress && event.button.key_code == ESC) {
+                goto shutdown;
+            }
+        }
+
+        if (xw_shared_wait_ready(shared, 100 * 1000)) {
+            xw_draw(handle);
+            xw_shared_release(handle, shared);
+        }
+        xw_sleep_ms(16);
+    }
+
+shutdown:
+    xw_free_window(handle);
+    waitpid(renderer, NULL, 0);
+    xw_shared_free(shared);
+
+    return 0;
+}
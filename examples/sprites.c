@@ -0,0 +1,146 @@
+/*
+This example shows the following features:
+1. Sprite atlas.
+2. Batched sprite drawing into an image.
+3. Frame time and upload counters.
+4. The frame time overlay, toggled with F1.
+ */
+#define XWRAP_IMPLEMENTATION
+#define XWRAP_AUTO_LINK
+#define XWRAP_STATS
+#include "../xwrap.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ESC 9
+#define F1 67
+#define SPRITES 10000
+#define SPRITE_SIZE 16
+#define BACKGROUND 0x181818
+
+typedef struct {
+    int x, y;
+    int vx, vy;
+} Body;
+
+// Soft edged ball, uses the alpha channel
+void make_ball(uint32_t* pixels, uint32_t color)
+{
+    const int r = SPRITE_SIZE / 2;
+    for (int y = 0; y < SPRITE_SIZE; y++) {
+        for (int x = 0; x < SPRITE_SIZE; x++) {
+            const int dx = x - r, dy = y - r;
+            const int d  = dx * dx + dy * dy;
+            uint32_t a   = d < (r - 2) * (r - 2) ? 0xFF : d < r * r ? 0x80 : 0x00;
+            pixels[y * SPRITE_SIZE + x] = (a << 24) | color;
+        }
+    }
+}
+
+// Arrow, uses the color key
+void make_arrow(uint32_t* pixels, uint32_t color)
+{
+    for (int y = 0; y < SPRITE_SIZE; y++) {
+        for (int x = 0; x < SPRITE_SIZE; x++) {
+            const bool inside = x < SPRITE_SIZE / 2 ? (y > 5 && y < 10) : (abs(y - 8) < 16 - x);
+            pixels[y * SPRITE_SIZE + x] = inside ? 0xFF000000 | color : 0xFF00FF;
+        }
+    }
+}
+
+int main(int argc, char const* argv[])
+{
+    const unsigned int width  = 640;
+    const unsigned int height = 480;
+    xw_handle* handle         = xw_create_window("sprites", width, height);
+
+    uint32_t* image_buffer = (uint32_t*)malloc(sizeof(uint32_t) * height * width);
+    if (!xw_image_connect(handle, image_buffer, width, height)) {
+        return 1;
+    }
+
+    xw_atlas* atlas = xw_atlas_create(256, 256);
+    uint32_t pixels[SPRITE_SIZE * SPRITE_SIZE];
+    make_ball(pixels, 0xFF4040);
+    const int ball = xw_atlas_add(atlas, pixels, SPRITE_SIZE, SPRITE_SIZE);
+    make_arrow(pixels, 0x40FF40);
+    const int arrow = xw_atlas_add(atlas, pixels, SPRITE_SIZE, SPRITE_SIZE);
+
+    static Body bodies[SPRITES];
+    static xw_sprite balls[SPRITES / 2];
+    static xw_sprite arrows[SPRITES / 2];
+    for (size_t i = 0; i < SPRITES; ++i) {
+        bodies[i] = (Body){.x  = rand() % width,
+                           .y  = rand() % height,
+                           .vx = rand() % 5 - 2,
+                           .vy = rand() % 5 - 2};
+    }
+
+    bool overlay = false;
+    for (size_t frame = 0;; ++frame) {
+        while (xw_event_pending(handle)) {
+            xw_event event;
+            xw_get_next_event(handle, &event);
+            if (event.type == KeyPress && event.button.key_code == ESC) {
+                goto shutdown;
+            }
+            if (event.type == KeyPress && event.button.key_code == F1) {
+                overlay = !overlay;
+                xw_overlay_enable(handle, overlay);
+            }
+        }
+
+        for (size_t i = 0; i < SPRITES; ++i) {
+            Body* b = &bodies[i];
+            b->x += b->vx;
+            b->y += b->vy;
+            if (b->x < -SPRITE_SIZE || b->x > (int)width) {
+                b->vx = -b->vx;
+            }
+            if (b->y < -SPRITE_SIZE || b->y > (int)height) {
+                b->vy = -b->vy;
+            }
+            if (i % 2 == 0) {
+                balls[i / 2] = (xw_sprite){.id = ball, .x = b->x, .y = b->y, .alpha = 255};
+            } else {
+                arrows[i / 2] = (xw_sprite){.id    = arrow,
+                                            .x     = b->x,
+                                            .y     = b->y,
+                                            .flip  = b->vx < 0 ? XW_FLIP_HORIZONTAL : XW_FLIP_NONE,
+                                            .alpha = 200};
+            }
+        }
+
+        for (size_t i = 0; i < height * width; ++i) {
+            image_buffer[i] = BACKGROUND;
+        }
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        xw_draw_sprites(handle, atlas, balls, SPRITES / 2, XW_BLEND_ALPHA);
+        xw_draw_sprites(handle, atlas, arrows, SPRITES / 2, XW_BLEND_COLOR_KEY);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (frame % 60 == 0) {
+            printf("%d sprites in %.3f ms\n", SPRITES,
+                   (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+        }
+
+        xw_draw(handle);
+        xw_sleep_ms(16);
+    }
+
+shutdown:;
+    const xw_stats stats = xw_get_stats(handle);
+    printf("%lu frames, p50 %lu us, p99 %lu us, %lu MB uploaded, %.3f ms per xw_draw\n",
+           (unsigned long)stats.frames, (unsigned long)xw_stats_frame_percentile(&stats, 50),
+           (unsigned long)xw_stats_frame_percentile(&stats, 99),
+           (unsigned long)(stats.bytes_uploaded >> 20),
+           stats.requests[XW_STAT_IMAGE] ? stats.draw_ns / 1e6 / stats.requests[XW_STAT_IMAGE] : 0);
+
+    xw_atlas_free(atlas);
+    xw_free_window(handle);
+    free(image_buffer);
+
+    return 0;
+}
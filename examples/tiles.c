@@ -0,0 +1,94 @@
+/*
+This example shows the following features:
+1. Viewing a raw image file bigger than the memory through a cache of tiles.
+2. Building the pyramid of smaller levels on the first open.
+3. Panning by dragging and zooming with the mouse wheel.
+
+usage: tiles <file> <width> <height>
+The file holds 0xXXRRGGBB pixels in rows, without a header.
+ */
+#define XWRAP_IMPLEMENTATION
+#define XWRAP_AUTO_LINK
+#define XWRAP_THREADS
+#include "../xwrap.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ESC 9
+
+int main(int argc, char const* argv[])
+{
+    if (argc < 4) {
+        printf("usage: %s <file> <width> <height>\n", argv[0]);
+        return 1;
+    }
+    char pyramid[4096];
+    snprintf(pyramid, sizeof(pyramid), "%s.pyramid", argv[1]);
+    xw_tiles* tiles = xw_tiles_open(argv[1], atoi(argv[2]), atoi(argv[3]), 0, pyramid, 256);
+    if (tiles == NULL) {
+        return 1;
+    }
+
+    const unsigned int width  = 1024;
+    const unsigned int height = 768;
+    xw_handle* handle         = xw_create_window("tiles", width, height);
+
+    uint32_t* image_buffer = (uint32_t*)malloc(sizeof(uint32_t) * height * width);
+    if (!xw_image_connect(handle, image_buffer, width, height)) {
+        return 1;
+    }
+
+    double x = 0, y = 0, zoom = 1;
+    bool dragging = false;
+    int drag_x    = 0;
+    int drag_y    = 0;
+    for (;;) {
+        while (xw_event_pending(handle)) {
+            xw_event event;
+            xw_get_next_event(handle, &event);
+            switch (event.type) {
+                case KeyPress:
+                    if (event.button.key_code == ESC) {
+                        goto shutdown;
+                    }
+                    break;
+                case ButtonPress:
+                    if (event.mouse.button == Button1) {
+                        dragging = true;
+                        drag_x   = event.mouse.x;
+                        drag_y   = event.mouse.y;
+                    } else if (event.mouse.button == Button4 || event.mouse.button == Button5) {
+                        // Zoom around the pixel under the mouse
+                        const double scale = event.mouse.button == Button4 ? 1.25 : 0.8;
+                        x += event.mouse.x / zoom - event.mouse.x / (zoom * scale);
+                        y += event.mouse.y / zoom - event.mouse.y / (zoom * scale);
+                        zoom *= scale;
+                    }
+                    break;
+                case ButtonRelease:
+                    dragging = event.mouse.button == Button1 ? false : dragging;
+                    break;
+                case MotionNotify:
+                    if (dragging) {
+                        x -= (event.mouse.x - drag_x) / zoom;
+                        y -= (event.mouse.y - drag_y) / zoom;
+                        drag_x = event.mouse.x;
+                        drag_y = event.mouse.y;
+                    }
+                    break;
+            }
+        }
+
+        xw_draw_tiles(handle, tiles, x, y, zoom);
+        xw_draw(handle);
+        xw_sleep_ms(16);
+    }
+
+shutdown:
+    xw_free_window(handle);
+    xw_tiles_close(tiles);
+    free(image_buffer);
+
+    return 0;
+}
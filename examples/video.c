@@ -0,0 +1,77 @@
+/*
+This example shows the following features:
+1. Converting NV12 frames, like the ones from cameras and decoders, into the image.
+2. Placing the frame in a region of the image, partly outside of it.
+ */
+#define XWRAP_IMPLEMENTATION
+#define XWRAP_AUTO_LINK
+#define XWRAP_THREADS
+#include "../xwrap.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ESC 9
+
+#define FRAME_WIDTH  640
+#define FRAME_HEIGHT 360
+
+int main(void)
+{
+    const unsigned int width  = 800;
+    const unsigned int height = 450;
+    xw_handle* handle         = xw_create_window("video", width, height);
+
+    uint32_t* image_buffer = (uint32_t*)calloc(height * width, sizeof(uint32_t));
+    if (!xw_image_connect(handle, image_buffer, width, height)) {
+        return 1;
+    }
+
+    uint8_t* luma   = (uint8_t*)malloc(FRAME_WIDTH * FRAME_HEIGHT);
+    uint8_t* chroma = (uint8_t*)malloc(FRAME_WIDTH * FRAME_HEIGHT / 2);
+
+    xw_yuv_frame frame = {
+        .format  = XW_YUV_NV12,
+        .matrix  = XW_YUV_BT709,
+        .width   = FRAME_WIDTH,
+        .height  = FRAME_HEIGHT,
+        .planes  = {luma, chroma},
+        .strides = {FRAME_WIDTH, FRAME_WIDTH},
+    };
+
+    for (uint32_t tick = 0;; ++tick) {
+        while (xw_event_pending(handle)) {
+            xw_event event;
+            xw_get_next_event(handle, &event);
+            if (event.type == KeyPress && event.button.key_code == ESC) {
+                goto shutdown;
+            }
+        }
+
+        // A moving luma ramp over chroma bars, in limited range
+        for (int y = 0; y < FRAME_HEIGHT; ++y) {
+            for (int x = 0; x < FRAME_WIDTH; ++x) {
+                luma[y * FRAME_WIDTH + x] = 16 + ((x + y + tick * 2) % 220);
+            }
+        }
+        for (int y = 0; y < FRAME_HEIGHT / 2; ++y) {
+            for (int x = 0; x < FRAME_WIDTH / 2; ++x) {
+                uint8_t* uv = &chroma[y * FRAME_WIDTH + x * 2];
+                uv[0]       = 16 + (x / 40) * 28;
+                uv[1]       = 240 - (y / 30) * 37;
+            }
+        }
+
+        xw_draw_yuv(handle, &frame, (int)(tick % 400) - 120, 45);
+        xw_draw(handle);
+        xw_sleep_ms(16);
+    }
+
+shutdown:
+    xw_free_window(handle);
+    free(image_buffer);
+    free(luma);
+    free(chroma);
+
+    return 0;
+}
@@ -0,0 +1,4 @@
+// The implementation for the C++ examples, the C++ files only include the header
+#define XWRAP_IMPLEMENTATION
+#define XWRAP_AUTO_LINK
+#include "../xwrap.h"
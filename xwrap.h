@@ -6,6 +6,25 @@ use example:
        // Before you include the file in *one* C or C++ file to create the implementation.
     #define XWRAP_AUTO_LINK
         // Enable runtime linking, eliminating the need for manual linking.
+    #define XWRAP_RENDER
+        // Optional, use XRender for the `xw_draw_*_blend` family (needs libXrender).
+    #define XWRAP_XCB
+        // Optional, use XCB for queries so they do not stall (needs libX11-xcb and libxcb).
+    #define XWRAP_PRESENT
+        // Optional, vsync aligned `xw_present` with timing events (needs libxcb-present, sets
+        // XWRAP_XCB).
+    #define XWRAP_SHM
+        // Optional, zero-copy `xw_draw` of shared framebuffers with MIT-SHM (needs libxcb-shm,
+        // sets XWRAP_XCB).
+    #define XWRAP_RECORD
+        // Optional, record the drawn frames to a file from a thread (needs pthread).
+    #define XWRAP_THREADS
+        // Optional, split the row kernels like `xw_draw_colormap` across threads and prefetch
+        // `xw_tiles` from a thread (needs pthread).
+    #define XWRAP_STATS
+        // Optional, count requests and time the calls for `xw_get_stats`.
+    #define XWRAP_TRACE
+        // Optional, record spans of the calls for `xw_trace_dump` (Chrome trace JSON).
     #include "xwrap.h"
 
     // Create window
@@ -57,6 +76,25 @@ extern "C" {
 
 typedef struct _xw_handle xw_handle;
 
+typedef struct {
+    int width, height;
+    int x_pos, y_pos; // Of the window in the screen
+} xw_dimensions;
+
+typedef struct {
+    int x, y;
+    unsigned int width, height;
+} xw_rect;
+
+// Event types that xwrap adds on top of the X11 core event types
+enum {
+    XW_EVENT_SHAPE_ENTER = 128,
+    XW_EVENT_SHAPE_LEAVE,
+    XW_EVENT_PRESENT_COMPLETE,
+    XW_EVENT_RESIZE, // The size changed, the position may have changed too
+    XW_EVENT_MOVE,   // Only the position or the stacking changed
+};
+
 typedef struct {
     int type;
     unsigned int button;
@@ -69,19 +107,45 @@ typedef struct {
     uint16_t key_code;
 } xw_button_event;
 
+typedef struct {
+    int type;
+    int id; // The shape or region that was entered or left
+    int x, y;
+} xw_shape_event;
+
+typedef struct {
+    int type;
+    uint32_t serial; // As returned from 'xw_present'
+    uint64_t ust;    // System time of the vblank in microseconds
+    uint64_t msc;    // Vblank counter of the frame
+} xw_present_event;
+
+typedef struct {
+    int type;
+    xw_dimensions dimensions; // The new dimensions, also returned by 'xw_get_dimensions'
+} xw_configure_event;
+
+typedef struct {
+    int type;
+    xw_rect rect; // The part of the window that lost its contents
+} xw_expose_event;
+
 typedef struct {
     union {
         int type;
         xw_mouse_event mouse;
         xw_button_event button;
+        xw_shape_event shape;
+        xw_present_event present;
+        xw_configure_event configure;
+        xw_expose_event expose;
     };
     char original_event[192]; // TODO: make it use 'XEvent' struct
 } xw_event;
 
 typedef struct {
-    int width, height;
-    int x_pos, y_pos; // Of the window in the screen
-} xw_dimensions;
+    unsigned int sequence;
+} xw_cookie;
 
 /**
  * @brief Creates X11 window
@@ -92,6 +156,20 @@ typedef struct {
  * @return xw_handle* The handle for the xwrap
  */
 XW_DEF xw_handle* xw_create_window(const char* window_name, int width, int height);
+/**
+ * @brief Creates X11 window on the connection of another window
+ * @note 'xw_draw_many' sends the windows of one connection with a single flush. Each window
+ *       reads only its own events, the others wait in the X11 queue. The X errors are kept by
+ *       the window that sent the failed request.
+ *
+ * @param window_name The name of the window
+ * @param width Width of the new window
+ * @param height Height of the new window
+ * @param share The window whose connection is used, it can be freed before the new one
+ * @return xw_handle* The handle for the xwrap
+ */
+XW_DEF xw_handle* xw_create_window_shared(const char* window_name, int width, int height,
+                                          xw_handle* share);
 /**
  * @brief Free the window
  *
@@ -118,6 +196,102 @@ XW_DEF const char* xw_get_window_name(xw_handle* handle);
  * @return bool true if OK, false if failed
  */
 XW_DEF bool xw_image_connect(xw_handle* handle, uint32_t* buffer, uint16_t width, uint16_t height);
+/**
+ * @brief Connect image with padded rows to the window by pointer
+ * @note Use 'xw_draw_region' to draw a crop of it
+ *
+ * @param handle The handle for the xwrap
+ * @param buffer The image to be connected
+ * @param width Width of the image
+ * @param height Height of the image
+ * @param stride Bytes from a row to the next, a multiple of 4, 0 for 'width * 4'
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_image_connect_strided(xw_handle* handle, uint32_t* buffer, uint16_t width,
+                                     uint16_t height, size_t stride);
+
+// A framebuffer in shared memory, another process maps it from the file descriptor
+typedef struct _xw_shared xw_shared;
+
+/**
+ * @brief Creates a framebuffer in shared memory (memfd)
+ *
+ * @param width Width of the image
+ * @param height Height of the image
+ * @return xw_shared* The framebuffer, NULL if failed
+ */
+XW_DEF xw_shared* xw_shared_create(uint16_t width, uint16_t height);
+/**
+ * @brief Maps a framebuffer made by 'xw_shared_create', usually in another process
+ * @note Pass the descriptor with SCM_RIGHTS or open '/proc/<pid>/fd/<fd>'
+ *
+ * @param fd The file descriptor of the framebuffer, owned by the returned framebuffer
+ * @return xw_shared* The framebuffer, NULL if failed
+ */
+XW_DEF xw_shared* xw_shared_open(int fd);
+/**
+ * @brief Unmaps the framebuffer and closes its file descriptor, free the handles using it first
+ *
+ * @param shared The framebuffer
+ */
+XW_DEF void xw_shared_free(xw_shared* shared);
+/**
+ * @brief Returns the file descriptor to give to the other process
+ *
+ * @param shared The framebuffer
+ * @return int The file descriptor
+ */
+XW_DEF int xw_shared_fd(xw_shared* shared);
+/**
+ * @brief Returns the pixels of the framebuffer
+ *
+ * @param shared The framebuffer
+ * @param width Returns the width of the image, can be NULL
+ * @param height Returns the height of the image, can be NULL
+ * @return uint32_t* The pixels, 'width' * 'height' of them
+ */
+XW_DEF uint32_t* xw_shared_pixels(xw_shared* shared, uint16_t* width, uint16_t* height);
+/**
+ * @brief Connects the framebuffer as the image of the window
+ * @note With 'XWRAP_SHM' the X server reads the pixels in place, without a copy
+ *
+ * @param handle The handle for the xwrap
+ * @param shared The framebuffer
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_image_connect_shared(xw_handle* handle, xw_shared* shared);
+/**
+ * @brief Producer side, marks the frame as ready for the consumer
+ *
+ * @param shared The framebuffer
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_shared_submit(xw_shared* shared);
+/**
+ * @brief Consumer side, waits until the producer submits a frame
+ *
+ * @param shared The framebuffer
+ * @param timeout In microseconds, 0 waits forever
+ * @return bool true if a frame is ready, false on timeout
+ */
+XW_DEF bool xw_shared_wait_ready(xw_shared* shared, uint64_t timeout);
+/**
+ * @brief Consumer side, gives the framebuffer back to the producer, call after 'xw_draw'
+ * @note Waits for the X server to read the pixels
+ *
+ * @param handle The handle the framebuffer is connected to, can be NULL
+ * @param shared The framebuffer
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_shared_release(xw_handle* handle, xw_shared* shared);
+/**
+ * @brief Producer side, waits until the consumer releases the last frame
+ *
+ * @param shared The framebuffer
+ * @param timeout In microseconds, 0 waits forever
+ * @return bool true if the framebuffer can be written, false on timeout
+ */
+XW_DEF bool xw_shared_wait_consumed(xw_shared* shared, uint64_t timeout);
 /**
  * @brief Finish and draw all the shapes that has been queued
  *
@@ -125,6 +299,230 @@ XW_DEF bool xw_image_connect(xw_handle* handle, uint32_t* buffer, uint16_t width
  * @return bool true if OK, false if failed
  */
 XW_DEF bool xw_draw(xw_handle* handle);
+/**
+ * @brief Draws a part of the connected image to a position in the window, without a copy
+ *
+ * @param handle The handle for the xwrap
+ * @param source The part of the image, clipped to the image
+ * @param x The x-coordinate in the window
+ * @param y The y-coordinate in the window
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_draw_region(xw_handle* handle, xw_rect source, int x, int y);
+/**
+ * @brief Draws the frames of many windows, then flushes each connection once
+ * @note With shared images, returns when the server has read the images of all the windows
+ *
+ * @param handles The windows, from 'xw_create_window_shared' to update them together
+ * @param count Number of windows
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_draw_many(xw_handle** handles, size_t count);
+/**
+ * @brief Sends all the queued requests to the X server
+ *
+ * @param handle The handle for the xwrap
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_flush(xw_handle* handle);
+/**
+ * @brief Sets if 'xw_draw' flushes, disable to flush by hand with 'xw_flush'
+ *
+ * @param handle The handle for the xwrap
+ * @param auto_flush true by default
+ */
+XW_DEF void xw_set_auto_flush(xw_handle* handle, bool auto_flush);
+/**
+ * @brief Switches 'xw_present' to the X Present extension, call after 'xw_image_connect'
+ * @note Needs 'XWRAP_PRESENT', every presented frame sends 'XW_EVENT_PRESENT_COMPLETE'. Unread
+ * completions are dropped from the oldest when the event queue is full
+ *
+ * @param handle The handle for the xwrap
+ * @return bool true if Present is used, false if 'xw_present' falls back to 'xw_draw'
+ */
+XW_DEF bool xw_present_enable(xw_handle* handle);
+/**
+ * @brief Shows the connected image on a vblank, without tearing
+ *
+ * @param handle The handle for the xwrap
+ * @param target_msc The vblank counter to show the image at, 0 for the next one
+ * @param serial Returns the serial of the 'XW_EVENT_PRESENT_COMPLETE', can be NULL
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_present(xw_handle* handle, uint64_t target_msc, uint32_t* serial);
+
+typedef enum {
+    XW_RECORD_Y4M, // I420 BT.601 video, every frame header has the time in 'Xus='
+    XW_RECORD_RAW, // For every frame a uint64_t time in us then the BGRX pixels
+} xw_record_format;
+
+/**
+ * @brief Starts recording every drawn frame of the connected image to a file
+ * @note Needs 'XWRAP_RECORD', a thread writes the file, frames are dropped when it falls behind
+ *       or when the image size changes. Only one recording per handle.
+ *
+ * @param handle The handle for the xwrap, with a connected image
+ * @param path The file to write, truncated
+ * @param format The file format
+ * @param fps The frame rate written in the Y4M header
+ * @param ring_frames How many frames can wait for the writer, 0 for the default (8)
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_record_start(xw_handle* handle, const char* path, xw_record_format format,
+                            unsigned int fps, unsigned int ring_frames);
+/**
+ * @brief Writes the waiting frames and closes the recording, called by 'xw_free_window'
+ *
+ * @param handle The handle for the xwrap
+ * @param dropped Returns how many frames were dropped, can be NULL
+ * @return bool true if every written frame reached the file, false if failed
+ */
+XW_DEF bool xw_record_stop(xw_handle* handle, uint64_t* dropped);
+/**
+ * @brief Returns how many frames were dropped so far by the recording of the handle
+ *
+ * @param handle The handle for the xwrap
+ * @return uint64_t The dropped frames, 0 when not recording
+ */
+XW_DEF uint64_t xw_record_dropped(xw_handle* handle);
+
+// Kinds of X requests counted by 'xw_stats'
+typedef enum {
+    XW_STAT_IMAGE, // 'xw_draw', 'xw_present' and 'xw_draw_image_blend' uploads
+    XW_STAT_RECTANGLE,
+    XW_STAT_LINE,
+    XW_STAT_CIRCLE,
+    XW_STAT_PIXEL,
+    XW_STAT_TRIANGLE,
+    XW_STAT_TEXT,
+    XW_STAT_PLOT,
+    XW_STAT_BACKGROUND,
+    XW_STAT_BLEND, // XRender requests of the 'xw_draw_*_blend' family
+    XW_STAT_COUNT,
+} xw_stat_request;
+
+#define XW_STATS_BUCKETS 96 // Frame time buckets, 4 per power of two microseconds
+
+typedef struct {
+    uint64_t requests[XW_STAT_COUNT]; // By 'xw_stat_request'
+    uint64_t bytes_uploaded;          // Pixels sent for the connected image
+    uint64_t flushes;
+    uint64_t events; // Decoded from X11 by 'xw_get_next_event'
+
+    uint64_t draw_ns;   // Spent in 'xw_draw' and 'xw_present'
+    uint64_t event_ns;  // Spent in 'xw_get_next_event', waiting included
+    uint64_t create_ns; // Spent in 'xw_create_window' of this handle, kept by 'xw_reset_stats'
+    uint64_t free_ns;   // Spent in 'xw_free_window' of all the windows closed before
+    uint64_t link_ns;   // Spent in dlopen and dlsym by all the windows, with 'XWRAP_AUTO_LINK'
+
+    // Time between frames, read with 'xw_stats_frame_percentile'
+    uint64_t frames;
+    uint64_t frame_min_us, frame_max_us;
+    uint64_t frame_histogram[XW_STATS_BUCKETS];
+} xw_stats;
+
+/**
+ * @brief Returns the counters of the handle
+ * @note Needs 'XWRAP_STATS', without it the counters compile out and are all 0
+ *
+ * @param handle The handle for the xwrap
+ * @return xw_stats The counters since the creation or the last 'xw_reset_stats'
+ */
+XW_DEF xw_stats xw_get_stats(xw_handle* handle);
+/**
+ * @brief Sets the counters of the handle back to 0
+ *
+ * @param handle The handle for the xwrap
+ */
+XW_DEF void xw_reset_stats(xw_handle* handle);
+/**
+ * @brief Returns a frame time percentile from the histogram
+ * @note The bucket bounds have about 19% precision
+ *
+ * @param stats The counters from 'xw_get_stats'
+ * @param percentile From 0 to 100
+ * @return uint64_t The frame time in microseconds, 0 without frames
+ */
+XW_DEF uint64_t xw_stats_frame_percentile(const xw_stats* stats, double percentile);
+
+/**
+ * @brief Writes the recorded spans of all the threads as Chrome trace JSON
+ * @note Needs 'XWRAP_TRACE', open the file in Perfetto or chrome://tracing
+ *
+ * @param path The file to write, truncated
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_trace_dump(const char* path);
+/**
+ * @brief Calls 'xw_trace_dump' when the program exits
+ *
+ * @param path The file to write, copied
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_trace_dump_at_exit(const char* path);
+/**
+ * @brief Starts a span of your own, finish it with 'xw_trace_end'
+ *
+ * @return uint64_t The start of the span, 0 without 'XWRAP_TRACE'
+ */
+XW_DEF uint64_t xw_trace_begin(void);
+/**
+ * @brief Records a span of your own, with the window and frame of the handle
+ *
+ * @param handle The handle the span belongs to, can be NULL
+ * @param name The name of the span, must live until the dump
+ * @param begin The start from 'xw_trace_begin'
+ */
+XW_DEF void xw_trace_end(xw_handle* handle, const char* name, uint64_t begin);
+
+/**
+ * @brief Shows or hides the frame time overlay in the top left corner of the window
+ * @note Drawn by 'xw_draw' and 'xw_present' with a few batched requests, it graphs the frame
+ *       time over the upload time and prints the FPS, the events per frame and its own cost
+ *
+ * @param handle The handle for the xwrap
+ * @param enable true to show the overlay
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_overlay_enable(xw_handle* handle, bool enable);
+
+// An X error, caught instead of exiting
+typedef struct {
+    unsigned long serial;   // Of the failed request
+    unsigned long resource; // The bad resource id, when there is one
+    uint8_t error_code;     // BadWindow, BadAlloc, ...
+    uint8_t request_code;   // The major opcode of the failed request
+    uint8_t minor_code;     // For extension requests
+    const char* call;       // The xwrap function that sent the request, "" when unknown
+} xw_error;
+
+/**
+ * @brief Takes the X errors caught for the handle, oldest first
+ * @note No round trip, errors show up once the X server answers, e.g. after
+ *       'xw_event_pending'. Xlib's default handler is replaced, errors no longer exit.
+ *
+ * @param handle The handle for the xwrap
+ * @param errors Returns the errors
+ * @param max The size of 'errors'
+ * @return size_t How many errors were written
+ */
+XW_DEF size_t xw_get_errors(xw_handle* handle, xw_error* errors, size_t max);
+/**
+ * @brief Returns how many errors were lost because they were not taken in time
+ *
+ * @param handle The handle for the xwrap
+ * @return uint64_t The lost errors since the creation of the handle
+ */
+XW_DEF uint64_t xw_errors_lost(xw_handle* handle);
+/**
+ * @brief Describes an error
+ *
+ * @param handle The handle for the xwrap
+ * @param error The error from 'xw_get_errors'
+ * @param buffer Returns the text
+ * @param length The size of 'buffer'
+ */
+XW_DEF void xw_error_text(xw_handle* handle, const xw_error* error, char* buffer, int length);
 
 /**
  * @brief Clears the window with color
@@ -211,6 +609,85 @@ XW_DEF bool xw_draw_pixel(xw_handle* handle, int x, int y, uint32_t color);
 XW_DEF bool xw_draw_triangle(xw_handle* handle, int x0, int y0, int x1, int y1, int x2, int y2,
                              uint32_t color);
 
+/**
+ * @brief Checks if the '_blend' functions are done by XRender
+ * @note Needs 'XWRAP_RENDER', otherwise they fall back to core drawing without alpha
+ *
+ * @param handle The handle for the xwrap
+ * @return bool true if XRender is used
+ */
+XW_DEF bool xw_render_available(xw_handle* handle);
+/**
+ * @brief Draws an alpha blended rectangle - use 'xw_draw' to finish the drawing
+ *
+ * @param handle The handle for the xwrap
+ * @param x The x-coordinate of the top-left corner of the rectangle
+ * @param y The y-coordinate of the top-left corner of the rectangle
+ * @param width The width of the rectangle
+ * @param height The height of the rectangle
+ * @param fill Set to true for filled rectangle, false for outline
+ * @param color The color of the rectangle in 0xAARRGGBB
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_draw_rectangle_blend(xw_handle* handle, int x, int y, unsigned int width,
+                                    unsigned int height, bool fill, uint32_t color);
+/**
+ * @brief Draws an antialiased, alpha blended line - use 'xw_draw' to finish the drawing
+ *
+ * @param handle The handle for the xwrap
+ * @param x0 The x-coordinate of the starting point of the line
+ * @param y0 The y-coordinate of the starting point of the line
+ * @param x1 The x-coordinate of the ending point of the line
+ * @param y1 The y-coordinate of the ending point of the line
+ * @param width The width of the line
+ * @param color The color of the line in 0xAARRGGBB
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_draw_line_blend(xw_handle* handle, int x0, int y0, int x1, int y1, uint16_t width,
+                               uint32_t color);
+/**
+ * @brief Draws an antialiased, alpha blended circle - use 'xw_draw' to finish the drawing
+ *
+ * @param handle The handle for the xwrap
+ * @param x The x-coordinate of the center of the circle
+ * @param y The y-coordinate of the center of the circle
+ * @param r The radius of the circle
+ * @param fill Set to true for filled circle, false for outline
+ * @param color The color of the circle in 0xAARRGGBB
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_draw_circle_blend(xw_handle* handle, int x, int y, int r, bool fill,
+                                 uint32_t color);
+/**
+ * @brief Draws an antialiased, alpha blended triangle - use 'xw_draw' to finish the drawing
+ *
+ * @param handle The handle for the xwrap
+ * @param x0 The x-coordinate of the first point of the triangle
+ * @param y0 The y-coordinate of the first point of the triangle
+ * @param x1 The x-coordinate of the second point of the triangle
+ * @param y1 The y-coordinate of the second point of the triangle
+ * @param x2 The x-coordinate of the third point of the triangle
+ * @param y2 The y-coordinate of the third point of the triangle
+ * @param color The color of the triangle in 0xAARRGGBB
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_draw_triangle_blend(xw_handle* handle, int x0, int y0, int x1, int y1, int x2,
+                                   int y2, uint32_t color);
+/**
+ * @brief Uploads the image and blends it over the window on the server
+ * @note Without XRender the image is drawn opaque
+ *
+ * @param handle The handle for the xwrap
+ * @param buffer The image in premultiplied 0xAARRGGBB
+ * @param width Width of the image
+ * @param height Height of the image
+ * @param x The x-coordinate of the top-left corner of the image
+ * @param y The y-coordinate of the top-left corner of the image
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_draw_image_blend(xw_handle* handle, uint32_t* buffer, uint16_t width,
+                                uint16_t height, int x, int y);
+
 /**
  * @brief Checks if there is events in the event queue
  *
@@ -235,28 +712,94 @@ XW_DEF bool xw_get_next_event(xw_handle* handle, xw_event* event);
  */
 XW_DEF bool xw_push_back_event(xw_handle* handle, xw_event event);
 
+/**
+ * @brief Starts writing the events from the X11 queue to a file
+ * @note Each event is saved decoded with its time, for 'xw_input_replay_start'
+ *
+ * @param handle The handle for the xwrap
+ * @param path The file of the log
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_input_record_start(xw_handle* handle, const char* path);
+/**
+ * @brief Serves the events of a log instead of the X11 queue
+ * @note The X11 events are dropped while replaying, the xwrap events are still served.
+ *       The replayed resize events carry the recorded dimensions, 'xw_get_dimensions' the real.
+ *
+ * @param handle The handle for the xwrap
+ * @param path The file from 'xw_input_record_start'
+ * @param realtime true to keep the recorded times, false to give each event to the same
+ *                 'xw_event_pending' loop it was recorded in, without waiting
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_input_replay_start(xw_handle* handle, const char* path, bool realtime);
+/**
+ * @brief Checks if a replay still has events
+ *
+ * @param handle The handle for the xwrap
+ * @return bool true until the last event of the log is served
+ */
+XW_DEF bool xw_input_replaying(xw_handle* handle);
+/**
+ * @brief Closes the record or the replay, called by 'xw_free_window'
+ *
+ * @param handle The handle for the xwrap
+ * @return bool true if the whole record reached the file, false if failed
+ */
+XW_DEF bool xw_input_stop(xw_handle* handle);
+
 /**
  * @brief Get the dimensions of the opened screen
+ * @note Kept from the resize and move events, no request is sent. The cache is stale until
+ * the application reads the events with 'xw_get_next_event', on a shared display each window
+ * reads its own. 'xw_request_dimensions' asks the server instead
  *
  * @param handle the handle for the xwrap
  * @return xw_dimensions struct
  */
 XW_DEF xw_dimensions xw_get_dimensions(xw_handle* handle);
-
 /**
- * @brief Sleeps for x time
+ * @brief Sends a dimensions query to the X server without waiting for the answer
+ * @note With 'XWRAP_XCB' the query is pipelined, otherwise it is sent by 'xw_reply_dimensions'
  *
- * @param nanoseconds how many ns to sleep
+ * @param handle the handle for the xwrap
+ * @return xw_cookie To pass to 'xw_reply_dimensions'
  */
-XW_DEF void xw_sleep_us(unsigned long nanoseconds);
+XW_DEF xw_cookie xw_request_dimensions(xw_handle* handle);
 /**
- * @brief Sleeps for x time
+ * @brief Waits for the answer of 'xw_request_dimensions'
+ * @note Every cookie has to be replied exactly once
  *
- * @param milliseconds
+ * @param handle the handle for the xwrap
+ * @param cookie From 'xw_request_dimensions'
+ * @param dimensions The dimensions that returns
+ * @return bool true if OK, false if failed
  */
-XW_DEF void xw_sleep_ms(unsigned long milliseconds);
+XW_DEF bool xw_reply_dimensions(xw_handle* handle, xw_cookie cookie, xw_dimensions* dimensions);
 /**
- * @brief Wait for ESC to be click
+ * @brief Get the dimensions of many windows with one wait for all of them
+ *
+ * @param handles The handles for the xwrap
+ * @param count Number of handles
+ * @param dimensions Array of 'count' dimensions that returns
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_get_dimensions_many(xw_handle** handles, size_t count, xw_dimensions* dimensions);
+
+/**
+ * @brief Sleeps for x time
+ *
+ * @param nanoseconds how many ns to sleep
+ */
+XW_DEF void xw_sleep_us(unsigned long nanoseconds);
+/**
+ * @brief Sleeps for x time
+ *
+ * @param milliseconds
+ */
+XW_DEF void xw_sleep_ms(unsigned long milliseconds);
+/**
+ * @brief Wait for ESC to be click
  *
  * @param handle the handle for the xwrap
  * @param timeout in us, 0 for forever wait
@@ -264,18 +807,550 @@ XW_DEF void xw_sleep_ms(unsigned long milliseconds);
  */
 XW_DEF bool xw_wait_for_esc(xw_handle* handle, uint64_t timeout);
 
+typedef struct _xw_atlas xw_atlas;
+
+typedef enum {
+    XW_FLIP_NONE       = 0,
+    XW_FLIP_HORIZONTAL = 1 << 0,
+    XW_FLIP_VERTICAL   = 1 << 1,
+} xw_flip;
+
+typedef enum {
+    XW_BLEND_ALPHA,     // Uses the sprite alpha channel (0xAARRGGBB) times the draw alpha
+    XW_BLEND_COLOR_KEY, // Skips pixels that match the atlas color key
+} xw_blend;
+
+typedef struct {
+    int id;        // As returned from 'xw_atlas_add'
+    int x, y;      // Top-left corner in the image
+    uint8_t flip;  // 'xw_flip' flags
+    uint8_t alpha; // 255 for opaque
+} xw_sprite;
+
+/**
+ * @brief Creates an empty sprite atlas
+ *
+ * @param width Width of the atlas
+ * @param height Height of the atlas
+ * @return xw_atlas* The atlas, NULL if failed
+ */
+XW_DEF xw_atlas* xw_atlas_create(uint16_t width, uint16_t height);
+/**
+ * @brief Free the atlas
+ *
+ * @param atlas The atlas to free
+ */
+XW_DEF void xw_atlas_free(xw_atlas* atlas);
+/**
+ * @brief Packs a copy of the image into the atlas
+ *
+ * @param atlas The atlas
+ * @param pixels The image in 0xAARRGGBB
+ * @param width Width of the image
+ * @param height Height of the image
+ * @return int The sprite id, -1 if the atlas is full
+ */
+XW_DEF int xw_atlas_add(xw_atlas* atlas, const uint32_t* pixels, uint16_t width, uint16_t height);
+/**
+ * @brief Sets the color that is skipped with 'XW_BLEND_COLOR_KEY'
+ * @note The alpha byte is ignored, default is 0xFF00FF
+ *
+ * @param atlas The atlas
+ * @param color The transparent color
+ */
+XW_DEF void xw_atlas_set_color_key(xw_atlas* atlas, uint32_t color);
+/**
+ * @brief Blits a batch of sprites into the connected image - use 'xw_draw' to finish the drawing
+ * @note Sprites are drawn in order and clipped to the image
+ *
+ * @param handle The handle for the xwrap
+ * @param atlas The atlas the sprites are taken from
+ * @param sprites The sprites to draw
+ * @param count Number of sprites
+ * @param blend How the sprites are blended into the image
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_draw_sprites(xw_handle* handle, const xw_atlas* atlas, const xw_sprite* sprites,
+                            size_t count, xw_blend blend);
+
+typedef struct _xw_scene xw_scene;
+
+typedef enum {
+    XW_SHAPE_RECTANGLE,
+    XW_SHAPE_CIRCLE,
+    XW_SHAPE_LINE,
+    XW_SHAPE_TRIANGLE,
+} xw_shape_type;
+
+typedef struct {
+    xw_shape_type type;
+    uint32_t color;
+    bool fill; // Rectangle and circle only
+    bool visible;
+    union {
+        struct {
+            int x, y;
+            unsigned int width, height;
+        } rectangle;
+        struct {
+            int x, y, r;
+        } circle;
+        struct {
+            int x0, y0, x1, y1;
+            uint16_t width;
+        } line;
+        struct {
+            int x0, y0, x1, y1, x2, y2;
+        } triangle;
+    };
+} xw_shape;
+
+/**
+ * @brief Creates a retained scene on the window, only the damaged parts are repainted
+ * @note The scene draws in graphic mode, do not mix it with a connected image
+ * @note The scene does not read events, pass the 'rect' of each 'Expose' event to
+ * 'xw_scene_damage'. The area gained by a resize is damaged by 'xw_scene_draw', once the
+ * resize event was read (see 'xw_get_dimensions')
+ *
+ * @param handle The handle for the xwrap
+ * @param background The color behind the shapes
+ * @return xw_scene* The scene, NULL if failed
+ */
+XW_DEF xw_scene* xw_scene_create(xw_handle* handle, uint32_t background);
+/**
+ * @brief Free the scene
+ *
+ * @param scene The scene to free
+ */
+XW_DEF void xw_scene_free(xw_scene* scene);
+/**
+ * @brief Adds a shape on top of the scene
+ *
+ * @param scene The scene
+ * @param shape The shape to copy into the scene
+ * @return int The shape id, -1 if failed
+ */
+XW_DEF int xw_scene_add(xw_scene* scene, const xw_shape* shape);
+/**
+ * @brief Replaces the shape properties, damages the old and the new bounds
+ *
+ * @param scene The scene
+ * @param id The shape id
+ * @param shape The new properties
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_scene_update(xw_scene* scene, int id, const xw_shape* shape);
+/**
+ * @brief Moves the shape by offset
+ *
+ * @param scene The scene
+ * @param id The shape id
+ * @param dx Offset on the x-axis
+ * @param dy Offset on the y-axis
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_scene_move(xw_scene* scene, int id, int dx, int dy);
+/**
+ * @brief Removes the shape from the scene, the id is not reused
+ *
+ * @param scene The scene
+ * @param id The shape id
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_scene_remove(xw_scene* scene, int id);
+/**
+ * @brief Return the shape properties
+ *
+ * @param scene The scene
+ * @param id The shape id
+ * @return const xw_shape* The shape, NULL if there is no such shape
+ */
+XW_DEF const xw_shape* xw_scene_get(const xw_scene* scene, int id);
+/**
+ * @brief Marks a part of the window to be repainted, e.g. after it was drawn over
+ *
+ * @param scene The scene
+ * @param rect The part of the window
+ */
+XW_DEF void xw_scene_damage(xw_scene* scene, xw_rect rect);
+/**
+ * @brief Repaints the damaged parts of the window and flush
+ *
+ * @param scene The scene
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_scene_draw(xw_scene* scene);
+
+typedef struct _xw_hit_index xw_hit_index;
+
+/**
+ * @brief Creates a uniform grid index for hit-testing points against rectangles
+ *
+ * @param width Width of the indexed area
+ * @param height Height of the indexed area
+ * @param cell_size Size of a grid cell, about the size of a typical region
+ * @return xw_hit_index* The index, NULL if failed
+ */
+XW_DEF xw_hit_index* xw_hit_index_create(unsigned int width, unsigned int height,
+                                         unsigned int cell_size);
+/**
+ * @brief Free the index
+ *
+ * @param index The index to free
+ */
+XW_DEF void xw_hit_index_free(xw_hit_index* index);
+/**
+ * @brief Inserts the region or moves it to new bounds
+ * @note Regions with a higher id are on top
+ *
+ * @param index The index
+ * @param id The region id, not negative
+ * @param bounds The region bounds
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_hit_index_set(xw_hit_index* index, int id, xw_rect bounds);
+/**
+ * @brief Removes the region from the index
+ *
+ * @param index The index
+ * @param id The region id
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_hit_index_remove(xw_hit_index* index, int id);
+/**
+ * @brief Sets an exact test for regions that are not rectangles
+ *
+ * @param index The index
+ * @param contains Called for candidates whose bounds contain the point, NULL for bounds only
+ * @param user Passed to 'contains'
+ */
+XW_DEF void xw_hit_index_set_filter(xw_hit_index* index,
+                                    bool (*contains)(void* user, int id, int x, int y), void* user);
+/**
+ * @brief Finds the top region under the point
+ *
+ * @param index The index
+ * @param x The x-coordinate of the point
+ * @param y The y-coordinate of the point
+ * @return int The region id, -1 if there is none
+ */
+XW_DEF int xw_hit_index_query(const xw_hit_index* index, int x, int y);
+/**
+ * @brief Tracks the pointer and synthesizes enter and leave events of regions
+ *
+ * @param index The index
+ * @param event A mouse or 'LeaveNotify' event from 'xw_get_next_event', others are ignored
+ * @param out Receives 'XW_EVENT_SHAPE_LEAVE' and then 'XW_EVENT_SHAPE_ENTER'
+ * @return int Number of events written to 'out'
+ */
+XW_DEF int xw_hit_index_pointer(xw_hit_index* index, const xw_event* event, xw_event out[2]);
+/**
+ * @brief Return the hit index of the scene, kept up to date with the shapes
+ * @note Queries test the exact shape, the index is freed with the scene
+ *
+ * @param scene The scene
+ * @return xw_hit_index* The index, NULL if failed
+ */
+XW_DEF xw_hit_index* xw_scene_get_hit_index(xw_scene* scene);
+
+// Samples for 'xw_draw_plot', optionally with a min/max pyramid
+typedef struct _xw_plot xw_plot;
+
+typedef struct {
+    double first, last; // The sample positions at the left and right edge of 'area'
+    float low, high;    // The values at the bottom and top of 'area'
+    xw_rect area;       // Where to draw
+} xw_plot_view;
+
+/**
+ * @brief Creates a plot of samples, the samples are not copied
+ * @note The pyramid keeps the min and max of blocks of 8, 64, 512... samples, it costs 2/7 of
+ *       the samples in memory and makes each pixel column O(log(samples)) instead of O(samples)
+ *
+ * @param samples The values, must live as long as the plot, no NaN
+ * @param count The number of samples
+ * @param pyramid true to build the pyramid, for pan and zoom over many samples
+ * @return xw_plot* The plot, NULL if failed
+ */
+XW_DEF xw_plot* xw_plot_create(const float* samples, size_t count, bool pyramid);
+/**
+ * @brief Frees the plot, not the samples
+ *
+ * @param plot The plot
+ */
+XW_DEF void xw_plot_free(xw_plot* plot);
+/**
+ * @brief Points the plot at new samples, rebuilds the pyramid
+ *
+ * @param plot The plot
+ * @param samples The values, must live as long as the plot, no NaN
+ * @param count The number of samples
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_plot_update(xw_plot* plot, const float* samples, size_t count);
+/**
+ * @brief Draws the plot with one request - use 'xw_draw' to finish the drawing
+ * @note Reduced to the min and max of each pixel column, a polyline when zoomed in further
+ *
+ * @param handle The handle for the xwrap
+ * @param plot The plot
+ * @param view The visible samples and where to draw them
+ * @param color The color of the line
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_draw_plot(xw_handle* handle, const xw_plot* plot, xw_plot_view view,
+                         uint32_t color);
+/**
+ * @brief Rasterizes the plot into the connected image, like 'xw_draw_plot'
+ *
+ * @param handle The handle for the xwrap, with a connected image
+ * @param plot The plot
+ * @param view The visible samples and where to draw them, clipped to the image
+ * @param color The color of the line
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_draw_plot_image(xw_handle* handle, const xw_plot* plot, xw_plot_view view,
+                               uint32_t color);
+
+typedef enum {
+    XW_SCALAR_U8,
+    XW_SCALAR_U16,
+    XW_SCALAR_F32,
+} xw_scalar_type;
+
+typedef struct {
+    const void* values; // Row major
+    xw_scalar_type type;
+    int width, height;
+    size_t stride; // In values from a row to the next, 0 for 'width'
+} xw_scalar_grid;
+
+typedef struct {
+    const uint32_t* lut; // The colors from 'low' to 'high', usually 256 or 4096 of them
+    int size;
+    float low, high; // The values of the first and last color, the rest are clamped
+    bool auto_range; // Use the min and max of the grid instead of 'low' and 'high'
+} xw_colormap;
+
+/**
+ * @brief Fills a lookup table with a gradient through evenly spaced colors
+ *
+ * @param lut The table to fill
+ * @param size The number of colors in the table
+ * @param stops The colors to go through, the first and last are the ends
+ * @param count The number of stops, at least 1
+ */
+XW_DEF void xw_colormap_gradient(uint32_t* lut, int size, const uint32_t* stops, int count);
+/**
+ * @brief Finds the min and max of the grid, NaN values are skipped
+ *
+ * @param grid The values
+ * @param low The min, 0 if there are no values
+ * @param high The max, 0 if there are no values
+ */
+XW_DEF void xw_scalar_grid_range(xw_scalar_grid grid, float* low, float* high);
+/**
+ * @brief Maps the grid through the colormap into a region of the connected image
+ * @note Scaled to the region with the nearest value, NaN values get the first color, the rows are
+ *       split across threads with 'XWRAP_THREADS'
+ *
+ * @param handle The handle for the xwrap, with a connected image
+ * @param grid The values
+ * @param colormap The colors and the range of values
+ * @param dest Where in the image, clipped to the image
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_draw_colormap(xw_handle* handle, xw_scalar_grid grid, const xw_colormap* colormap,
+                             xw_rect dest);
+
+typedef enum {
+    XW_YUV_I420, // 8 bit Y plane, then U and V planes at half width and height
+    XW_YUV_NV12, // 8 bit Y plane, then an interleaved UV plane at half width and height
+    XW_YUV_YUYV, // Packed Y0 U Y1 V for every two pixels
+} xw_yuv_format;
+
+typedef enum {
+    XW_YUV_BT601,
+    XW_YUV_BT709,
+} xw_yuv_matrix;
+
+typedef struct {
+    xw_yuv_format format;
+    xw_yuv_matrix matrix;
+    bool full_range; // 0-255 values instead of 16-235 luma and 16-240 chroma
+    int width, height;
+    const uint8_t* planes[3]; // In the order of the format name, unused planes are ignored
+    size_t strides[3];        // In bytes
+} xw_yuv_frame;
+
+/**
+ * @brief Converts a YUV frame to RGB into the connected image
+ * @note The rows are split across threads with 'XWRAP_THREADS'
+ *
+ * @param handle The handle for the xwrap, with a connected image
+ * @param frame The frame
+ * @param x The x-coordinate of the top-left corner of the frame in the image
+ * @param y The y-coordinate of the top-left corner of the frame in the image
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_draw_yuv(xw_handle* handle, const xw_yuv_frame* frame, int x, int y);
+
+// A raw image file viewed through a cache of tiles, for images bigger than the memory
+typedef struct _xw_tiles xw_tiles;
+
+/**
+ * @brief Maps a raw image file for 'xw_draw_tiles'
+ * @note The pyramid keeps the image at half, quarter... size in 256x256 tiles for zooming out, it
+ *       is built on the first open and rebuilt when the image file changes, about a third of the
+ *       image file in size. Tiles are prefetched from a thread with 'XWRAP_THREADS'
+ *
+ * @param path The file with 0xXXRRGGBB pixels in rows
+ * @param width Width of the image
+ * @param height Height of the image
+ * @param stride Bytes from a row to the next, 0 for 'width * 4'
+ * @param pyramid_path Where to keep the pyramid, NULL to zoom out from the full image
+ * @param cache_mb The memory for cached tiles, each takes 256 KiB
+ * @return xw_tiles* The tiles, NULL if failed
+ */
+XW_DEF xw_tiles* xw_tiles_open(const char* path, uint32_t width, uint32_t height, size_t stride,
+                               const char* pyramid_path, size_t cache_mb);
+/**
+ * @brief Unmaps the files and frees the cache
+ *
+ * @param tiles The tiles
+ */
+XW_DEF void xw_tiles_close(xw_tiles* tiles);
+/**
+ * @brief Fills the connected image with a view of the tiles, use 'xw_draw' to draw it
+ * @note Tiles that are not loaded yet are drawn from a smaller level when one is cached
+ *
+ * @param handle The handle for the xwrap, with a connected image
+ * @param tiles The tiles
+ * @param x The x-coordinate in the tiled image at the left edge of the connected image
+ * @param y The y-coordinate in the tiled image at the top edge of the connected image
+ * @param zoom Pixels of the connected image per pixel of the tiled image
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_draw_tiles(xw_handle* handle, xw_tiles* tiles, double x, double y, double zoom);
+
+// Draw commands recorded by one thread, 'xw_draw' sends them from the thread of the window
+typedef struct _xw_cmdbuf xw_cmdbuf;
+
+/**
+ * @brief Creates a command buffer for one recording thread, call from the thread of the window
+ * @note Free the command buffers before the window
+ *
+ * @param handle The handle for the xwrap
+ * @param order 'xw_draw' sends the buffers from the lowest order up, creation order for ties
+ * @return xw_cmdbuf* The command buffer, NULL if failed
+ */
+XW_DEF xw_cmdbuf* xw_cmdbuf_create(xw_handle* handle, int order);
+/**
+ * @brief Frees the command buffer, call from the thread of the window
+ *
+ * @param cmdbuf The command buffer
+ */
+XW_DEF void xw_cmdbuf_free(xw_cmdbuf* cmdbuf);
+/**
+ * @brief Hands the recorded commands to the next 'xw_draw' and starts a new recording
+ * @note Waits while the commands of the previous submit are not drawn yet
+ *
+ * @param cmdbuf The command buffer
+ */
+XW_DEF void xw_cmdbuf_submit(xw_cmdbuf* cmdbuf);
+/**
+ * @brief Records 'xw_draw_text', without locks
+ *
+ * @param cmdbuf The command buffer of the calling thread
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_cmd_text(xw_cmdbuf* cmdbuf, int x, int y, const char* string, uint32_t color);
+/**
+ * @brief Records 'xw_draw_rectangle', without locks
+ *
+ * @param cmdbuf The command buffer of the calling thread
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_cmd_rectangle(xw_cmdbuf* cmdbuf, int x, int y, unsigned int width,
+                             unsigned int height, bool fill, uint32_t color);
+/**
+ * @brief Records 'xw_draw_line', without locks
+ *
+ * @param cmdbuf The command buffer of the calling thread
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_cmd_line(xw_cmdbuf* cmdbuf, int x0, int y0, int x1, int y1, uint16_t width,
+                        uint32_t color);
+/**
+ * @brief Records 'xw_draw_circle', without locks
+ *
+ * @param cmdbuf The command buffer of the calling thread
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_cmd_circle(xw_cmdbuf* cmdbuf, int x, int y, int r, bool fill, uint32_t color);
+/**
+ * @brief Records 'xw_draw_pixel', without locks
+ *
+ * @param cmdbuf The command buffer of the calling thread
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_cmd_pixel(xw_cmdbuf* cmdbuf, int x, int y, uint32_t color);
+/**
+ * @brief Records 'xw_draw_triangle', without locks
+ *
+ * @param cmdbuf The command buffer of the calling thread
+ * @return bool true if OK, false if failed
+ */
+XW_DEF bool xw_cmd_triangle(xw_cmdbuf* cmdbuf, int x0, int y0, int x1, int y1, int x2, int y2,
+                            uint32_t color);
+
 #endif // XWRAP_INCLUDE_H
 
 #ifdef XWRAP_IMPLEMENTATION
 
+#if (defined(XWRAP_PRESENT) || defined(XWRAP_SHM)) && !defined(XWRAP_XCB)
+#define XWRAP_XCB
+#endif // XWRAP_PRESENT || XWRAP_SHM
+
 #if !defined(XWRAP_AUTO_LINK)
 #include <X11/Xlib.h>
+#ifdef XWRAP_RENDER
+#include <X11/extensions/Xrender.h>
+#endif // XWRAP_RENDER
+#ifdef XWRAP_XCB
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+#endif // XWRAP_XCB
+#ifdef XWRAP_PRESENT
+#include <xcb/present.h>
+#define _XW_PRESENT_ID (&xcb_present_id)
+#endif // XWRAP_PRESENT
+#ifdef XWRAP_SHM
+#include <xcb/shm.h>
+#define _XW_SHM_ID (&xcb_shm_id)
+#endif // XWRAP_SHM
 #endif // XWRAP_AUTO_LINK
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(XWRAP_RECORD) || defined(XWRAP_THREADS)
+#include <pthread.h>
+#endif // XWRAP_RECORD || XWRAP_THREADS
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif // __SSE2__
+
 #ifdef XWRAP_AUTO_LINK
 #include <dlfcn.h>
 
@@ -289,6 +1364,7 @@ typedef XID Drawable;
 typedef XID Font;
 typedef XID Pixmap;
 typedef XID Colormap;
+typedef XID GContext;
 
 typedef unsigned long Time;
 typedef char* XPointer;
@@ -358,6 +1434,14 @@ typedef struct {
 
 }* _XPrivDisplay;
 
+typedef struct {
+    int type;
+    unsigned long serial;
+    int send_event;
+    Display* display;
+    Window window;
+} XAnyEvent;
+
 typedef struct {
     int type;
     unsigned long serial;
@@ -382,30 +1466,103 @@ typedef struct {
     int same_screen;
 } XButtonEvent;
 
-typedef union _XEvent {
+typedef struct {
     int type;
-    XKeyEvent xkey;
-    XButtonEvent xbutton;
-    long pad[24];
-} XEvent;
+    unsigned long serial;
+    int send_event;
+    Display* display;
+    Window window, root, subwindow;
+    Time time;
+    int x, y, x_root, y_root;
+    int mode, detail; // Shortened
+} XCrossingEvent;
 
 typedef struct {
-    short x, y;
-} XPoint;
-
-/* Definitions */
-#define ScreenOfDisplay(dpy, scr) (&((_XPrivDisplay)(dpy))->screens[scr])
-#define RootWindow(dpy, scr) (ScreenOfDisplay(dpy, scr)->root)
-#define DefaultScreen(dpy) (((_XPrivDisplay)(dpy))->default_screen)
-#define DefaultVisual(dpy, scr) (ScreenOfDisplay(dpy, scr)->root_visual)
-#define WhitePixel(dpy, scr) (ScreenOfDisplay(dpy, scr)->white_pixel)
+    int type;
+    unsigned long serial;
+    int send_event;
+    Display* display;
+    Window event, window;
+    int x, y;
+    int width, height;
+    int border_width;
+    Window above;
+    int override_redirect;
+} XConfigureEvent;
 
-#define NoEventMask 0L
-#define KeyPressMask (1L << 0)
-#define KeyReleaseMask (1L << 1)
-#define ButtonPressMask (1L << 2)
+typedef struct {
+    int type;
+    unsigned long serial;
+    int send_event;
+    Display* display;
+    Window window;
+    int x, y;
+    int width, height;
+    int count;
+} XExposeEvent;
+
+typedef struct {
+    int type;
+    unsigned long serial;
+    int send_event;
+    Display* display;
+    Window event, window, parent;
+    int x, y;
+    int override_redirect;
+} XReparentEvent;
+
+typedef union _XEvent {
+    int type;
+    XAnyEvent xany;
+    XKeyEvent xkey;
+    XButtonEvent xbutton;
+    XCrossingEvent xcrossing;
+    XExposeEvent xexpose;
+    XConfigureEvent xconfigure;
+    XReparentEvent xreparent;
+    long pad[24];
+} XEvent;
+
+typedef struct {
+    short x, y;
+} XPoint;
+
+typedef struct {
+    short x1, y1, x2, y2;
+} XSegment;
+
+typedef struct {
+    short x, y;
+    unsigned short width, height;
+} XRectangle;
+
+typedef struct {
+    int type;
+    Display* display;
+    XID resourceid;
+    unsigned long serial;
+    unsigned char error_code, request_code, minor_code;
+} XErrorEvent;
+
+typedef int (*XErrorHandler)(Display*, XErrorEvent*);
+
+/* Definitions */
+#define NextRequest(dpy) (((_XPrivDisplay)(dpy))->request + 1)
+#define ScreenOfDisplay(dpy, scr) (&((_XPrivDisplay)(dpy))->screens[scr])
+#define RootWindow(dpy, scr) (ScreenOfDisplay(dpy, scr)->root)
+#define DefaultScreen(dpy) (((_XPrivDisplay)(dpy))->default_screen)
+#define DefaultVisual(dpy, scr) (ScreenOfDisplay(dpy, scr)->root_visual)
+#define WhitePixel(dpy, scr) (ScreenOfDisplay(dpy, scr)->white_pixel)
+
+#define NoEventMask 0L
+#define KeyPressMask (1L << 0)
+#define KeyReleaseMask (1L << 1)
+#define ButtonPressMask (1L << 2)
 #define ButtonReleaseMask (1L << 3)
+#define LeaveWindowMask (1L << 5)
 #define PointerMotionMask (1L << 6)
+#define ExposureMask (1L << 15)
+#define StructureNotifyMask (1L << 17)
 
 #define ZPixmap 2
 #define LineSolid 0
@@ -413,6 +1570,8 @@ typedef struct {
 #define JoinMiter 0
 #define Nonconvex 1
 #define CoordModeOrigin 0
+#define Unsorted 0
+#define None 0L
 
 /* Clicks */
 #define Button1 1
@@ -426,6 +1585,15 @@ typedef struct {
 #define ButtonPress 4
 #define ButtonRelease 5
 #define MotionNotify 6
+#define LeaveNotify 8
+#define Expose 12
+#define DestroyNotify 17
+#define UnmapNotify 18
+#define MapNotify 19
+#define ReparentNotify 21
+#define ConfigureNotify 22
+#define GravityNotify 24
+#define CirculateNotify 26
 
 /* Function declarations */
 Display* (*XOpenDisplay)(const char*)                                                   = NULL;
@@ -447,6 +1615,9 @@ int (*XPutImage)(Display*, Drawable, GC, XImage*, int, int, int, int, unsigned i
 int (*XDrawRectangle)(Display*, Drawable, GC, int, int, unsigned int, unsigned int)     = NULL;
 int (*XSetLineAttributes)(Display*, GC, unsigned int, int, int, int)                    = NULL;
 int (*XDrawLine)(Display*, Drawable, GC, int, int, int, int)                            = NULL;
+int (*XDrawLines)(Display*, Drawable, GC, XPoint*, int, int)                            = NULL;
+int (*XDrawSegments)(Display*, Drawable, GC, XSegment*, int)                            = NULL;
+int (*XDrawPoints)(Display*, Drawable, GC, XPoint*, int, int)                           = NULL;
 int (*XFillArc)(Display*, Drawable, GC, int, int, unsigned int, unsigned int, int, int) = NULL;
 int (*XDrawArc)(Display*, Drawable, GC, int, int, unsigned int, unsigned int, int, int) = NULL;
 int (*XDrawPoint)(Display*, Drawable, GC, int, int)                                     = NULL;
@@ -454,19 +1625,210 @@ int (*XFillPolygon)(Display*, Drawable, GC, XPoint*, int, int, int)
 int (*XPending)(Display*)                                                               = NULL;
 int (*XNextEvent)(Display*, XEvent*)                                                    = NULL;
 int (*XPutBackEvent)(Display*, XEvent*)                                                 = NULL;
+int (*XIfEvent)(Display*, XEvent*, int (*)(Display*, XEvent*, XPointer), XPointer)      = NULL;
+int (*XCheckIfEvent)(Display*, XEvent*, int (*)(Display*, XEvent*, XPointer), XPointer) = NULL;
 int (*XGetWindowAttributes)(Display*, Window, XWindowAttributes*)                       = NULL;
 int (*XClearWindow)(Display*, Window)                                                   = NULL;
 int (*XSetWindowBackground)(Display*, Window, unsigned long)                            = NULL;
 int (*XDrawString)(Display*, Drawable, GC, int, int, char*, int)                        = NULL;
 int (*XStoreName)(Display*, Window, const char*)                                        = NULL;
+int (*XFillRectangles)(Display*, Drawable, GC, XRectangle*, int)                        = NULL;
+int (*XSetClipRectangles)(Display*, GC, int, int, XRectangle*, int, int)                = NULL;
+int (*XSetClipMask)(Display*, GC, Pixmap)                                               = NULL;
+Pixmap (*XCreatePixmap)(Display*, Drawable, unsigned int, unsigned int, unsigned int)   = NULL;
+int (*XFreePixmap)(Display*, Pixmap)                                                    = NULL;
+int (*XFree)(void*)                                                                     = NULL;
+int (*XWindowEvent)(Display*, Window, long, XEvent*)                                    = NULL;
+GContext (*XGContextFromGC)(GC)                                                         = NULL;
+int (*XSync)(Display*, int)                                                             = NULL;
+XErrorHandler (*XSetErrorHandler)(XErrorHandler)                                        = NULL;
+int (*XGetErrorText)(Display*, int, char*, int)                                         = NULL;
+
+#ifdef XWRAP_RENDER
+typedef XID Picture;
+typedef int XFixed;
+
+typedef struct _XRenderPictFormat XRenderPictFormat;                 // Shortened
+typedef struct _XRenderPictureAttributes XRenderPictureAttributes;   // Shortened
+
+typedef struct {
+    unsigned short red, green, blue, alpha;
+} XRenderColor;
+
+typedef struct {
+    XFixed x, y;
+} XPointFixed;
+
+typedef struct {
+    XPointFixed p1, p2, p3;
+} XTriangle;
+
+#define PictOpSrc 1
+#define PictOpOver 3
+#define PictStandardARGB32 0
+#define PictStandardA8 2
+#define XDoubleToFixed(f) ((XFixed)((f) * 65536))
+
+int (*XRenderQueryExtension)(Display*, int*, int*)                                      = NULL;
+XRenderPictFormat* (*XRenderFindVisualFormat)(Display*, const Visual*)                  = NULL;
+XRenderPictFormat* (*XRenderFindStandardFormat)(Display*, int)                          = NULL;
+Picture (*XRenderCreatePicture)(Display*, Drawable, const XRenderPictFormat*, unsigned long,
+                                const XRenderPictureAttributes*)                        = NULL;
+void (*XRenderFreePicture)(Display*, Picture)                                           = NULL;
+Picture (*XRenderCreateSolidFill)(Display*, const XRenderColor*)                        = NULL;
+void (*XRenderFillRectangle)(Display*, int, Picture, const XRenderColor*, int, int, unsigned int,
+                             unsigned int)                                              = NULL;
+void (*XRenderComposite)(Display*, int, Picture, Picture, Picture, int, int, int, int, int, int,
+                         unsigned int, unsigned int)                                    = NULL;
+void (*XRenderCompositeTriangles)(Display*, int, Picture, Picture, const XRenderPictFormat*, int,
+                                  int, const XTriangle*, int)                           = NULL;
+void (*XRenderCompositeTriStrip)(Display*, int, Picture, Picture, const XRenderPictFormat*, int,
+                                 int, const XPointFixed*, int)                          = NULL;
+void (*XRenderCompositeTriFan)(Display*, int, Picture, Picture, const XRenderPictFormat*, int, int,
+                               const XPointFixed*, int)                                 = NULL;
+#endif // XWRAP_RENDER
+
+#ifdef XWRAP_XCB
+typedef struct xcb_connection_t xcb_connection_t;
+typedef uint32_t xcb_window_t;
+typedef uint32_t xcb_drawable_t;
+
+typedef struct {
+    unsigned int sequence;
+} xcb_get_geometry_cookie_t;
+
+typedef struct {
+    uint8_t response_type, error_code;
+    uint16_t sequence;
+    uint32_t resource_id;
+    uint16_t minor_code;
+    uint8_t major_code, pad0;
+    uint32_t pad[5];
+    uint32_t full_sequence;
+} xcb_generic_error_t;
+
+typedef struct {
+    uint8_t response_type, depth;
+    uint16_t sequence;
+    uint32_t length;
+    xcb_window_t root;
+    int16_t x, y;
+    uint16_t width, height, border_width;
+    uint8_t pad0[2];
+} xcb_get_geometry_reply_t;
+
+xcb_connection_t* (*XGetXCBConnection)(Display*)                                        = NULL;
+xcb_get_geometry_cookie_t (*xcb_get_geometry)(xcb_connection_t*, xcb_drawable_t)       = NULL;
+xcb_get_geometry_reply_t* (*xcb_get_geometry_reply)(xcb_connection_t*, xcb_get_geometry_cookie_t,
+                                                    xcb_generic_error_t**)              = NULL;
+int (*xcb_flush)(xcb_connection_t*)                                                     = NULL;
+
+typedef struct xcb_extension_t xcb_extension_t;
+
+typedef struct {
+    unsigned int sequence;
+} xcb_void_cookie_t;
+
+typedef struct {
+    uint8_t response_type, pad0;
+    uint16_t sequence;
+    uint32_t length;
+    uint8_t present, major_opcode, first_event, first_error;
+} xcb_query_extension_reply_t;
+
+uint32_t (*xcb_generate_id)(xcb_connection_t*)                                          = NULL;
+const xcb_query_extension_reply_t* (*xcb_get_extension_data)(xcb_connection_t*,
+                                                             xcb_extension_t*)          = NULL;
+
+#ifdef XWRAP_PRESENT
+typedef struct xcb_special_event xcb_special_event_t;
+typedef uint32_t xcb_pixmap_t;
+
+typedef struct {
+    uint8_t response_type, pad0;
+    uint16_t sequence;
+    uint32_t pad[7];
+    uint32_t full_sequence;
+} xcb_generic_event_t;
+
+#define XCB_PRESENT_COMPLETE_NOTIFY 1
+#define XCB_PRESENT_IDLE_NOTIFY 2
+#define XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY 2
+#define XCB_PRESENT_EVENT_MASK_IDLE_NOTIFY 4
+
+xcb_special_event_t* (*xcb_register_for_special_xge)(xcb_connection_t*, xcb_extension_t*,
+                                                     uint32_t, uint32_t*)               = NULL;
+void (*xcb_unregister_for_special_event)(xcb_connection_t*, xcb_special_event_t*)       = NULL;
+xcb_generic_event_t* (*xcb_poll_for_special_event)(xcb_connection_t*,
+                                                   xcb_special_event_t*)                = NULL;
+xcb_generic_event_t* (*xcb_wait_for_special_event)(xcb_connection_t*,
+                                                   xcb_special_event_t*)                = NULL;
+
+xcb_extension_t* xcb_present_id                                                         = NULL;
+xcb_void_cookie_t (*xcb_present_select_input)(xcb_connection_t*, uint32_t, xcb_window_t,
+                                              uint32_t)                                 = NULL;
+xcb_void_cookie_t (*xcb_present_pixmap)(xcb_connection_t*, xcb_window_t, xcb_pixmap_t, uint32_t,
+                                        uint32_t, uint32_t, int16_t, int16_t, uint32_t, uint32_t,
+                                        uint32_t, uint32_t, uint64_t, uint64_t, uint64_t, uint32_t,
+                                        const void*)                                    = NULL;
+#define _XW_PRESENT_ID xcb_present_id
+#endif // XWRAP_PRESENT
+
+#ifdef XWRAP_SHM
+typedef uint32_t xcb_shm_seg_t;
+typedef uint32_t xcb_gcontext_t;
+
+typedef struct {
+    unsigned int sequence;
+} xcb_shm_query_version_cookie_t;
+
+typedef struct {
+    uint8_t response_type, shared_pixmaps;
+    uint16_t sequence;
+    uint32_t length;
+    uint16_t major_version, minor_version, uid, gid;
+    uint8_t pixmap_format, pad0[15];
+} xcb_shm_query_version_reply_t;
+
+#define XCB_IMAGE_FORMAT_Z_PIXMAP 2
+
+xcb_extension_t* xcb_shm_id                                                             = NULL;
+xcb_shm_query_version_cookie_t (*xcb_shm_query_version)(xcb_connection_t*)             = NULL;
+xcb_shm_query_version_reply_t* (*xcb_shm_query_version_reply)(
+    xcb_connection_t*, xcb_shm_query_version_cookie_t, xcb_generic_error_t**)           = NULL;
+xcb_void_cookie_t (*xcb_shm_attach_fd_checked)(xcb_connection_t*, xcb_shm_seg_t, int32_t,
+                                               uint8_t)                                 = NULL;
+xcb_generic_error_t* (*xcb_request_check)(xcb_connection_t*, xcb_void_cookie_t)         = NULL;
+xcb_void_cookie_t (*xcb_shm_detach)(xcb_connection_t*, xcb_shm_seg_t)                   = NULL;
+xcb_void_cookie_t (*xcb_shm_put_image)(xcb_connection_t*, xcb_drawable_t, xcb_gcontext_t,
+                                       uint16_t, uint16_t, uint16_t, uint16_t, uint16_t,
+                                       uint16_t, int16_t, int16_t, uint8_t, uint8_t, uint8_t,
+                                       xcb_shm_seg_t, uint32_t)                         = NULL;
+#define _XW_SHM_ID xcb_shm_id
+#endif // XWRAP_SHM
+#endif // XWRAP_XCB
 
 /* Linker */
-void* dl_handle         = NULL;
-const char* name_libx11 = "libX11.so";
-const struct {
+typedef struct {
     const char* name;
     void** fun;
-} dl_fun[] = {
+} _xw_dl_sym;
+
+// A library of optional functions, linked on the first use and kept until the exit
+typedef struct {
+    const char* const* names; // Tried in order, NULL ended
+    const _xw_dl_sym* fun;
+    size_t fun_len;
+    void* handle; // NULL when missing
+    bool tried;
+} _xw_dl_lib;
+
+#define _XW_DL_LIB(names, fun) {names, fun, sizeof(fun) / sizeof(*fun), NULL, false}
+
+// The versioned name first, the bare name only comes with the dev packages
+void* dl_handle                 = NULL;
+const char* const name_libx11[] = {"libX11.so.6", "libX11.so", NULL};
+const _xw_dl_sym dl_fun[]       = {
     {"XOpenDisplay", (void**)&XOpenDisplay},
     {"XCreateSimpleWindow", (void**)&XCreateSimpleWindow},
     {"XMapWindow", (void**)&XMapWindow},
@@ -483,211 +1845,1083 @@ const struct {
     {"XDrawRectangle", (void**)&XDrawRectangle},
     {"XSetLineAttributes", (void**)&XSetLineAttributes},
     {"XDrawLine", (void**)&XDrawLine},
+    {"XDrawLines", (void**)&XDrawLines},
+    {"XDrawSegments", (void**)&XDrawSegments},
     {"XFillArc", (void**)&XFillArc},
     {"XDrawArc", (void**)&XDrawArc},
     {"XDrawPoint", (void**)&XDrawPoint},
+    {"XDrawPoints", (void**)&XDrawPoints},
     {"XFillPolygon", (void**)&XFillPolygon},
     {"XPending", (void**)&XPending},
     {"XNextEvent", (void**)&XNextEvent},
     {"XPutBackEvent", (void**)&XPutBackEvent},
+    {"XIfEvent", (void**)&XIfEvent},
+    {"XCheckIfEvent", (void**)&XCheckIfEvent},
     {"XGetWindowAttributes", (void**)&XGetWindowAttributes},
     {"XClearWindow", (void**)&XClearWindow},
     {"XSetWindowBackground", (void**)&XSetWindowBackground},
     {"XDrawString", (void**)&XDrawString},
     {"XStoreName", (void**)&XStoreName},
+    {"XFillRectangles", (void**)&XFillRectangles},
+    {"XSetClipRectangles", (void**)&XSetClipRectangles},
+    {"XSetClipMask", (void**)&XSetClipMask},
+    {"XCreatePixmap", (void**)&XCreatePixmap},
+    {"XFreePixmap", (void**)&XFreePixmap},
+    {"XFree", (void**)&XFree},
+    {"XWindowEvent", (void**)&XWindowEvent},
+    {"XGContextFromGC", (void**)&XGContextFromGC},
+    {"XSync", (void**)&XSync},
+    {"XSetErrorHandler", (void**)&XSetErrorHandler},
+    {"XGetErrorText", (void**)&XGetErrorText},
 };
 
 const size_t dl_fun_len = sizeof(dl_fun) / sizeof(*dl_fun);
 
+#ifdef XWRAP_RENDER
+const char* const name_libxrender[] = {"libXrender.so.1", "libXrender.so", NULL};
+const _xw_dl_sym dl_render_fun[]    = {
+    {"XRenderQueryExtension", (void**)&XRenderQueryExtension},
+    {"XRenderFindVisualFormat", (void**)&XRenderFindVisualFormat},
+    {"XRenderFindStandardFormat", (void**)&XRenderFindStandardFormat},
+    {"XRenderCreatePicture", (void**)&XRenderCreatePicture},
+    {"XRenderFreePicture", (void**)&XRenderFreePicture},
+    {"XRenderCreateSolidFill", (void**)&XRenderCreateSolidFill},
+    {"XRenderFillRectangle", (void**)&XRenderFillRectangle},
+    {"XRenderComposite", (void**)&XRenderComposite},
+    {"XRenderCompositeTriangles", (void**)&XRenderCompositeTriangles},
+    {"XRenderCompositeTriStrip", (void**)&XRenderCompositeTriStrip},
+    {"XRenderCompositeTriFan", (void**)&XRenderCompositeTriFan},
+};
+
+_xw_dl_lib dl_render = _XW_DL_LIB(name_libxrender, dl_render_fun);
+#endif // XWRAP_RENDER
+
+#ifdef XWRAP_XCB
+const char* const name_libx11_xcb[] = {"libX11-xcb.so.1", "libX11-xcb.so", NULL};
+const _xw_dl_sym dl_x11_xcb_fun[]   = {
+    {"XGetXCBConnection", (void**)&XGetXCBConnection},
+};
+
+_xw_dl_lib dl_x11_xcb = _XW_DL_LIB(name_libx11_xcb, dl_x11_xcb_fun);
+
+const char* const name_libxcb[] = {"libxcb.so.1", "libxcb.so", NULL};
+const _xw_dl_sym dl_xcb_fun[]   = {
+    {"xcb_get_geometry", (void**)&xcb_get_geometry},
+    {"xcb_get_geometry_reply", (void**)&xcb_get_geometry_reply},
+    {"xcb_flush", (void**)&xcb_flush},
+    {"xcb_generate_id", (void**)&xcb_generate_id},
+    {"xcb_get_extension_data", (void**)&xcb_get_extension_data},
+#ifdef XWRAP_PRESENT
+    {"xcb_register_for_special_xge", (void**)&xcb_register_for_special_xge},
+    {"xcb_unregister_for_special_event", (void**)&xcb_unregister_for_special_event},
+    {"xcb_poll_for_special_event", (void**)&xcb_poll_for_special_event},
+    {"xcb_wait_for_special_event", (void**)&xcb_wait_for_special_event},
+#endif // XWRAP_PRESENT
+#ifdef XWRAP_SHM
+    {"xcb_request_check", (void**)&xcb_request_check},
+#endif // XWRAP_SHM
+};
+
+_xw_dl_lib dl_xcb = _XW_DL_LIB(name_libxcb, dl_xcb_fun);
+
+#ifdef XWRAP_PRESENT
+const char* const name_libxcb_present[] = {"libxcb-present.so.0", "libxcb-present.so", NULL};
+const _xw_dl_sym dl_present_fun[]       = {
+    {"xcb_present_id", (void**)&xcb_present_id},
+    {"xcb_present_select_input", (void**)&xcb_present_select_input},
+    {"xcb_present_pixmap", (void**)&xcb_present_pixmap},
+};
+
+_xw_dl_lib dl_present = _XW_DL_LIB(name_libxcb_present, dl_present_fun);
+#endif // XWRAP_PRESENT
+
+#ifdef XWRAP_SHM
+const char* const name_libxcb_shm[] = {"libxcb-shm.so.0", "libxcb-shm.so", NULL};
+const _xw_dl_sym dl_shm_fun[]       = {
+    {"xcb_shm_id", (void**)&xcb_shm_id},
+    {"xcb_shm_query_version", (void**)&xcb_shm_query_version},
+    {"xcb_shm_query_version_reply", (void**)&xcb_shm_query_version_reply},
+    {"xcb_shm_attach_fd_checked", (void**)&xcb_shm_attach_fd_checked},
+    {"xcb_shm_detach", (void**)&xcb_shm_detach},
+    {"xcb_shm_put_image", (void**)&xcb_shm_put_image},
+};
+
+_xw_dl_lib dl_shm = _XW_DL_LIB(name_libxcb_shm, dl_shm_fun);
+#endif // XWRAP_SHM
+#endif // XWRAP_XCB
+
 void _xw_d_unlink(void* handle)
 {
     dlclose(handle);
 }
 
+static inline uint64_t _xw_now_ns(void);
+static uint64_t _xw_link_ns = 0; // In dlopen and dlsym, reported by 'xw_get_stats'
+
+// The first name that opens, NULL if none
+static void* _xw_d_open(const char* const* names)
+{
+    for (; *names != NULL; names++) {
+        void* handle = dlopen(*names, RTLD_LAZY | RTLD_GLOBAL);
+        if (handle != NULL) {
+            return handle;
+        }
+    }
+    return NULL;
+}
+
+/* The core functions are linked on the first window and kept for the next windows */
 bool _xw_d_link(void** handle)
 {
     if (*handle != NULL) {
-        fprintf(stderr, "WARNING: double link\n");
         return true;
     }
 
-    *handle = dlopen(name_libx11, RTLD_LAZY | RTLD_GLOBAL);
-    for (size_t i = 0; i < dl_fun_len; i++) {
+    const uint64_t start = _xw_now_ns();
+    *handle              = _xw_d_open(name_libx11);
+    bool ok              = *handle != NULL;
+    for (size_t i = 0; ok && i < dl_fun_len; i++) {
         *dl_fun[i].fun = dlsym(*handle, dl_fun[i].name);
-        if (*dl_fun[i].fun == NULL) {
-            return false;
+        ok             = *dl_fun[i].fun != NULL;
+    }
+    _xw_link_ns += _xw_now_ns() - start;
+    return ok;
+}
+
+/* Extensions are optional, on failure all their functions stay NULL */
+bool _xw_d_link_extension(_xw_dl_lib* lib)
+{
+    if (lib->tried) {
+        return lib->handle != NULL;
+    }
+    lib->tried = true;
+
+    const uint64_t start = _xw_now_ns();
+    lib->handle          = _xw_d_open(lib->names);
+    if (lib->handle != NULL) {
+        size_t i = 0;
+        for (; i < lib->fun_len; i++) {
+            *lib->fun[i].fun = dlsym(lib->handle, lib->fun[i].name);
+            if (*lib->fun[i].fun == NULL) {
+                break;
+            }
+        }
+        if (i < lib->fun_len) {
+            _xw_d_unlink(lib->handle);
+            lib->handle = NULL;
         }
     }
-    return true;
+    if (lib->handle == NULL) {
+        for (size_t i = 0; i < lib->fun_len; i++) {
+            *lib->fun[i].fun = NULL;
+        }
+    }
+    _xw_link_ns += _xw_now_ns() - start;
+    return lib->handle != NULL;
 }
 #endif // XWRAP_AUTO_LINK
 
+#define XW_QUEUE_SIZE 32
+#define XW_CALL_RING 64 // Calls remembered to name the errors
+#define XW_ERROR_RING 16
+#define XW_COOKIE_CHUNK 64 // Requests of 'xw_get_dimensions_many' sent before the replies
+
 struct _xw_handle {
     Display* display;
     Window window;
     char* window_name;
     GC gc;
     XImage* image;
+    uint32_t* buffer;
     uint16_t width;
     uint16_t height;
-};
+    size_t stride; // In pixels
+    bool auto_flush;
 
-static size_t windows_open = 0; /* Count how many windows open */
-XW_DEF xw_handle* xw_create_window(const char* window_name, int width, int height)
-{
-#ifdef XWRAP_AUTO_LINK
-    if (windows_open == 0 && !_xw_d_link(&dl_handle)) {
-        fprintf(stderr, "ERROR: could not link with x11: %s\n", dlerror());
-        exit(1);
-    }
-    windows_open++;
-#endif // XWRAP_AUTO_LINK
+    bool shared_display; // From 'xw_create_window_shared', the events are routed by window
 
-    xw_handle* handle = (xw_handle*)malloc(sizeof(xw_handle));
-    handle->display   = XOpenDisplay(NULL);
-    if (handle->display == NULL) {
-        fprintf(stderr, "ERROR: Unable to connect X server\n");
-        free(handle);
-        return NULL;
-    }
-    handle->window = XCreateSimpleWindow(
-        handle->display, RootWindow(handle->display, DefaultScreen(handle->display)), 0, 0, width,
-        height, 0, 0x000000, WhitePixel(handle->display, 0));
+    // Kept from 'ConfigureNotify'
+    xw_dimensions dimensions;
+    bool reparented; // By the window manager, real positions are relative to its frame
 
-    // Set the window name
-    XStoreName(handle->display, handle->window, window_name);
-    handle->window_name = malloc(strlen(window_name) * sizeof(char) + 1);
-    if (handle->window_name == NULL) {
-        fprintf(stderr, "ERROR: Buy more ram\n");
-        free(handle);
-        return NULL;
-    }
-    strcpy(handle->window_name, window_name);
+    // Events made by xwrap, served before the X11 queue
+    xw_event queue[XW_QUEUE_SIZE];
+    size_t queue_head;
+    size_t queue_len;
+#ifdef XWRAP_XCB
+    xcb_connection_t* xcb; // NULL when XCB is missing
+#endif // XWRAP_XCB
+#ifdef XWRAP_PRESENT
+    xcb_special_event_t* present_events; // NULL when Present is not used
+    uint32_t present_eid;
+    Pixmap present_pixmaps[2];
+    bool present_busy[2];
+    uint32_t present_serial;
+#endif // XWRAP_PRESENT
+#ifdef XWRAP_SHM
+    xcb_shm_seg_t shm_seg; // 0 when the image is not in shared memory
+    uint32_t shm_offset;
+#endif // XWRAP_SHM
+#ifdef XWRAP_RENDER
+    Picture picture; // Of the window, None when XRender is missing
+    XRenderPictFormat* mask_format;
+    Picture fill;    // Solid source of 'fill_color'
+    uint32_t fill_color;
+    Pixmap blend_pixmap; // Staging for 'xw_draw_image_blend'
+    Picture blend_picture;
+    GC blend_gc;
+    uint16_t blend_width, blend_height;
+#endif // XWRAP_RENDER
+#ifdef XWRAP_RECORD
+    struct _xw_recorder* recorder; // NULL when not recording
+#endif // XWRAP_RECORD
+#ifdef XWRAP_STATS
+    xw_stats stats;
+    uint64_t last_frame_ns; // 0 before the first frame
+#endif // XWRAP_STATS
+#ifdef XWRAP_TRACE
+    uint64_t trace_frame; // Counts 'xw_draw' and 'xw_present'
+#endif // XWRAP_TRACE
+    struct _xw_overlay* overlay; // NULL when hidden
+    xw_cmdbuf* cmdbufs;          // Sorted by order
+    struct _xw_input* input;     // NULL when not recording or replaying events
 
-    XMapWindow(handle->display, handle->window);
-    XSelectInput(handle->display, handle->window,
-                 KeyPressMask | KeyReleaseMask | ButtonPressMask | ButtonReleaseMask |
-                     PointerMotionMask);
+    // Which call sent which requests, to name the call in the errors
+    struct {
+        unsigned long serial; // Of the first request of the call
+        const char* call;
+    } calls[XW_CALL_RING];
+    size_t calls_next;
+    xw_error errors[XW_ERROR_RING];
+    size_t errors_head, errors_len;
+    uint64_t errors_lost;
+    xw_handle* next; // In the list of open handles, for the error handler
+};
 
-    handle->gc    = XCreateGC(handle->display, handle->window, 0, NULL);
-    handle->image = NULL;
+// Marks the requests sent from here on as sent by the calling function
+#define _XW_CALL(handle) _xw_call((handle), __func__)
 
-    // Busy wait for the screen to open - fixes premature drawing
-    XWindowAttributes window_attributes_return = {0};
-    while (window_attributes_return.map_state == 0) {
-        xw_sleep_us(10);
-        XGetWindowAttributes(handle->display, handle->window, &window_attributes_return);
-    }
-    return handle;
+static inline void _xw_call(xw_handle* handle, const char* call)
+{
+    handle->calls[handle->calls_next].serial = NextRequest(handle->display);
+    handle->calls[handle->calls_next].call   = call;
+    handle->calls_next                       = (handle->calls_next + 1) % XW_CALL_RING;
 }
 
-XW_DEF void xw_free_window(xw_handle* handle)
+static inline uint64_t _xw_now_ns(void)
 {
-    XFreeGC(handle->display, handle->gc);
-    XDestroyWindow(handle->display, handle->window);
-    XCloseDisplay(handle->display);
-    free(handle->window_name);
-    free(handle);
-
-#ifdef XWRAP_AUTO_LINK
-    windows_open--;
-    if (windows_open < 1) {
-        _xw_d_unlink(dl_handle);
-        dl_handle = NULL;
-    }
-#endif // XWRAP_AUTO_LINK
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
 }
 
-XW_DEF const char* xw_get_window_name(xw_handle* handle)
+#if defined(XWRAP_STATS) || defined(XWRAP_TRACE)
+#define _XW_CLOCK(start) const uint64_t start = _xw_now_ns()
+#else
+#define _XW_CLOCK(start) ((void)0)
+#endif // XWRAP_STATS || XWRAP_TRACE
+
+#ifdef XWRAP_STATS
+static uint64_t _xw_free_ns = 0; // Of the closed windows
+
+// Log-linear, 4 buckets per power of two
+static inline int _xw_stats_bucket(uint64_t us)
 {
-    // TODO: get this information from _XPrivDisplay struct
-    return handle->window_name;
+    if (us < 4) {
+        return us;
+    }
+    const int octave = 63 - __builtin_clzll(us);
+    const int bucket = 4 * (octave - 1) + ((us >> (octave - 2)) & 3);
+    return bucket < XW_STATS_BUCKETS ? bucket : XW_STATS_BUCKETS - 1;
 }
 
-XW_DEF bool xw_image_connect(xw_handle* handle, uint32_t* buffer, uint16_t width, uint16_t height)
+static void _xw_stats_frame(xw_handle* handle, uint64_t now)
 {
-    if (handle->image != NULL) {
-        fprintf(stderr, "ERROR: cannot reconnect image\n"); // TODO: reconnect image
-        return false;
+    if (handle->last_frame_ns != 0) {
+        const uint64_t us = (now - handle->last_frame_ns) / 1000;
+        xw_stats* stats   = &handle->stats;
+        if (stats->frames == 0 || us < stats->frame_min_us) {
+            stats->frame_min_us = us;
+        }
+        if (us > stats->frame_max_us) {
+            stats->frame_max_us = us;
+        }
+        stats->frame_histogram[_xw_stats_bucket(us)]++;
+        stats->frames++;
     }
-    handle->image = XCreateImage(handle->display,
-                                 DefaultVisual(handle->display, DefaultScreen(handle->display)), 24,
-                                 ZPixmap, 0, (char*)buffer, width, height, 32, 0);
+    handle->last_frame_ns = now;
+}
 
-    if (handle->image == NULL) {
-        fprintf(stderr, "ERROR: could not connect image\n");
-        return false;
-    }
+#define _XW_STAT_ADD(handle, stat, n) ((handle)->stats.stat += (n))
+#define _XW_STAT_TIME(handle, stat, start) ((handle)->stats.stat += _xw_now_ns() - (start))
+#define _XW_STAT_FRAME(handle, start) _xw_stats_frame((handle), (start))
+#else
+#define _XW_STAT_ADD(handle, stat, n) ((void)0)
+#define _XW_STAT_TIME(handle, stat, start) ((void)0)
+#define _XW_STAT_FRAME(handle, start) ((void)0)
+#endif // XWRAP_STATS
 
-    handle->width  = width;
-    handle->height = height;
-    return true;
-}
+#ifdef XWRAP_TRACE
+#define XW_TRACE_EVENTS (1 << 16) // Per thread, later spans are dropped
 
-XW_DEF bool xw_draw(xw_handle* handle)
+typedef struct {
+    const char* name;
+    uint64_t begin_ns, end_ns;
+    uint64_t window, frame;
+} _xw_trace_event;
+
+// Only its thread writes it, 'len' publishes the events to 'xw_trace_dump'
+typedef struct _xw_trace_buffer {
+    struct _xw_trace_buffer* next;
+    long tid;
+    size_t len;
+    uint64_t dropped;
+    _xw_trace_event events[XW_TRACE_EVENTS];
+} _xw_trace_buffer;
+
+static _xw_trace_buffer* _xw_trace_buffers = NULL; // Lock-free list of all threads
+static __thread _xw_trace_buffer* _xw_trace_local = NULL;
+
+static _xw_trace_buffer* _xw_trace_buffer_get(void)
 {
-    if (handle->image != NULL) {
-        XPutImage(handle->display, handle->window, handle->gc, handle->image, 0, 0, 0, 0,
-                  handle->width, handle->height);
+    if (_xw_trace_local == NULL) {
+        _xw_trace_buffer* buffer = (_xw_trace_buffer*)calloc(1, sizeof(_xw_trace_buffer));
+        if (buffer == NULL) {
+            return NULL;
+        }
+        buffer->tid  = syscall(SYS_gettid);
+        buffer->next = __atomic_load_n(&_xw_trace_buffers, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&_xw_trace_buffers, &buffer->next, buffer, true,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+        _xw_trace_local = buffer;
     }
-    return XFlush(handle->display);
+    return _xw_trace_local;
 }
 
-XW_DEF bool xw_draw_background(xw_handle* handle, uint32_t color)
+static void _xw_trace_span(const char* name, uint64_t begin_ns, uint64_t window, uint64_t frame)
 {
-    XSetWindowBackground(handle->display, handle->window, color);
-    return XClearWindow(handle->display, handle->window);
+    _xw_trace_buffer* buffer = _xw_trace_buffer_get();
+    if (buffer == NULL) {
+        return;
+    }
+    const size_t len = buffer->len;
+    if (len == XW_TRACE_EVENTS) {
+        __atomic_add_fetch(&buffer->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    buffer->events[len] = (_xw_trace_event){
+        .name = name, .begin_ns = begin_ns, .end_ns = _xw_now_ns(), .window = window, .frame = frame};
+    __atomic_store_n(&buffer->len, len + 1, __ATOMIC_RELEASE);
 }
 
-XW_DEF bool xw_draw_text(xw_handle* handle, int x, int y, char* string, uint32_t color)
+#define _XW_TRACE(name, start, handle)                                                             \
+    _xw_trace_span((name), (start), (handle)->window, (handle)->trace_frame)
+#define _XW_TRACE_GLOBAL(name, start) _xw_trace_span((name), (start), 0, 0)
+#define _XW_TRACE_FRAME(handle) ((handle)->trace_frame++)
+#define _XW_TRACE_CLOCK(start) _XW_CLOCK(start) // Only traced, not counted
+#else
+#define _XW_TRACE(name, start, handle) ((void)0)
+#define _XW_TRACE_GLOBAL(name, start) ((void)0)
+#define _XW_TRACE_FRAME(handle) ((void)0)
+#define _XW_TRACE_CLOCK(start) ((void)0)
+#endif // XWRAP_TRACE
+
+#ifdef XWRAP_RECORD
+static void _xw_record_frame(xw_handle* handle);
+#endif // XWRAP_RECORD
+static void _xw_cmdbufs_replay(xw_handle* handle);
+
+#define XW_OVERLAY_SAMPLES 128    // One pixel column each
+#define XW_OVERLAY_HEIGHT 64      // Of the graph
+#define XW_OVERLAY_WIDTH 280      // Of the panel, fits the text
+#define XW_OVERLAY_SCALE_US 33333 // The top of the graph, two 60 Hz frames
+#define XW_OVERLAY_BUDGET_US 16667
+
+struct _xw_overlay {
+    uint32_t frame_us[XW_OVERLAY_SAMPLES];
+    uint32_t upload_us[XW_OVERLAY_SAMPLES];
+    uint32_t events[XW_OVERLAY_SAMPLES];
+    size_t next, len;
+    uint64_t last_frame_ns; // 0 before the first frame
+    uint32_t frame_events;  // Since the last frame
+    uint32_t cost_us;       // Of the last overlay drawing, not in the graph
+};
+
+static void _xw_overlay_draw(xw_handle* handle, Drawable drawable, uint64_t start,
+                             uint64_t uploaded);
+
+#ifdef XWRAP_RENDER
+static void _xw_render_init(xw_handle* handle)
 {
-    XSetForeground(handle->display, handle->gc, color);
+    handle->picture       = None;
+    handle->fill          = None;
+    handle->blend_pixmap  = None;
+    handle->blend_picture = None;
+    handle->blend_width   = 0;
+    handle->blend_height  = 0;
 
-    int length = strlen(string);
-    return XDrawString(handle->display, handle->window, handle->gc, x, y, string, length);
+    int event_base, error_base;
+#ifdef XWRAP_AUTO_LINK
+    if (!_xw_d_link_extension(&dl_render)) {
+        fprintf(stderr, "WARNING: could not link with xrender, using core drawing\n");
+        return;
+    }
+#endif // XWRAP_AUTO_LINK
+    if (!XRenderQueryExtension(handle->display, &event_base, &error_base)) {
+        fprintf(stderr, "WARNING: XRender is missing, using core drawing\n");
+        return;
+    }
+    XRenderPictFormat* format = XRenderFindVisualFormat(
+        handle->display, DefaultVisual(handle->display, DefaultScreen(handle->display)));
+    handle->mask_format = XRenderFindStandardFormat(handle->display, PictStandardA8);
+    if (format == NULL || handle->mask_format == NULL) {
+        fprintf(stderr, "WARNING: XRender format is missing, using core drawing\n");
+        return;
+    }
+    handle->picture = XRenderCreatePicture(handle->display, handle->window, format, 0, NULL);
 }
 
-XW_DEF bool xw_draw_rectangle(xw_handle* handle, int x, int y, unsigned int width,
-                              unsigned int height, bool fill, uint32_t color)
+static void _xw_render_free(xw_handle* handle)
 {
-    XSetForeground(handle->display, handle->gc, color);
-    if (fill) {
-        return XFillRectangle(handle->display, handle->window, handle->gc, x, y, width, height);
+    if (handle->picture == None) {
+        return;
     }
-    return XDrawRectangle(handle->display, handle->window, handle->gc, x, y, width, height);
+    if (handle->fill != None) {
+        XRenderFreePicture(handle->display, handle->fill);
+    }
+    if (handle->blend_picture != None) {
+        XRenderFreePicture(handle->display, handle->blend_picture);
+        XFreeGC(handle->display, handle->blend_gc);
+        XFreePixmap(handle->display, handle->blend_pixmap);
+    }
+    XRenderFreePicture(handle->display, handle->picture);
 }
+#endif // XWRAP_RENDER
 
-XW_DEF bool xw_draw_line(xw_handle* handle, int x0, int y0, int x1, int y1, uint16_t width,
-                         uint32_t color)
+// Updates the kept dimensions, return true if the size changed
+static bool _xw_configure(xw_handle* handle, const XConfigureEvent* configure)
 {
-    XSetLineAttributes(handle->display, handle->gc, width, LineSolid, CapButt, JoinMiter);
-    XSetForeground(handle->display, handle->gc, color);
+    const bool resized = configure->width != handle->dimensions.width ||
+                         configure->height != handle->dimensions.height;
+    handle->dimensions.width  = configure->width;
+    handle->dimensions.height = configure->height;
+    // Real events are relative to the parent, the window manager sends the screen position
+    if (configure->send_event || !handle->reparented) {
+        handle->dimensions.x_pos = configure->x;
+        handle->dimensions.y_pos = configure->y;
+    }
+    return resized;
+}
 
-    return XDrawLine(handle->display, handle->window, handle->gc, x0, y0, x1, y1);
+#ifdef XWRAP_PRESENT
+static void _xw_queue_push_back(xw_handle* handle, const xw_event* event)
+{
+    if (handle->queue_len == XW_QUEUE_SIZE) {
+        // An application that does not read the completions must not be warned every frame,
+        // the oldest completion makes room
+        size_t i = 0;
+        while (i < handle->queue_len &&
+               handle->queue[(handle->queue_head + i) % XW_QUEUE_SIZE].type !=
+                   XW_EVENT_PRESENT_COMPLETE) {
+            i++;
+        }
+        if (i == handle->queue_len) {
+            fprintf(stderr, "WARNING: event queue is full, dropping event\n");
+            return;
+        }
+        for (; i + 1 < handle->queue_len; i++) {
+            handle->queue[(handle->queue_head + i) % XW_QUEUE_SIZE] =
+                handle->queue[(handle->queue_head + i + 1) % XW_QUEUE_SIZE];
+        }
+        handle->queue_len--;
+    }
+    handle->queue[(handle->queue_head + handle->queue_len++) % XW_QUEUE_SIZE] = *event;
 }
+#endif // XWRAP_PRESENT
 
-XW_DEF bool xw_draw_circle(xw_handle* handle, int x, int y, int r, bool fill, uint32_t color)
+static void _xw_queue_push_front(xw_handle* handle, const xw_event* event)
 {
-    XSetForeground(handle->display, handle->gc, color);
-    if (fill) {
-        return XFillArc(handle->display, handle->window, handle->gc, x - r, y - r, 2 * r, 2 * r, 0,
-                        360 * 64);
+    if (handle->queue_len == XW_QUEUE_SIZE) {
+        fprintf(stderr, "WARNING: event queue is full, dropping event\n");
+        return;
     }
-    return XDrawArc(handle->display, handle->window, handle->gc, x - r, y - r, 2 * r, 2 * r, 0,
-                    360 * 64);
+    handle->queue_head                = (handle->queue_head + XW_QUEUE_SIZE - 1) % XW_QUEUE_SIZE;
+    handle->queue[handle->queue_head] = *event;
+    handle->queue_len++;
 }
 
-XW_DEF bool xw_draw_pixel(xw_handle* handle, int x, int y, uint32_t color)
+static xw_event _xw_queue_pop(xw_handle* handle)
 {
-    XSetForeground(handle->display, handle->gc, color);
-    return XDrawPoint(handle->display, handle->window, handle->gc, x, y);
+    const xw_event event = handle->queue[handle->queue_head];
+    handle->queue_head   = (handle->queue_head + 1) % XW_QUEUE_SIZE;
+    handle->queue_len--;
+    return event;
 }
 
-XW_DEF bool xw_draw_triangle(xw_handle* handle, int x0, int y0, int x1, int y1, int x2, int y2,
-                             uint32_t color)
+#ifdef XWRAP_PRESENT
+// Moves the Present events into the xwrap queue, 'wait' blocks for one event
+static void _xw_present_poll(xw_handle* handle, bool wait)
 {
-    XSetForeground(handle->display, handle->gc, color);
-    XPoint points[3] = {
+    if (handle->present_events == NULL) {
+        return;
+    }
+    for (;;) {
+        xcb_generic_event_t* generic =
+            wait ? xcb_wait_for_special_event(handle->xcb, handle->present_events)
+                 : xcb_poll_for_special_event(handle->xcb, handle->present_events);
+        wait = false;
+        if (generic == NULL) {
+            return;
+        }
+
+        // Read by offset, XCB moves the bytes after the first 32 by 'full_sequence'
+        const uint8_t* bytes = (const uint8_t*)generic;
+        uint16_t event_type;
+        uint32_t serial;
+        memcpy(&event_type, bytes + 8, sizeof(event_type));
+        memcpy(&serial, bytes + 20, sizeof(serial));
+        if (event_type == XCB_PRESENT_COMPLETE_NOTIFY) {
+            xw_event event = {0};
+            event.present  = (xw_present_event){.type = XW_EVENT_PRESENT_COMPLETE, .serial = serial};
+            memcpy(&event.present.ust, bytes + 24, sizeof(uint64_t));
+            memcpy(&event.present.msc, bytes + 36, sizeof(uint64_t));
+            _xw_queue_push_back(handle, &event);
+        } else if (event_type == XCB_PRESENT_IDLE_NOTIFY) {
+            uint32_t pixmap;
+            memcpy(&pixmap, bytes + 24, sizeof(pixmap));
+            for (int i = 0; i < 2; i++) {
+                if ((uint32_t)handle->present_pixmaps[i] == pixmap) {
+                    handle->present_busy[i] = false;
+                }
+            }
+        }
+        free(generic);
+    }
+}
+#endif // XWRAP_PRESENT
+
+/* Errors */
+static xw_handle* _xw_handles = NULL; // Open handles
+
+static int _xw_error_handler(Display* display, XErrorEvent* event)
+{
+    // The latest call that started at or before the failed request, of all the windows on the
+    // connection, its window keeps the error
+    xw_handle* handle     = NULL;
+    const char* call      = "";
+    unsigned long closest = 0;
+    for (xw_handle* it = _xw_handles; it != NULL; it = it->next) {
+        if (it->display != display) {
+            continue;
+        }
+        handle = handle != NULL ? handle : it;
+        for (size_t i = 0; i < XW_CALL_RING; i++) {
+            if (it->calls[i].call != NULL && it->calls[i].serial <= event->serial &&
+                it->calls[i].serial >= closest) {
+                closest = it->calls[i].serial;
+                call    = it->calls[i].call;
+                handle  = it;
+            }
+        }
+    }
+    if (handle == NULL) {
+        fprintf(stderr, "ERROR: X error %d on request %d\n", event->error_code,
+                event->request_code);
+        return 0;
+    }
+
+    if (handle->errors_len == XW_ERROR_RING) {
+        handle->errors_head = (handle->errors_head + 1) % XW_ERROR_RING;
+        handle->errors_len--;
+        handle->errors_lost++;
+    }
+    handle->errors[(handle->errors_head + handle->errors_len) % XW_ERROR_RING] = (xw_error){
+        .serial       = event->serial,
+        .resource     = event->resourceid,
+        .error_code   = event->error_code,
+        .request_code = event->request_code,
+        .minor_code   = event->minor_code,
+        .call         = call,
+    };
+    handle->errors_len++;
+    return 0;
+}
+
+static void _xw_errors_register(xw_handle* handle)
+{
+    memset(handle->calls, 0, sizeof(handle->calls));
+    handle->calls_next  = 0;
+    handle->errors_head = 0;
+    handle->errors_len  = 0;
+    handle->errors_lost = 0;
+    // The handler is for the whole process, set again after the last window was closed
+    if (_xw_handles == NULL) {
+        XSetErrorHandler(_xw_error_handler);
+    }
+    handle->next = _xw_handles;
+    _xw_handles  = handle;
+}
+
+static void _xw_errors_unregister(xw_handle* handle)
+{
+    for (xw_handle** it = &_xw_handles; *it != NULL; it = &(*it)->next) {
+        if (*it == handle) {
+            *it = handle->next;
+            return;
+        }
+    }
+}
+
+static bool _xw_auto_flush(xw_handle* handle)
+{
+    if (!handle->auto_flush) {
+        return true;
+    }
+    return xw_flush(handle);
+}
+
+// Opens a connection when 'display' is NULL
+static xw_handle* _xw_create_window(const char* window_name, int width, int height,
+                                    Display* display)
+{
+    _XW_CLOCK(start);
+#ifdef XWRAP_AUTO_LINK
+    // The extensions are linked on their first use
+    if (!_xw_d_link(&dl_handle)) {
+        fprintf(stderr, "ERROR: could not link with x11: %s\n", dlerror());
+        exit(1);
+    }
+#endif // XWRAP_AUTO_LINK
+
+    // Everything that can fail comes before the handle is registered for the X errors
+    xw_handle* handle = (xw_handle*)malloc(sizeof(xw_handle));
+    char* name        = handle != NULL ? malloc(strlen(window_name) * sizeof(char) + 1) : NULL;
+    if (name == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        free(handle);
+        return NULL;
+    }
+    strcpy(name, window_name);
+    handle->window_name = name;
+    handle->display     = display != NULL ? display : XOpenDisplay(NULL);
+    if (handle->display == NULL) {
+        fprintf(stderr, "ERROR: Unable to connect X server\n");
+        free(handle->window_name);
+        free(handle);
+        return NULL;
+    }
+    _xw_errors_register(handle);
+    _XW_CALL(handle);
+    handle->window = XCreateSimpleWindow(
+        handle->display, RootWindow(handle->display, DefaultScreen(handle->display)), 0, 0, width,
+        height, 0, 0x000000, WhitePixel(handle->display, 0));
+
+    // Set the window name
+    XStoreName(handle->display, handle->window, handle->window_name);
+
+    // Select before mapping, so the map is seen
+    XSelectInput(handle->display, handle->window,
+                 KeyPressMask | KeyReleaseMask | ButtonPressMask | ButtonReleaseMask |
+                     PointerMotionMask | LeaveWindowMask | ExposureMask | StructureNotifyMask);
+    XMapWindow(handle->display, handle->window);
+
+    handle->gc             = XCreateGC(handle->display, handle->window, 0, NULL);
+    handle->image          = NULL;
+    handle->buffer         = NULL;
+    handle->auto_flush     = true;
+    handle->shared_display = display != NULL;
+    handle->dimensions     = (xw_dimensions){.width = width, .height = height};
+    handle->reparented     = false;
+    handle->queue_head     = 0;
+    handle->queue_len      = 0;
+#ifdef XWRAP_XCB
+    handle->xcb = NULL;
+#ifdef XWRAP_AUTO_LINK
+    if (_xw_d_link_extension(&dl_x11_xcb) && _xw_d_link_extension(&dl_xcb))
+#endif // XWRAP_AUTO_LINK
+    {
+        handle->xcb = XGetXCBConnection(handle->display);
+    }
+    if (handle->xcb == NULL) {
+        fprintf(stderr, "WARNING: XCB is missing, using Xlib queries\n");
+    }
+#endif // XWRAP_XCB
+#ifdef XWRAP_PRESENT
+    handle->present_events = NULL;
+#endif // XWRAP_PRESENT
+#ifdef XWRAP_SHM
+    handle->shm_seg = 0;
+#endif // XWRAP_SHM
+#ifdef XWRAP_RENDER
+    _xw_render_init(handle);
+#endif // XWRAP_RENDER
+#ifdef XWRAP_RECORD
+    handle->recorder = NULL;
+#endif // XWRAP_RECORD
+#ifdef XWRAP_STATS
+    memset(&handle->stats, 0, sizeof(handle->stats));
+    handle->last_frame_ns = 0;
+#endif // XWRAP_STATS
+#ifdef XWRAP_TRACE
+    handle->trace_frame = 0;
+#endif // XWRAP_TRACE
+    handle->overlay = NULL;
+    handle->cmdbufs = NULL;
+    handle->input   = NULL;
+
+    // Wait for the screen to open - fixes premature drawing
+    XEvent event;
+    do {
+        XWindowEvent(handle->display, handle->window, StructureNotifyMask, &event);
+        if (event.type == ConfigureNotify) {
+            _xw_configure(handle, &event.xconfigure);
+        } else if (event.type == ReparentNotify) {
+            handle->reparented = event.xreparent.parent !=
+                                 RootWindow(handle->display, DefaultScreen(handle->display));
+        }
+    } while (event.type != MapNotify);
+    _XW_STAT_TIME(handle, create_ns, start);
+    _XW_TRACE("xw_create_window", start, handle);
+    return handle;
+}
+
+XW_DEF xw_handle* xw_create_window(const char* window_name, int width, int height)
+{
+    return _xw_create_window(window_name, width, height, NULL);
+}
+
+XW_DEF xw_handle* xw_create_window_shared(const char* window_name, int width, int height,
+                                          xw_handle* share)
+{
+    xw_handle* handle = _xw_create_window(window_name, width, height, share->display);
+    if (handle != NULL) {
+        share->shared_display = true;
+    }
+    return handle;
+}
+
+// The open window that has the connection and the window id, NULL if none
+static xw_handle* _xw_window_handle(const Display* display, Window window)
+{
+    for (xw_handle* handle = _xw_handles; handle != NULL; handle = handle->next) {
+        if (handle->display == display && handle->window == window) {
+            return handle;
+        }
+    }
+    return NULL;
+}
+
+// Checks if another open window uses the connection of 'handle'
+static bool _xw_display_shared(const xw_handle* handle)
+{
+    for (xw_handle* other = _xw_handles; other != NULL; other = other->next) {
+        if (other != handle && other->display == handle->display) {
+            return true;
+        }
+    }
+    return false;
+}
+
+XW_DEF void xw_free_window(xw_handle* handle)
+{
+    _XW_CLOCK(start);
+    if (handle->input != NULL) {
+        xw_input_stop(handle);
+    }
+#ifdef XWRAP_RECORD
+    if (handle->recorder != NULL) {
+        xw_record_stop(handle, NULL);
+    }
+#endif // XWRAP_RECORD
+#ifdef XWRAP_RENDER
+    _xw_render_free(handle);
+#endif // XWRAP_RENDER
+#ifdef XWRAP_PRESENT
+    if (handle->present_events != NULL) {
+        xcb_unregister_for_special_event(handle->xcb, handle->present_events);
+        XFreePixmap(handle->display, handle->present_pixmaps[0]);
+        XFreePixmap(handle->display, handle->present_pixmaps[1]);
+    }
+#endif // XWRAP_PRESENT
+#ifdef XWRAP_SHM
+    // The server keeps the memory mapped until the segment is detached, not only on close
+    if (handle->shm_seg != 0) {
+        xcb_shm_detach(handle->xcb, handle->shm_seg);
+    }
+#endif // XWRAP_SHM
+    free(handle->overlay);
+    XFreeGC(handle->display, handle->gc);
+    XDestroyWindow(handle->display, handle->window);
+    if (!_xw_display_shared(handle)) {
+        XCloseDisplay(handle->display);
+    } else {
+        XFlush(handle->display);
+    }
+    _xw_errors_unregister(handle);
+    _XW_TRACE("xw_free_window", start, handle);
+    free(handle->window_name);
+    free(handle);
+
+    // The linked libraries stay for the next windows
+#ifdef XWRAP_STATS
+    _xw_free_ns += _xw_now_ns() - start;
+#endif // XWRAP_STATS
+}
+
+XW_DEF const char* xw_get_window_name(xw_handle* handle)
+{
+    // TODO: get this information from _XPrivDisplay struct
+    return handle->window_name;
+}
+
+XW_DEF bool xw_image_connect(xw_handle* handle, uint32_t* buffer, uint16_t width, uint16_t height)
+{
+    return xw_image_connect_strided(handle, buffer, width, height, 0);
+}
+
+XW_DEF bool xw_image_connect_strided(xw_handle* handle, uint32_t* buffer, uint16_t width,
+                                     uint16_t height, size_t stride)
+{
+    if (handle->image != NULL) {
+        fprintf(stderr, "ERROR: cannot reconnect image\n"); // TODO: reconnect image
+        return false;
+    }
+    stride = stride != 0 ? stride : (size_t)width * sizeof(uint32_t);
+    if (stride % sizeof(uint32_t) != 0 || stride < (size_t)width * sizeof(uint32_t)) {
+        fprintf(stderr, "ERROR: stride %zu does not fit %u pixels\n", stride, width);
+        return false;
+    }
+    // The X server reads the padding from 'bytes_per_line'
+    handle->image = XCreateImage(handle->display,
+                                 DefaultVisual(handle->display, DefaultScreen(handle->display)), 24,
+                                 ZPixmap, 0, (char*)buffer, width, height, 32, stride);
+
+    if (handle->image == NULL) {
+        fprintf(stderr, "ERROR: could not connect image\n");
+        return false;
+    }
+
+    handle->buffer = buffer;
+    handle->width  = width;
+    handle->height = height;
+    handle->stride = stride / sizeof(uint32_t);
+    return true;
+}
+
+// Clips the region to the connected image, moving the destination with it
+static bool _xw_clip_region(const xw_handle* handle, xw_rect* source, int* x, int* y)
+{
+    const int x0 = source->x < 0 ? 0 : source->x;
+    const int y0 = source->y < 0 ? 0 : source->y;
+    const int x1 = source->x + (int)source->width > handle->width ? handle->width
+                                                                  : source->x + (int)source->width;
+    const int y1 = source->y + (int)source->height > handle->height
+                       ? handle->height
+                       : source->y + (int)source->height;
+    if (x0 >= x1 || y0 >= y1) {
+        return false;
+    }
+    *x += x0 - source->x;
+    *y += y0 - source->y;
+    *source = (xw_rect){.x = x0, .y = y0, .width = x1 - x0, .height = y1 - y0};
+    return true;
+}
+
+// Uploads a region of the connected image, in place when it is in shared memory
+static void _xw_put_image(xw_handle* handle, Drawable drawable, xw_rect source, int x, int y)
+{
+    _XW_STAT_ADD(handle, requests[XW_STAT_IMAGE], 1);
+    _XW_STAT_ADD(handle, bytes_uploaded, (uint64_t)source.width * source.height * 4);
+#ifdef XWRAP_SHM
+    if (handle->shm_seg != 0) {
+        xcb_shm_put_image(handle->xcb, drawable, XGContextFromGC(handle->gc), handle->stride,
+                          handle->height, source.x, source.y, source.width, source.height, x, y,
+                          24, XCB_IMAGE_FORMAT_Z_PIXMAP, 0, handle->shm_seg, handle->shm_offset);
+        return;
+    }
+#endif // XWRAP_SHM
+    XPutImage(handle->display, drawable, handle->gc, handle->image, source.x, source.y, x, y,
+              source.width, source.height);
+}
+
+static bool _xw_draw(xw_handle* handle, xw_rect source, int x, int y)
+{
+    _XW_CLOCK(start);
+    _XW_STAT_FRAME(handle, start);
+    _XW_TRACE_FRAME(handle);
+    const uint64_t overlay_start = handle->overlay != NULL ? _xw_now_ns() : 0;
+    if (handle->image != NULL && _xw_clip_region(handle, &source, &x, &y)) {
+        _xw_put_image(handle, handle->window, source, x, y);
+#ifdef XWRAP_RECORD
+        if (handle->recorder != NULL) {
+            _xw_record_frame(handle);
+        }
+#endif // XWRAP_RECORD
+    }
+    _xw_cmdbufs_replay(handle);
+    if (handle->overlay != NULL) {
+        _xw_overlay_draw(handle, handle->window, overlay_start, _xw_now_ns());
+    }
+    const bool ret = _xw_auto_flush(handle);
+    _XW_STAT_TIME(handle, draw_ns, start);
+    _XW_TRACE("xw_draw", start, handle);
+    return ret;
+}
+
+XW_DEF bool xw_draw(xw_handle* handle)
+{
+    _XW_CALL(handle);
+    return _xw_draw(handle, (xw_rect){.width = handle->width, .height = handle->height}, 0, 0);
+}
+
+XW_DEF bool xw_draw_region(xw_handle* handle, xw_rect source, int x, int y)
+{
+    _XW_CALL(handle);
+    return _xw_draw(handle, source, x, y);
+}
+
+// Checks if no window before 'index' has the connection of 'handles[index]'
+static bool _xw_first_on_display(xw_handle** handles, size_t index)
+{
+    for (size_t i = 0; i < index; i++) {
+        if (handles[i]->display == handles[index]->display) {
+            return false;
+        }
+    }
+    return true;
+}
+
+XW_DEF bool xw_draw_many(xw_handle** handles, size_t count)
+{
+#ifdef XWRAP_SHM
+    xcb_get_geometry_cookie_t* fences =
+        (xcb_get_geometry_cookie_t*)malloc(sizeof(xcb_get_geometry_cookie_t) * count);
+    if (fences == NULL && count > 0) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        return false;
+    }
+#endif // XWRAP_SHM
+    bool ok = true;
+    for (size_t i = 0; i < count; i++) {
+        xw_handle* handle     = handles[i];
+        const bool auto_flush = handle->auto_flush;
+        handle->auto_flush    = false;
+        _XW_CALL(handle);
+        ok &= _xw_draw(handle, (xw_rect){.width = handle->width, .height = handle->height}, 0, 0);
+        handle->auto_flush = auto_flush;
+    }
+
+    // One flush for each connection, a shared connection sends all its windows in one write
+    for (size_t i = 0; i < count; i++) {
+        if (!_xw_first_on_display(handles, i)) {
+            continue;
+        }
+#ifdef XWRAP_SHM
+        // Any reply comes after the server has read the shared images sent before it
+        fences[i].sequence = 0;
+        for (size_t j = i; j < count && fences[i].sequence == 0; j++) {
+            if (handles[j]->display == handles[i]->display && handles[j]->shm_seg != 0) {
+                fences[i] = xcb_get_geometry(handles[i]->xcb, handles[i]->window);
+            }
+        }
+#endif // XWRAP_SHM
+        ok &= xw_flush(handles[i]);
+    }
+#ifdef XWRAP_SHM
+    // The connections wait together
+    for (size_t i = 0; i < count; i++) {
+        if (_xw_first_on_display(handles, i) && fences[i].sequence != 0) {
+            free(xcb_get_geometry_reply(handles[i]->xcb, fences[i], NULL));
+        }
+    }
+    free(fences);
+#endif // XWRAP_SHM
+    return ok;
+}
+
+XW_DEF bool xw_flush(xw_handle* handle)
+{
+    _XW_TRACE_CLOCK(start);
+    _XW_STAT_ADD(handle, flushes, 1);
+    const bool ret = XFlush(handle->display);
+    _XW_TRACE("XFlush", start, handle);
+    return ret;
+}
+
+XW_DEF void xw_set_auto_flush(xw_handle* handle, bool auto_flush)
+{
+    handle->auto_flush = auto_flush;
+}
+
+XW_DEF bool xw_draw_background(xw_handle* handle, uint32_t color)
+{
+    _XW_CALL(handle);
+    _XW_STAT_ADD(handle, requests[XW_STAT_BACKGROUND], 1);
+    XSetWindowBackground(handle->display, handle->window, color);
+    return XClearWindow(handle->display, handle->window);
+}
+
+XW_DEF bool xw_draw_text(xw_handle* handle, int x, int y, char* string, uint32_t color)
+{
+    _XW_CALL(handle);
+    XSetForeground(handle->display, handle->gc, color);
+
+    int length = strlen(string);
+    _XW_STAT_ADD(handle, requests[XW_STAT_TEXT], 1);
+    return XDrawString(handle->display, handle->window, handle->gc, x, y, string, length);
+}
+
+XW_DEF bool xw_draw_rectangle(xw_handle* handle, int x, int y, unsigned int width,
+                              unsigned int height, bool fill, uint32_t color)
+{
+    _XW_CALL(handle);
+    XSetForeground(handle->display, handle->gc, color);
+    _XW_STAT_ADD(handle, requests[XW_STAT_RECTANGLE], 1);
+    if (fill) {
+        return XFillRectangle(handle->display, handle->window, handle->gc, x, y, width, height);
+    }
+    return XDrawRectangle(handle->display, handle->window, handle->gc, x, y, width, height);
+}
+
+XW_DEF bool xw_draw_line(xw_handle* handle, int x0, int y0, int x1, int y1, uint16_t width,
+                         uint32_t color)
+{
+    _XW_CALL(handle);
+    XSetLineAttributes(handle->display, handle->gc, width, LineSolid, CapButt, JoinMiter);
+    XSetForeground(handle->display, handle->gc, color);
+    _XW_STAT_ADD(handle, requests[XW_STAT_LINE], 1);
+
+    return XDrawLine(handle->display, handle->window, handle->gc, x0, y0, x1, y1);
+}
+
+XW_DEF bool xw_draw_circle(xw_handle* handle, int x, int y, int r, bool fill, uint32_t color)
+{
+    _XW_CALL(handle);
+    XSetForeground(handle->display, handle->gc, color);
+    _XW_STAT_ADD(handle, requests[XW_STAT_CIRCLE], 1);
+    if (fill) {
+        return XFillArc(handle->display, handle->window, handle->gc, x - r, y - r, 2 * r, 2 * r, 0,
+                        360 * 64);
+    }
+    return XDrawArc(handle->display, handle->window, handle->gc, x - r, y - r, 2 * r, 2 * r, 0,
+                    360 * 64);
+}
+
+XW_DEF bool xw_draw_pixel(xw_handle* handle, int x, int y, uint32_t color)
+{
+    _XW_CALL(handle);
+    XSetForeground(handle->display, handle->gc, color);
+    _XW_STAT_ADD(handle, requests[XW_STAT_PIXEL], 1);
+    return XDrawPoint(handle->display, handle->window, handle->gc, x, y);
+}
+
+XW_DEF bool xw_draw_triangle(xw_handle* handle, int x0, int y0, int x1, int y1, int x2, int y2,
+                             uint32_t color)
+{
+    _XW_CALL(handle);
+    XSetForeground(handle->display, handle->gc, color);
+    XPoint points[3] = {
         [0] = {.x = x0, .y = y0},
         [1] = {.x = x1, .y = y1},
         [2] = {.x = x2, .y = y2},
@@ -695,113 +2929,4505 @@ XW_DEF bool xw_draw_triangle(xw_handle* handle, int x0, int y0, int x1, int y1,
     int npoints = 3;
     int shape   = Nonconvex;
     int mode    = CoordModeOrigin;
+    _XW_STAT_ADD(handle, requests[XW_STAT_TRIANGLE], 1);
+
+    return XFillPolygon(handle->display, handle->window, handle->gc, points, npoints, shape, mode);
+}
+
+// Defined with the input logs
+static int _xw_input_pending(xw_handle* handle);
+static bool _xw_input_next(xw_handle* handle, xw_event* event);
+
+static bool _xw_next_x_event(xw_handle* handle, xw_event* event);
+
+// On a shared connection the events stay in the X11 queue until their window reads them, the
+// events of windows without a handle go to the first window that reads
+static int _xw_own_event(Display* display, XEvent* event, XPointer arg)
+{
+    const xw_handle* handle = (const xw_handle*)arg;
+    return event->xany.window == handle->window ||
+           _xw_window_handle(display, event->xany.window) == NULL;
+}
+
+typedef struct {
+    xw_handle* handle;
+    int count;
+} _xw_own_count;
+
+// Counts without taking, never matches
+static int _xw_count_own_event(Display* display, XEvent* event, XPointer arg)
+{
+    _xw_own_count* own = (_xw_own_count*)arg;
+    own->count += _xw_own_event(display, event, (XPointer)own->handle);
+    return false;
+}
+
+// The events of the X11 queue for this window
+static int _xw_x_pending(xw_handle* handle)
+{
+    const int pending = XPending(handle->display);
+    if (!handle->shared_display || pending == 0) {
+        return pending;
+    }
+    _xw_own_count own = {.handle = handle, .count = 0};
+    XEvent unused;
+    XCheckIfEvent(handle->display, &unused, _xw_count_own_event, (XPointer)&own);
+    return own.count;
+}
+
+XW_DEF int xw_event_pending(xw_handle* handle)
+{
+    _XW_TRACE_CLOCK(start);
+#ifdef XWRAP_PRESENT
+    _xw_present_poll(handle, false);
+#endif // XWRAP_PRESENT
+    int pending = handle->queue_len;
+    if (handle->input != NULL) {
+        pending += _xw_input_pending(handle);
+    } else {
+        pending += _xw_x_pending(handle);
+    }
+    _XW_TRACE("xw_event_pending", start, handle);
+    return pending;
+}
+
+XW_DEF bool xw_get_next_event(xw_handle* handle, xw_event* event)
+{
+    if (handle->queue_len > 0) {
+        *event = _xw_queue_pop(handle);
+        return true;
+    }
+    if (handle->input != NULL) {
+        return _xw_input_next(handle, event);
+    }
+    return _xw_next_x_event(handle, event);
+}
+
+// Waits for the next X11 event and decodes it
+static bool _xw_next_x_event(xw_handle* handle, xw_event* event)
+{
+    _XW_CLOCK(start);
+    XEvent* Xevent = (XEvent*)event->original_event;
+    bool ret       = handle->shared_display
+                         ? XIfEvent(handle->display, Xevent, _xw_own_event, (XPointer)handle)
+                         : XNextEvent(handle->display, Xevent);
+    event->type    = Xevent->type;
+    _XW_STAT_ADD(handle, events, 1);
+    if (handle->overlay != NULL) {
+        handle->overlay->frame_events++;
+    }
+
+    switch (event->type) {
+        case MotionNotify:
+        case ButtonRelease:
+        case ButtonPress: {
+            event->mouse.button = Xevent->xbutton.button;
+            event->mouse.x      = Xevent->xbutton.x;
+            event->mouse.y      = Xevent->xbutton.y;
+            event->mouse.y_root = Xevent->xbutton.y_root;
+            event->mouse.x_root = Xevent->xbutton.x_root;
+        } break;
+
+        case LeaveNotify: {
+            event->mouse.button = 0;
+            event->mouse.x      = Xevent->xcrossing.x;
+            event->mouse.y      = Xevent->xcrossing.y;
+            event->mouse.y_root = Xevent->xcrossing.y_root;
+            event->mouse.x_root = Xevent->xcrossing.x_root;
+        } break;
+
+        case KeyPress:
+        case KeyRelease: {
+            event->button.key_code = Xevent->xkey.keycode;
+        } break;
+
+        case Expose: {
+            event->expose.rect = (xw_rect){.x      = Xevent->xexpose.x,
+                                           .y      = Xevent->xexpose.y,
+                                           .width  = Xevent->xexpose.width,
+                                           .height = Xevent->xexpose.height};
+        } break;
+
+        case ConfigureNotify: {
+            event->type = _xw_configure(handle, &Xevent->xconfigure) ? XW_EVENT_RESIZE
+                                                                     : XW_EVENT_MOVE;
+            event->configure.dimensions = handle->dimensions;
+        } break;
+
+        case ReparentNotify: {
+            handle->reparented = Xevent->xreparent.parent !=
+                                 RootWindow(handle->display, DefaultScreen(handle->display));
+        } break;
+
+        case MapNotify:
+        case UnmapNotify:
+        case DestroyNotify:
+        case GravityNotify:
+        case CirculateNotify:
+            break;
+
+        default:
+            fprintf(stderr, __FILE__ ":%d WARNING: unreachable code\n", __LINE__);
+            break;
+    }
+
+    _XW_STAT_TIME(handle, event_ns, start);
+    _XW_TRACE("xw_get_next_event", start, handle);
+    return ret;
+}
+
+XW_DEF bool xw_push_back_event(xw_handle* handle, xw_event event)
+{
+    // A logged event must not be read from the X11 queue twice
+    if (event.type >= XW_EVENT_SHAPE_ENTER || handle->input != NULL) {
+        _xw_queue_push_front(handle, &event);
+        return true;
+    }
+    return XPutBackEvent(handle->display, (XEvent*)event.original_event);
+}
+
+XW_DEF xw_cookie xw_request_dimensions(xw_handle* handle)
+{
+    xw_cookie cookie = {0};
+#ifdef XWRAP_XCB
+    if (handle->xcb != NULL) {
+        cookie.sequence = xcb_get_geometry(handle->xcb, handle->window).sequence;
+        // Each window has its own connection, send now so the waits overlap
+        xcb_flush(handle->xcb);
+    }
+#else
+    (void)handle;
+#endif // XWRAP_XCB
+    return cookie;
+}
+
+XW_DEF bool xw_reply_dimensions(xw_handle* handle, xw_cookie cookie, xw_dimensions* dimensions)
+{
+#ifdef XWRAP_XCB
+    if (handle->xcb != NULL) {
+        const xcb_get_geometry_cookie_t request = {.sequence = cookie.sequence};
+        xcb_get_geometry_reply_t* reply = xcb_get_geometry_reply(handle->xcb, request, NULL);
+        if (reply == NULL) {
+            fprintf(stderr, "ERROR: could not get the window geometry\n");
+            return false;
+        }
+        *dimensions = (xw_dimensions){
+            .width = reply->width, .height = reply->height, .x_pos = reply->x, .y_pos = reply->y};
+        free(reply);
+        return true;
+    }
+#else
+    (void)cookie;
+#endif // XWRAP_XCB
+    XWindowAttributes window_attributes_return = {0};
+    if (!XGetWindowAttributes(handle->display, handle->window, &window_attributes_return)) {
+        fprintf(stderr, "ERROR: could not get the window attributes\n");
+        return false;
+    }
+    *dimensions = (xw_dimensions){.width  = window_attributes_return.width,
+                                  .height = window_attributes_return.height,
+                                  .x_pos  = window_attributes_return.x,
+                                  .y_pos  = window_attributes_return.y};
+    return true;
+}
+
+XW_DEF bool xw_get_dimensions_many(xw_handle** handles, size_t count, xw_dimensions* dimensions)
+{
+    // Send the requests of a chunk before waiting, the replies come back together
+    xw_cookie cookies[XW_COOKIE_CHUNK];
+    bool ok = true;
+    for (size_t first = 0; first < count; first += XW_COOKIE_CHUNK) {
+        const size_t len = count - first < XW_COOKIE_CHUNK ? count - first : XW_COOKIE_CHUNK;
+        for (size_t i = 0; i < len; i++) {
+            cookies[i] = xw_request_dimensions(handles[first + i]);
+        }
+        for (size_t i = 0; i < len; i++) {
+            ok &= xw_reply_dimensions(handles[first + i], cookies[i], &dimensions[first + i]);
+        }
+    }
+    return ok;
+}
+
+XW_DEF xw_dimensions xw_get_dimensions(xw_handle* handle)
+{
+    return handle->dimensions;
+}
+
+XW_DEF void xw_sleep_us(unsigned long nanoseconds)
+{
+    _XW_TRACE_CLOCK(start);
+    struct timespec ts;
+    ts.tv_sec  = nanoseconds / 1000000ul;
+    ts.tv_nsec = (nanoseconds % 1000000ul) * 1000;
+    nanosleep(&ts, NULL);
+    _XW_TRACE_GLOBAL("xw_sleep_us", start);
+}
+
+XW_DEF void xw_sleep_ms(unsigned long milliseconds)
+{
+    xw_sleep_us(1000 * milliseconds);
+}
+
+XW_DEF bool xw_wait_for_esc(xw_handle* handle, uint64_t timeout)
+{
+    uint64_t total = 0;
+    uint64_t wait  = 50;
+    if (timeout > wait && timeout != 0) {
+        wait = timeout;
+    }
+
+    for (;;) {
+        bool found_event        = false;
+        const int event_pending = xw_event_pending(handle);
+        xw_event events[event_pending];
+        size_t pos = 0;
+        for (size_t i = 0; i < event_pending; i++) {
+            xw_get_next_event(handle, &events[pos]);
+            if (events[pos].type == KeyPress && events[pos].button.key_code == 9) {
+                found_event = true;
+                break;
+            } else {
+                pos++;
+            }
+        }
+        // put back on the event stack - (in the doc they said queue but...)
+        for (int i = pos - 1; i >= 0; i--) {
+            xw_push_back_event(handle, events[i]);
+        }
+        if (found_event) {
+            return true;
+        }
+
+        xw_sleep_us(wait);
+        total += wait;
+
+        if (total > timeout && timeout != 0) {
+            return false;
+        }
+    }
+}
+
+/* Sprites */
+typedef struct {
+    uint32_t* pixels;
+    int width, height;
+    size_t stride; // In pixels
+} _xw_surface;
+
+static bool _xw_image_surface(xw_handle* handle, _xw_surface* surface)
+{
+    if (handle->buffer == NULL) {
+        fprintf(stderr, "ERROR: no image connected\n");
+        return false;
+    }
+    surface->pixels = handle->buffer;
+    surface->width  = handle->width;
+    surface->height = handle->height;
+    surface->stride = handle->stride;
+    return true;
+}
+
+typedef struct {
+    uint16_t x, y, width, height;
+} _xw_atlas_rect;
+
+struct _xw_atlas {
+    uint32_t* pixels;
+    uint16_t width, height;
+    uint32_t color_key;
+
+    // Shelf packing
+    uint16_t shelf_x, shelf_y, shelf_height;
+
+    _xw_atlas_rect* rects;
+    size_t rects_len;
+    size_t rects_cap;
+};
+
+XW_DEF xw_atlas* xw_atlas_create(uint16_t width, uint16_t height)
+{
+    xw_atlas* atlas = (xw_atlas*)calloc(1, sizeof(xw_atlas));
+    if (atlas == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        return NULL;
+    }
+    atlas->pixels = (uint32_t*)calloc((size_t)width * height, sizeof(uint32_t));
+    if (atlas->pixels == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        free(atlas);
+        return NULL;
+    }
+    atlas->width     = width;
+    atlas->height    = height;
+    atlas->color_key = 0xFF00FF;
+    return atlas;
+}
+
+XW_DEF void xw_atlas_free(xw_atlas* atlas)
+{
+    free(atlas->pixels);
+    free(atlas->rects);
+    free(atlas);
+}
+
+XW_DEF int xw_atlas_add(xw_atlas* atlas, const uint32_t* pixels, uint16_t width, uint16_t height)
+{
+    if (width > atlas->width) {
+        fprintf(stderr, "ERROR: sprite is wider than the atlas\n");
+        return -1;
+    }
+    // Open a new shelf when the current one is out of room, kept only if the sprite fits
+    unsigned int shelf_x      = atlas->shelf_x;
+    unsigned int shelf_y      = atlas->shelf_y;
+    unsigned int shelf_height = atlas->shelf_height;
+    if (shelf_x + width > atlas->width) {
+        shelf_y += shelf_height;
+        shelf_x      = 0;
+        shelf_height = 0;
+    }
+    if (shelf_y + height > atlas->height) {
+        fprintf(stderr, "ERROR: atlas is full\n");
+        return -1;
+    }
+
+    if (atlas->rects_len == atlas->rects_cap) {
+        const size_t cap      = atlas->rects_cap == 0 ? 64 : atlas->rects_cap * 2;
+        _xw_atlas_rect* rects = (_xw_atlas_rect*)realloc(atlas->rects, cap * sizeof(*rects));
+        if (rects == NULL) {
+            fprintf(stderr, "ERROR: Buy more ram\n");
+            return -1;
+        }
+        atlas->rects     = rects;
+        atlas->rects_cap = cap;
+    }
+
+    _xw_atlas_rect rect = {.x = shelf_x, .y = shelf_y, .width = width, .height = height};
+    for (size_t row = 0; row < height; row++) {
+        memcpy(&atlas->pixels[(size_t)(rect.y + row) * atlas->width + rect.x],
+               &pixels[row * width], width * sizeof(uint32_t));
+    }
+
+    atlas->shelf_x      = shelf_x + width;
+    atlas->shelf_y      = shelf_y;
+    atlas->shelf_height = height > shelf_height ? height : shelf_height;
+    atlas->rects[atlas->rects_len] = rect;
+    return (int)atlas->rects_len++;
+}
+
+XW_DEF void xw_atlas_set_color_key(xw_atlas* atlas, uint32_t color)
+{
+    atlas->color_key = color & 0xFFFFFF;
+}
+
+// (x + 128 + ((x + 128) >> 8)) >> 8 is x / 255 rounded, exact for x <= 255 * 255
+static inline uint32_t _xw_div255(uint32_t x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static inline uint32_t _xw_blend_pixel(uint32_t src, uint32_t dst, uint32_t alpha)
+{
+    uint32_t out = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const uint32_t s = (src >> shift) & 0xFF;
+        const uint32_t d = (dst >> shift) & 0xFF;
+        out |= _xw_div255(s * alpha + d * (255 - alpha)) << shift;
+    }
+    return out;
+}
+
+#if defined(__SSE2__)
+// Blends 4 pixels, 'alpha' holds the per pixel alpha in the alpha byte of each lane
+static inline __m128i _xw_blend4(__m128i src, __m128i dst, __m128i alpha)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c128 = _mm_set1_epi16(128);
+    const __m128i c255 = _mm_set1_epi16(255);
+
+    __m128i a_lo = _mm_unpacklo_epi8(alpha, zero);
+    __m128i a_hi = _mm_unpackhi_epi8(alpha, zero);
+    a_lo         = _mm_shufflehi_epi16(_mm_shufflelo_epi16(a_lo, 0xFF), 0xFF);
+    a_hi         = _mm_shufflehi_epi16(_mm_shufflelo_epi16(a_hi, 0xFF), 0xFF);
+
+    __m128i lo = _mm_add_epi16(
+        _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(src, zero), a_lo),
+                      _mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero), _mm_sub_epi16(c255, a_lo))),
+        c128);
+    __m128i hi = _mm_add_epi16(
+        _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(src, zero), a_hi),
+                      _mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero), _mm_sub_epi16(c255, a_hi))),
+        c128);
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+    return _mm_packus_epi16(lo, hi);
+}
+
+// Multiplies the alpha byte of each lane by 'alpha' / 255
+static inline __m128i _xw_scale_alpha4(__m128i src, uint8_t alpha)
+{
+    const __m128i a   = _mm_srli_epi32(src, 24);
+    __m128i scaled    = _mm_add_epi32(_mm_mullo_epi16(a, _mm_set1_epi32(alpha)), _mm_set1_epi32(128));
+    scaled            = _mm_srli_epi32(_mm_add_epi32(scaled, _mm_srli_epi32(scaled, 8)), 8);
+    return _mm_slli_epi32(scaled, 24);
+}
+#endif // __SSE2__
+
+#if defined(__SSE2__)
+static inline __m128i _xw_load4(const uint32_t* src, int i, bool reverse)
+{
+    if (reverse) {
+        return _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(src - i - 3)), 0x1B);
+    }
+    return _mm_loadu_si128((const __m128i*)(src + i));
+}
+#endif // __SSE2__
+
+// 'src' walks backwards when 'reverse' is set (horizontal flip)
+static inline void _xw_blit_row(uint32_t* dst, const uint32_t* src, int len, bool reverse,
+                                xw_blend blend, uint8_t alpha, uint32_t color_key)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    if (blend == XW_BLEND_COLOR_KEY) {
+        const __m128i rgb_mask = _mm_set1_epi32(0xFFFFFF);
+        const __m128i key      = _mm_set1_epi32(color_key);
+        const __m128i opaque   = _mm_set1_epi32((int)((uint32_t)alpha << 24));
+        for (; i + 4 <= len; i += 4) {
+            const __m128i s    = _xw_load4(src, i, reverse);
+            const __m128i d    = _mm_loadu_si128((const __m128i*)(dst + i));
+            const __m128i skip = _mm_cmpeq_epi32(_mm_and_si128(s, rgb_mask), key);
+            const __m128i out  = alpha == 255
+                                     ? _mm_or_si128(_mm_and_si128(skip, d), _mm_andnot_si128(skip, s))
+                                     : _xw_blend4(s, d, _mm_andnot_si128(skip, opaque));
+            _mm_storeu_si128((__m128i*)(dst + i), out);
+        }
+    } else if (alpha == 255) {
+        const __m128i alpha_mask = _mm_set1_epi32((int)0xFF000000);
+        for (; i + 4 <= len; i += 4) {
+            const __m128i s = _xw_load4(src, i, reverse);
+            const __m128i a = _mm_and_si128(s, alpha_mask);
+            // Most sprite pixels are either fully opaque or fully transparent
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, alpha_mask)) == 0xFFFF) {
+                _mm_storeu_si128((__m128i*)(dst + i), s);
+                continue;
+            }
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, _mm_setzero_si128())) == 0xFFFF) {
+                continue;
+            }
+            const __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+            _mm_storeu_si128((__m128i*)(dst + i), _xw_blend4(s, d, s));
+        }
+    } else {
+        for (; i + 4 <= len; i += 4) {
+            const __m128i s = _xw_load4(src, i, reverse);
+            const __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+            _mm_storeu_si128((__m128i*)(dst + i), _xw_blend4(s, d, _xw_scale_alpha4(s, alpha)));
+        }
+    }
+#endif // __SSE2__
+    for (; i < len; i++) {
+        const uint32_t s = reverse ? *(src - i) : src[i];
+        if (blend == XW_BLEND_COLOR_KEY) {
+            if ((s & 0xFFFFFF) == color_key) {
+                continue;
+            }
+            dst[i] = alpha == 255 ? s : _xw_blend_pixel(s, dst[i], alpha);
+        } else {
+            dst[i] = _xw_blend_pixel(s, dst[i], _xw_div255((s >> 24) * alpha));
+        }
+    }
+}
+
+XW_DEF bool xw_draw_sprites(xw_handle* handle, const xw_atlas* atlas, const xw_sprite* sprites,
+                            size_t count, xw_blend blend)
+{
+    _xw_surface surface;
+    if (!_xw_image_surface(handle, &surface)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const xw_sprite* sprite = &sprites[i];
+        if (sprite->id < 0 || (size_t)sprite->id >= atlas->rects_len) {
+            fprintf(stderr, "ERROR: unknown sprite id %d\n", sprite->id);
+            return false;
+        }
+        const _xw_atlas_rect rect = atlas->rects[sprite->id];
+
+        // Clip to the image
+        const int x0 = sprite->x < 0 ? 0 : sprite->x;
+        const int y0 = sprite->y < 0 ? 0 : sprite->y;
+        const int x1 = sprite->x + rect.width > surface.width ? surface.width : sprite->x + rect.width;
+        const int y1 =
+            sprite->y + rect.height > surface.height ? surface.height : sprite->y + rect.height;
+        if (x0 >= x1 || y0 >= y1 || sprite->alpha == 0) {
+            continue;
+        }
+
+        const bool flip_h = sprite->flip & XW_FLIP_HORIZONTAL;
+        const bool flip_v = sprite->flip & XW_FLIP_VERTICAL;
+        const int src_x = flip_h ? rect.width - 1 - (x0 - sprite->x) : x0 - sprite->x;
+        for (int y = y0; y < y1; y++) {
+            const int src_y = flip_v ? rect.height - 1 - (y - sprite->y) : y - sprite->y;
+            const uint32_t* src =
+                &atlas->pixels[(size_t)(rect.y + src_y) * atlas->width + rect.x + src_x];
+            _xw_blit_row(&surface.pixels[(size_t)y * surface.stride + x0], src, x1 - x0, flip_h,
+                         blend, sprite->alpha, atlas->color_key);
+        }
+    }
+    return true;
+}
+
+/* Scene */
+#define XW_SCENE_MAX_DAMAGE 16
+
+typedef struct {
+    xw_shape shape;
+    bool alive;
+} _xw_scene_node;
+
+struct _xw_scene {
+    xw_handle* handle;
+    uint32_t background;
+    unsigned int width, height;
+    xw_hit_index* index; // Created on first use
+
+    _xw_scene_node* nodes;
+    size_t nodes_len;
+    size_t nodes_cap;
+
+    xw_rect damage[XW_SCENE_MAX_DAMAGE];
+    size_t damage_len;
+};
+
+static inline bool _xw_rect_empty(xw_rect r)
+{
+    return r.width == 0 || r.height == 0;
+}
+
+static inline xw_rect _xw_rect_union(xw_rect a, xw_rect b)
+{
+    if (_xw_rect_empty(a)) {
+        return b;
+    }
+    if (_xw_rect_empty(b)) {
+        return a;
+    }
+    const int x0 = a.x < b.x ? a.x : b.x;
+    const int y0 = a.y < b.y ? a.y : b.y;
+    const int x1 = a.x + (int)a.width > b.x + (int)b.width ? a.x + (int)a.width : b.x + (int)b.width;
+    const int y1 =
+        a.y + (int)a.height > b.y + (int)b.height ? a.y + (int)a.height : b.y + (int)b.height;
+    return (xw_rect){.x = x0, .y = y0, .width = x1 - x0, .height = y1 - y0};
+}
+
+static inline bool _xw_rect_intersects(xw_rect a, xw_rect b)
+{
+    return !_xw_rect_empty(a) && !_xw_rect_empty(b) && a.x < b.x + (int)b.width &&
+           b.x < a.x + (int)a.width && a.y < b.y + (int)b.height && b.y < a.y + (int)a.height;
+}
+
+static inline xw_rect _xw_rect_intersection(xw_rect a, xw_rect b)
+{
+    if (!_xw_rect_intersects(a, b)) {
+        return (xw_rect){0};
+    }
+    const int x0 = a.x > b.x ? a.x : b.x;
+    const int y0 = a.y > b.y ? a.y : b.y;
+    const int x1 = a.x + (int)a.width < b.x + (int)b.width ? a.x + (int)a.width : b.x + (int)b.width;
+    const int y1 =
+        a.y + (int)a.height < b.y + (int)b.height ? a.y + (int)a.height : b.y + (int)b.height;
+    return (xw_rect){.x = x0, .y = y0, .width = x1 - x0, .height = y1 - y0};
+}
+
+static inline uint64_t _xw_rect_area(xw_rect r)
+{
+    return (uint64_t)r.width * r.height;
+}
+
+// Conservative bounds of what the shape touches on the screen
+static xw_rect _xw_shape_bounds(const xw_shape* shape)
+{
+    if (!shape->visible) {
+        return (xw_rect){0};
+    }
+    switch (shape->type) {
+        case XW_SHAPE_RECTANGLE:
+            return (xw_rect){.x      = shape->rectangle.x,
+                             .y      = shape->rectangle.y,
+                             .width  = shape->rectangle.width + 1,
+                             .height = shape->rectangle.height + 1};
+        case XW_SHAPE_CIRCLE:
+            return (xw_rect){.x      = shape->circle.x - shape->circle.r,
+                             .y      = shape->circle.y - shape->circle.r,
+                             .width  = 2 * shape->circle.r + 1,
+                             .height = 2 * shape->circle.r + 1};
+        case XW_SHAPE_LINE: {
+            const int pad = shape->line.width / 2 + 1;
+            const int x0  = shape->line.x0 < shape->line.x1 ? shape->line.x0 : shape->line.x1;
+            const int y0  = shape->line.y0 < shape->line.y1 ? shape->line.y0 : shape->line.y1;
+            const int x1  = shape->line.x0 < shape->line.x1 ? shape->line.x1 : shape->line.x0;
+            const int y1  = shape->line.y0 < shape->line.y1 ? shape->line.y1 : shape->line.y0;
+            return (xw_rect){.x      = x0 - pad,
+                             .y      = y0 - pad,
+                             .width  = x1 - x0 + 2 * pad + 1,
+                             .height = y1 - y0 + 2 * pad + 1};
+        }
+        case XW_SHAPE_TRIANGLE: {
+            const int xs[3] = {shape->triangle.x0, shape->triangle.x1, shape->triangle.x2};
+            const int ys[3] = {shape->triangle.y0, shape->triangle.y1, shape->triangle.y2};
+            int x0 = xs[0], x1 = xs[0], y0 = ys[0], y1 = ys[0];
+            for (int i = 1; i < 3; i++) {
+                x0 = xs[i] < x0 ? xs[i] : x0;
+                x1 = xs[i] > x1 ? xs[i] : x1;
+                y0 = ys[i] < y0 ? ys[i] : y0;
+                y1 = ys[i] > y1 ? ys[i] : y1;
+            }
+            return (xw_rect){.x = x0, .y = y0, .width = x1 - x0 + 1, .height = y1 - y0 + 1};
+        }
+    }
+    return (xw_rect){0};
+}
+
+static bool _xw_shape_draw(xw_handle* handle, const xw_shape* shape)
+{
+    switch (shape->type) {
+        case XW_SHAPE_RECTANGLE:
+            return xw_draw_rectangle(handle, shape->rectangle.x, shape->rectangle.y,
+                                     shape->rectangle.width, shape->rectangle.height, shape->fill,
+                                     shape->color);
+        case XW_SHAPE_CIRCLE:
+            return xw_draw_circle(handle, shape->circle.x, shape->circle.y, shape->circle.r,
+                                  shape->fill, shape->color);
+        case XW_SHAPE_LINE:
+            return xw_draw_line(handle, shape->line.x0, shape->line.y0, shape->line.x1,
+                                shape->line.y1, shape->line.width, shape->color);
+        case XW_SHAPE_TRIANGLE:
+            return xw_draw_triangle(handle, shape->triangle.x0, shape->triangle.y0,
+                                    shape->triangle.x1, shape->triangle.y1, shape->triangle.x2,
+                                    shape->triangle.y2, shape->color);
+    }
+    return false;
+}
+
+static _xw_scene_node* _xw_scene_find(const xw_scene* scene, int id)
+{
+    if (id < 0 || (size_t)id >= scene->nodes_len || !scene->nodes[id].alive) {
+        fprintf(stderr, "ERROR: unknown shape id %d\n", id);
+        return NULL;
+    }
+    return &scene->nodes[id];
+}
+
+XW_DEF xw_scene* xw_scene_create(xw_handle* handle, uint32_t background)
+{
+    xw_scene* scene = (xw_scene*)calloc(1, sizeof(xw_scene));
+    if (scene == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        return NULL;
+    }
+    scene->handle     = handle;
+    scene->background = background;
+
+    // Nothing was painted yet
+    const xw_dimensions dimensions = xw_get_dimensions(handle);
+    scene->width                   = dimensions.width;
+    scene->height                  = dimensions.height;
+    xw_scene_damage(scene, (xw_rect){.width = dimensions.width, .height = dimensions.height});
+    return scene;
+}
+
+XW_DEF void xw_scene_free(xw_scene* scene)
+{
+    if (scene->index != NULL) {
+        xw_hit_index_free(scene->index);
+    }
+    free(scene->nodes);
+    free(scene);
+}
+
+XW_DEF int xw_scene_add(xw_scene* scene, const xw_shape* shape)
+{
+    if (scene->nodes_len == scene->nodes_cap) {
+        const size_t cap       = scene->nodes_cap == 0 ? 64 : scene->nodes_cap * 2;
+        _xw_scene_node* nodes = (_xw_scene_node*)realloc(scene->nodes, cap * sizeof(*nodes));
+        if (nodes == NULL) {
+            fprintf(stderr, "ERROR: Buy more ram\n");
+            return -1;
+        }
+        scene->nodes     = nodes;
+        scene->nodes_cap = cap;
+    }
+    scene->nodes[scene->nodes_len] = (_xw_scene_node){.shape = *shape, .alive = true};
+    xw_scene_damage(scene, _xw_shape_bounds(shape));
+    if (scene->index != NULL) {
+        xw_hit_index_set(scene->index, scene->nodes_len, _xw_shape_bounds(shape));
+    }
+    return (int)scene->nodes_len++;
+}
+
+XW_DEF bool xw_scene_update(xw_scene* scene, int id, const xw_shape* shape)
+{
+    _xw_scene_node* node = _xw_scene_find(scene, id);
+    if (node == NULL) {
+        return false;
+    }
+    const xw_rect old_bounds = _xw_shape_bounds(&node->shape);
+    const xw_rect new_bounds = _xw_shape_bounds(shape);
+    node->shape              = *shape;
+    if (scene->index != NULL) {
+        xw_hit_index_set(scene->index, id, new_bounds);
+    }
+
+    // Small moves repaint one rectangle, far moves repaint two
+    const xw_rect both = _xw_rect_union(old_bounds, new_bounds);
+    if (_xw_rect_area(both) <= _xw_rect_area(old_bounds) + _xw_rect_area(new_bounds)) {
+        xw_scene_damage(scene, both);
+    } else {
+        xw_scene_damage(scene, old_bounds);
+        xw_scene_damage(scene, new_bounds);
+    }
+    return true;
+}
+
+XW_DEF bool xw_scene_move(xw_scene* scene, int id, int dx, int dy)
+{
+    _xw_scene_node* node = _xw_scene_find(scene, id);
+    if (node == NULL) {
+        return false;
+    }
+    xw_shape shape = node->shape;
+    switch (shape.type) {
+        case XW_SHAPE_RECTANGLE:
+            shape.rectangle.x += dx;
+            shape.rectangle.y += dy;
+            break;
+        case XW_SHAPE_CIRCLE:
+            shape.circle.x += dx;
+            shape.circle.y += dy;
+            break;
+        case XW_SHAPE_LINE:
+            shape.line.x0 += dx;
+            shape.line.y0 += dy;
+            shape.line.x1 += dx;
+            shape.line.y1 += dy;
+            break;
+        case XW_SHAPE_TRIANGLE:
+            shape.triangle.x0 += dx;
+            shape.triangle.y0 += dy;
+            shape.triangle.x1 += dx;
+            shape.triangle.y1 += dy;
+            shape.triangle.x2 += dx;
+            shape.triangle.y2 += dy;
+            break;
+    }
+    return xw_scene_update(scene, id, &shape);
+}
+
+XW_DEF bool xw_scene_remove(xw_scene* scene, int id)
+{
+    _xw_scene_node* node = _xw_scene_find(scene, id);
+    if (node == NULL) {
+        return false;
+    }
+    xw_scene_damage(scene, _xw_shape_bounds(&node->shape));
+    node->alive = false;
+    if (scene->index != NULL) {
+        xw_hit_index_remove(scene->index, id);
+    }
+    return true;
+}
+
+XW_DEF const xw_shape* xw_scene_get(const xw_scene* scene, int id)
+{
+    _xw_scene_node* node = _xw_scene_find(scene, id);
+    return node == NULL ? NULL : &node->shape;
+}
+
+XW_DEF void xw_scene_damage(xw_scene* scene, xw_rect rect)
+{
+    if (_xw_rect_empty(rect)) {
+        return;
+    }
+    // Merge into the overlapping rectangles, the result can overlap others so repeat
+    for (size_t i = 0; i < scene->damage_len;) {
+        if (_xw_rect_intersects(scene->damage[i], rect)) {
+            rect             = _xw_rect_union(scene->damage[i], rect);
+            scene->damage[i] = scene->damage[--scene->damage_len];
+            i                = 0;
+        } else {
+            i++;
+        }
+    }
+    if (scene->damage_len < XW_SCENE_MAX_DAMAGE) {
+        scene->damage[scene->damage_len++] = rect;
+        return;
+    }
+
+    // Out of slots, grow the rectangle that grows the least
+    size_t best         = 0;
+    uint64_t best_added = UINT64_MAX;
+    for (size_t i = 0; i < scene->damage_len; i++) {
+        const uint64_t added = _xw_rect_area(_xw_rect_union(scene->damage[i], rect)) -
+                               _xw_rect_area(scene->damage[i]);
+        if (added < best_added) {
+            best_added = added;
+            best       = i;
+        }
+    }
+    rect = _xw_rect_union(scene->damage[best], rect);
+    scene->damage[best] = scene->damage[--scene->damage_len];
+    xw_scene_damage(scene, rect);
+}
+
+XW_DEF bool xw_scene_draw(xw_scene* scene)
+{
+    xw_handle* handle = scene->handle;
+    _XW_CALL(handle);
+    // The area gained by a resize was never painted, the strips must not overlap or they merge
+    const unsigned int width  = handle->dimensions.width;
+    const unsigned int height = handle->dimensions.height;
+    if (width > scene->width) {
+        const xw_rect right = {
+            .x = (int)scene->width, .width = width - scene->width, .height = height};
+        xw_scene_damage(scene, right);
+    }
+    if (height > scene->height) {
+        const xw_rect bottom = {.y      = (int)scene->height,
+                                .width  = width < scene->width ? width : scene->width,
+                                .height = height - scene->height};
+        xw_scene_damage(scene, bottom);
+    }
+    scene->width  = width;
+    scene->height = height;
+    if (scene->damage_len == 0) {
+        return true;
+    }
+
+    // Cut to the window first, the X11 rectangles are 16 bits
+    const xw_rect window = {.width  = handle->dimensions.width,
+                            .height = handle->dimensions.height};
+    XRectangle clip[XW_SCENE_MAX_DAMAGE];
+    size_t len = 0;
+    for (size_t i = 0; i < scene->damage_len; i++) {
+        const xw_rect r = _xw_rect_intersection(scene->damage[i], window);
+        if (_xw_rect_empty(r)) {
+            continue;
+        }
+        scene->damage[len] = r;
+        clip[len++]        = (XRectangle){.x      = (short)r.x,
+                                          .y      = (short)r.y,
+                                          .width  = (unsigned short)r.width,
+                                          .height = (unsigned short)r.height};
+    }
+    scene->damage_len = len;
+    if (len == 0) {
+        return true;
+    }
+
+    XSetClipRectangles(handle->display, handle->gc, 0, 0, clip, len, Unsorted);
+    XSetForeground(handle->display, handle->gc, scene->background);
+    _XW_STAT_ADD(handle, requests[XW_STAT_RECTANGLE], 1);
+    XFillRectangles(handle->display, handle->window, handle->gc, clip, len);
+
+    for (size_t i = 0; i < scene->nodes_len; i++) {
+        const _xw_scene_node* node = &scene->nodes[i];
+        if (!node->alive) {
+            continue;
+        }
+        const xw_rect bounds = _xw_shape_bounds(&node->shape);
+        for (size_t j = 0; j < scene->damage_len; j++) {
+            if (_xw_rect_intersects(bounds, scene->damage[j])) {
+                _xw_shape_draw(handle, &node->shape);
+                break;
+            }
+        }
+    }
+
+    XSetClipMask(handle->display, handle->gc, None);
+    scene->damage_len = 0;
+    return _xw_auto_flush(handle);
+}
+
+/* Hit index */
+typedef struct {
+    int* ids;
+    uint32_t len;
+    uint32_t cap;
+} _xw_hit_cell;
+
+typedef struct {
+    xw_rect bounds;
+    int cx0, cy0, cx1, cy1; // Covered cells, inclusive
+    bool present;
+} _xw_hit_entry;
+
+struct _xw_hit_index {
+    int columns, rows;
+    int cell_size;
+    _xw_hit_cell* cells;
+
+    _xw_hit_entry* entries; // By id
+    size_t entries_cap;
+
+    bool (*contains)(void* user, int id, int x, int y);
+    void* user;
+
+    int hovered;
+};
+
+XW_DEF xw_hit_index* xw_hit_index_create(unsigned int width, unsigned int height,
+                                         unsigned int cell_size)
+{
+    if (cell_size == 0) {
+        fprintf(stderr, "ERROR: cell size must be positive\n");
+        return NULL;
+    }
+    xw_hit_index* index = (xw_hit_index*)calloc(1, sizeof(xw_hit_index));
+    if (index == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        return NULL;
+    }
+    index->cell_size = cell_size;
+    index->columns   = (width + cell_size - 1) / cell_size;
+    index->rows      = (height + cell_size - 1) / cell_size;
+    index->columns   = index->columns < 1 ? 1 : index->columns;
+    index->rows      = index->rows < 1 ? 1 : index->rows;
+    index->hovered   = -1;
+    index->cells = (_xw_hit_cell*)calloc((size_t)index->columns * index->rows, sizeof(_xw_hit_cell));
+    if (index->cells == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        free(index);
+        return NULL;
+    }
+    return index;
+}
+
+XW_DEF void xw_hit_index_free(xw_hit_index* index)
+{
+    for (size_t i = 0; i < (size_t)index->columns * index->rows; i++) {
+        free(index->cells[i].ids);
+    }
+    free(index->cells);
+    free(index->entries);
+    free(index);
+}
+
+// Points outside of the grid belong to the border cells
+static inline int _xw_hit_column(const xw_hit_index* index, int x)
+{
+    const int c = x < 0 ? 0 : x / index->cell_size;
+    return c >= index->columns ? index->columns - 1 : c;
+}
+
+static inline int _xw_hit_row(const xw_hit_index* index, int y)
+{
+    const int r = y < 0 ? 0 : y / index->cell_size;
+    return r >= index->rows ? index->rows - 1 : r;
+}
+
+static bool _xw_hit_cell_push(_xw_hit_cell* cell, int id)
+{
+    if (cell->len == cell->cap) {
+        const uint32_t cap = cell->cap == 0 ? 4 : cell->cap * 2;
+        int* ids           = (int*)realloc(cell->ids, cap * sizeof(int));
+        if (ids == NULL) {
+            fprintf(stderr, "ERROR: Buy more ram\n");
+            return false;
+        }
+        cell->ids = ids;
+        cell->cap = cap;
+    }
+    cell->ids[cell->len++] = id;
+    return true;
+}
+
+static void _xw_hit_cell_erase(_xw_hit_cell* cell, int id)
+{
+    for (uint32_t i = 0; i < cell->len; i++) {
+        if (cell->ids[i] == id) {
+            cell->ids[i] = cell->ids[--cell->len];
+            return;
+        }
+    }
+}
+
+// Takes the region out of its cells, the hovered region stays for a move
+static void _xw_hit_index_erase(xw_hit_index* index, int id)
+{
+    _xw_hit_entry* entry = &index->entries[id];
+    for (int cy = entry->cy0; cy <= entry->cy1; cy++) {
+        for (int cx = entry->cx0; cx <= entry->cx1; cx++) {
+            _xw_hit_cell_erase(&index->cells[(size_t)cy * index->columns + cx], id);
+        }
+    }
+    entry->present = false;
+}
+
+XW_DEF bool xw_hit_index_remove(xw_hit_index* index, int id)
+{
+    if (id < 0 || (size_t)id >= index->entries_cap || !index->entries[id].present) {
+        fprintf(stderr, "ERROR: unknown region id %d\n", id);
+        return false;
+    }
+    _xw_hit_index_erase(index, id);
+    // Gone without a leave event
+    if (index->hovered == id) {
+        index->hovered = -1;
+    }
+    return true;
+}
+
+XW_DEF bool xw_hit_index_set(xw_hit_index* index, int id, xw_rect bounds)
+{
+    if (id < 0) {
+        fprintf(stderr, "ERROR: region id must not be negative\n");
+        return false;
+    }
+    if ((size_t)id >= index->entries_cap) {
+        size_t cap = index->entries_cap == 0 ? 64 : index->entries_cap;
+        while (cap <= (size_t)id) {
+            cap *= 2;
+        }
+        _xw_hit_entry* entries = (_xw_hit_entry*)realloc(index->entries, cap * sizeof(*entries));
+        if (entries == NULL) {
+            fprintf(stderr, "ERROR: Buy more ram\n");
+            return false;
+        }
+        memset(&entries[index->entries_cap], 0, (cap - index->entries_cap) * sizeof(*entries));
+        index->entries     = entries;
+        index->entries_cap = cap;
+    }
+
+    _xw_hit_entry* entry = &index->entries[id];
+    _xw_hit_entry next   = {.bounds = bounds, .present = true};
+    if (_xw_rect_empty(bounds)) {
+        // Kept, but cannot be hit
+        next.cx0 = next.cy0 = 0;
+        next.cx1 = next.cy1 = -1;
+    } else {
+        next.cx0 = _xw_hit_column(index, bounds.x);
+        next.cy0 = _xw_hit_row(index, bounds.y);
+        next.cx1 = _xw_hit_column(index, bounds.x + (int)bounds.width - 1);
+        next.cy1 = _xw_hit_row(index, bounds.y + (int)bounds.height - 1);
+    }
+
+    if (entry->present && entry->cx0 == next.cx0 && entry->cy0 == next.cy0 &&
+        entry->cx1 == next.cx1 && entry->cy1 == next.cy1) {
+        // Moved inside the same cells
+        entry->bounds = bounds;
+        return true;
+    }
+    if (entry->present) {
+        _xw_hit_index_erase(index, id);
+    }
+    for (int cy = next.cy0; cy <= next.cy1; cy++) {
+        for (int cx = next.cx0; cx <= next.cx1; cx++) {
+            if (!_xw_hit_cell_push(&index->cells[(size_t)cy * index->columns + cx], id)) {
+                // Erasing from cells that were not reached is harmless
+                *entry = next;
+                xw_hit_index_remove(index, id);
+                return false;
+            }
+        }
+    }
+    *entry = next;
+    return true;
+}
+
+XW_DEF void xw_hit_index_set_filter(xw_hit_index* index,
+                                    bool (*contains)(void* user, int id, int x, int y), void* user)
+{
+    index->contains = contains;
+    index->user     = user;
+}
+
+XW_DEF int xw_hit_index_query(const xw_hit_index* index, int x, int y)
+{
+    const _xw_hit_cell* cell =
+        &index->cells[(size_t)_xw_hit_row(index, y) * index->columns + _xw_hit_column(index, x)];
+    int top = -1;
+    for (uint32_t i = 0; i < cell->len; i++) {
+        const int id   = cell->ids[i];
+        const xw_rect b = index->entries[id].bounds;
+        if (id <= top || x < b.x || y < b.y || x >= b.x + (int)b.width ||
+            y >= b.y + (int)b.height) {
+            continue;
+        }
+        if (index->contains != NULL && !index->contains(index->user, id, x, y)) {
+            continue;
+        }
+        top = id;
+    }
+    return top;
+}
+
+XW_DEF int xw_hit_index_pointer(xw_hit_index* index, const xw_event* event, xw_event out[2])
+{
+    switch (event->type) {
+        case MotionNotify:
+        case ButtonPress:
+        case ButtonRelease:
+        case LeaveNotify:
+            break;
+        default:
+            return 0;
+    }
+
+    const int x  = event->mouse.x;
+    const int y  = event->mouse.y;
+    const int id = event->type == LeaveNotify ? -1 : xw_hit_index_query(index, x, y);
+    if (id == index->hovered) {
+        return 0;
+    }
+
+    int count = 0;
+    if (index->hovered >= 0) {
+        memset(&out[count], 0, sizeof(xw_event));
+        out[count++].shape =
+            (xw_shape_event){.type = XW_EVENT_SHAPE_LEAVE, .id = index->hovered, .x = x, .y = y};
+    }
+    if (id >= 0) {
+        memset(&out[count], 0, sizeof(xw_event));
+        out[count++].shape = (xw_shape_event){.type = XW_EVENT_SHAPE_ENTER, .id = id, .x = x, .y = y};
+    }
+    index->hovered = id;
+    return count;
+}
+
+static bool _xw_shape_contains(const xw_shape* shape, int x, int y)
+{
+    switch (shape->type) {
+        case XW_SHAPE_RECTANGLE:
+            return true; // The bounds are the rectangle
+        case XW_SHAPE_CIRCLE: {
+            const int64_t dx = x - shape->circle.x;
+            const int64_t dy = y - shape->circle.y;
+            return dx * dx + dy * dy <= (int64_t)shape->circle.r * shape->circle.r;
+        }
+        case XW_SHAPE_LINE: {
+            // Distance from the segment, compared squared
+            const double vx = shape->line.x1 - shape->line.x0;
+            const double vy = shape->line.y1 - shape->line.y0;
+            const double wx = x - shape->line.x0;
+            const double wy = y - shape->line.y0;
+            const double length = vx * vx + vy * vy;
+            double t            = length > 0 ? (wx * vx + wy * vy) / length : 0;
+            t                   = t < 0 ? 0 : t > 1 ? 1 : t;
+            const double dx     = wx - t * vx;
+            const double dy     = wy - t * vy;
+            const double reach  = shape->line.width / 2.0 + 1;
+            return dx * dx + dy * dy <= reach * reach;
+        }
+        case XW_SHAPE_TRIANGLE: {
+            const int64_t x0 = shape->triangle.x0, y0 = shape->triangle.y0;
+            const int64_t x1 = shape->triangle.x1, y1 = shape->triangle.y1;
+            const int64_t x2 = shape->triangle.x2, y2 = shape->triangle.y2;
+            const int64_t d0 = (x1 - x0) * (y - y0) - (y1 - y0) * (x - x0);
+            const int64_t d1 = (x2 - x1) * (y - y1) - (y2 - y1) * (x - x1);
+            const int64_t d2 = (x0 - x2) * (y - y2) - (y0 - y2) * (x - x2);
+            return (d0 >= 0 && d1 >= 0 && d2 >= 0) || (d0 <= 0 && d1 <= 0 && d2 <= 0);
+        }
+    }
+    return false;
+}
+
+static bool _xw_scene_contains(void* user, int id, int x, int y)
+{
+    const xw_scene* scene = (const xw_scene*)user;
+    return _xw_shape_contains(&scene->nodes[id].shape, x, y);
+}
+
+XW_DEF xw_hit_index* xw_scene_get_hit_index(xw_scene* scene)
+{
+    if (scene->index != NULL) {
+        return scene->index;
+    }
+    scene->index = xw_hit_index_create(scene->width, scene->height, 32);
+    if (scene->index == NULL) {
+        return NULL;
+    }
+    xw_hit_index_set_filter(scene->index, _xw_scene_contains, scene);
+    for (size_t i = 0; i < scene->nodes_len; i++) {
+        if (scene->nodes[i].alive &&
+            !xw_hit_index_set(scene->index, i, _xw_shape_bounds(&scene->nodes[i].shape))) {
+            xw_hit_index_free(scene->index);
+            scene->index = NULL;
+            return NULL;
+        }
+    }
+    return scene->index;
+}
+
+/* Blend */
+XW_DEF bool xw_render_available(xw_handle* handle)
+{
+#ifdef XWRAP_RENDER
+    return handle->picture != None;
+#else
+    (void)handle;
+    return false;
+#endif // XWRAP_RENDER
+}
+
+#ifdef XWRAP_RENDER
+// XRender colors are 16 bit and premultiplied
+static XRenderColor _xw_render_color(uint32_t color)
+{
+    const uint32_t a = color >> 24;
+    return (XRenderColor){
+        .red   = _xw_div255(((color >> 16) & 0xFF) * a) * 257,
+        .green = _xw_div255(((color >> 8) & 0xFF) * a) * 257,
+        .blue  = _xw_div255((color & 0xFF) * a) * 257,
+        .alpha = a * 257,
+    };
+}
+
+// Solid source picture, cached for runs of the same color
+static Picture _xw_render_fill(xw_handle* handle, uint32_t color)
+{
+    if (handle->fill != None && handle->fill_color == color) {
+        return handle->fill;
+    }
+    if (handle->fill != None) {
+        XRenderFreePicture(handle->display, handle->fill);
+    }
+    const XRenderColor value = _xw_render_color(color);
+    handle->fill             = XRenderCreateSolidFill(handle->display, &value);
+    handle->fill_color = color;
+    return handle->fill;
+}
+
+static inline XPointFixed _xw_point_fixed(double x, double y)
+{
+    return (XPointFixed){.x = XDoubleToFixed(x), .y = XDoubleToFixed(y)};
+}
+
+static int _xw_circle_segments(int r)
+{
+    const int segments = r * 2;
+    return segments < 16 ? 16 : segments > 256 ? 256 : segments;
+}
+
+// The math helpers avoid linking with libm
+static double _xw_sqrt(double x)
+{
+    if (x <= 0) {
+        return 0;
+    }
+    // Newton from above decreases until it converges
+    double r = x > 1 ? x : 1;
+    for (int i = 0; i < 128; i++) {
+        const double next = 0.5 * (r + x / r);
+        if (next >= r) {
+            break;
+        }
+        r = next;
+    }
+    return r;
+}
+
+// Taylor series, accurate for the small angles of a circle segment
+static void _xw_sin_cos(double angle, double* sin, double* cos)
+{
+    const double a2 = angle * angle;
+    double term_sin = angle, term_cos = 1;
+    *sin            = term_sin;
+    *cos            = term_cos;
+    for (int n = 1; n < 8; n++) {
+        term_sin *= -a2 / ((2 * n) * (2 * n + 1));
+        term_cos *= -a2 / ((2 * n - 1) * (2 * n));
+        *sin += term_sin;
+        *cos += term_cos;
+    }
+}
+#endif // XWRAP_RENDER
+
+XW_DEF bool xw_draw_rectangle_blend(xw_handle* handle, int x, int y, unsigned int width,
+                                    unsigned int height, bool fill, uint32_t color)
+{
+    _XW_CALL(handle);
+    if ((color >> 24) == 0) {
+        return true;
+    }
+#ifdef XWRAP_RENDER
+    if (handle->picture != None) {
+        _XW_STAT_ADD(handle, requests[XW_STAT_BLEND], 1);
+        const XRenderColor value = _xw_render_color(color);
+        if (fill) {
+            XRenderFillRectangle(handle->display, PictOpOver, handle->picture, &value, x, y, width,
+                                 height);
+            return true;
+        }
+        // Same pixels as 'XDrawRectangle', edges do not overlap so the alpha is even
+        XRenderFillRectangle(handle->display, PictOpOver, handle->picture, &value, x, y, width + 1,
+                             1);
+        XRenderFillRectangle(handle->display, PictOpOver, handle->picture, &value, x, y + height,
+                             width + 1, 1);
+        if (height > 1) {
+            XRenderFillRectangle(handle->display, PictOpOver, handle->picture, &value, x, y + 1, 1,
+                                 height - 1);
+            XRenderFillRectangle(handle->display, PictOpOver, handle->picture, &value, x + width,
+                                 y + 1, 1, height - 1);
+        }
+        return true;
+    }
+#endif // XWRAP_RENDER
+    return xw_draw_rectangle(handle, x, y, width, height, fill, color & 0xFFFFFF);
+}
+
+XW_DEF bool xw_draw_line_blend(xw_handle* handle, int x0, int y0, int x1, int y1, uint16_t width,
+                               uint32_t color)
+{
+    _XW_CALL(handle);
+    if ((color >> 24) == 0) {
+        return true;
+    }
+#ifdef XWRAP_RENDER
+    if (handle->picture != None) {
+        _XW_STAT_ADD(handle, requests[XW_STAT_BLEND], 1);
+        const double dx     = x1 - x0;
+        const double dy     = y1 - y0;
+        const double length = _xw_sqrt(dx * dx + dy * dy);
+        if (length == 0) {
+            return true;
+        }
+        // Offset to the edges of the line, like 'CapButt'
+        const double w  = width == 0 ? 1 : width;
+        const double nx = -dy / length * w / 2;
+        const double ny = dx / length * w / 2;
+
+        const XPointFixed strip[4] = {
+            _xw_point_fixed(x0 + nx, y0 + ny),
+            _xw_point_fixed(x0 - nx, y0 - ny),
+            _xw_point_fixed(x1 + nx, y1 + ny),
+            _xw_point_fixed(x1 - nx, y1 - ny),
+        };
+        XRenderCompositeTriStrip(handle->display, PictOpOver, _xw_render_fill(handle, color),
+                                 handle->picture, handle->mask_format, 0, 0, strip, 4);
+        return true;
+    }
+#endif // XWRAP_RENDER
+    return xw_draw_line(handle, x0, y0, x1, y1, width, color & 0xFFFFFF);
+}
+
+XW_DEF bool xw_draw_circle_blend(xw_handle* handle, int x, int y, int r, bool fill, uint32_t color)
+{
+    _XW_CALL(handle);
+    if ((color >> 24) == 0) {
+        return true;
+    }
+#ifdef XWRAP_RENDER
+    if (handle->picture != None) {
+        _XW_STAT_ADD(handle, requests[XW_STAT_BLEND], 1);
+        const int segments = _xw_circle_segments(r);
+        double step_sin, step_cos;
+        _xw_sin_cos(2 * 3.14159265358979323846 / segments, &step_sin, &step_cos);
+
+        XPointFixed points[2 * 256 + 2];
+        int npoints = 0;
+        double ux = 1, uy = 0; // Rotated by one segment each step
+        if (fill) {
+            points[npoints++] = _xw_point_fixed(x, y);
+            for (int i = 0; i <= segments; i++) {
+                points[npoints++] = _xw_point_fixed(x + r * ux, y + r * uy);
+                const double next = ux * step_cos - uy * step_sin;
+                uy                = ux * step_sin + uy * step_cos;
+                ux                = next;
+            }
+            XRenderCompositeTriFan(handle->display, PictOpOver, _xw_render_fill(handle, color),
+                                   handle->picture, handle->mask_format, 0, 0, points, npoints);
+            return true;
+        }
+        // One pixel wide ring
+        for (int i = 0; i <= segments; i++) {
+            points[npoints++] = _xw_point_fixed(x + (r + 0.5) * ux, y + (r + 0.5) * uy);
+            points[npoints++] = _xw_point_fixed(x + (r - 0.5) * ux, y + (r - 0.5) * uy);
+            const double next = ux * step_cos - uy * step_sin;
+            uy                = ux * step_sin + uy * step_cos;
+            ux                = next;
+        }
+        XRenderCompositeTriStrip(handle->display, PictOpOver, _xw_render_fill(handle, color),
+                                 handle->picture, handle->mask_format, 0, 0, points, npoints);
+        return true;
+    }
+#endif // XWRAP_RENDER
+    return xw_draw_circle(handle, x, y, r, fill, color & 0xFFFFFF);
+}
+
+XW_DEF bool xw_draw_triangle_blend(xw_handle* handle, int x0, int y0, int x1, int y1, int x2,
+                                   int y2, uint32_t color)
+{
+    _XW_CALL(handle);
+    if ((color >> 24) == 0) {
+        return true;
+    }
+#ifdef XWRAP_RENDER
+    if (handle->picture != None) {
+        _XW_STAT_ADD(handle, requests[XW_STAT_BLEND], 1);
+        const XTriangle triangle = {
+            .p1 = _xw_point_fixed(x0, y0),
+            .p2 = _xw_point_fixed(x1, y1),
+            .p3 = _xw_point_fixed(x2, y2),
+        };
+        XRenderCompositeTriangles(handle->display, PictOpOver, _xw_render_fill(handle, color),
+                                  handle->picture, handle->mask_format, 0, 0, &triangle, 1);
+        return true;
+    }
+#endif // XWRAP_RENDER
+    return xw_draw_triangle(handle, x0, y0, x1, y1, x2, y2, color & 0xFFFFFF);
+}
+
+XW_DEF bool xw_draw_image_blend(xw_handle* handle, uint32_t* buffer, uint16_t width,
+                                uint16_t height, int x, int y)
+{
+    _XW_CALL(handle);
+    Visual* visual = DefaultVisual(handle->display, DefaultScreen(handle->display));
+#ifdef XWRAP_RENDER
+    if (handle->picture != None) {
+        _XW_STAT_ADD(handle, requests[XW_STAT_BLEND], 1);
+        // The staging pixmap only grows
+        if (width > handle->blend_width || height > handle->blend_height) {
+            if (handle->blend_picture != None) {
+                XRenderFreePicture(handle->display, handle->blend_picture);
+                XFreeGC(handle->display, handle->blend_gc);
+                XFreePixmap(handle->display, handle->blend_pixmap);
+            }
+            handle->blend_width  = width > handle->blend_width ? width : handle->blend_width;
+            handle->blend_height = height > handle->blend_height ? height : handle->blend_height;
+            handle->blend_pixmap = XCreatePixmap(handle->display, handle->window,
+                                                 handle->blend_width, handle->blend_height, 32);
+            handle->blend_gc     = XCreateGC(handle->display, handle->blend_pixmap, 0, NULL);
+            handle->blend_picture = XRenderCreatePicture(
+                handle->display, handle->blend_pixmap,
+                XRenderFindStandardFormat(handle->display, PictStandardARGB32), 0, NULL);
+        }
+
+        XImage* image = XCreateImage(handle->display, visual, 32, ZPixmap, 0, (char*)buffer,
+                                     width, height, 32, 0);
+        if (image == NULL) {
+            fprintf(stderr, "ERROR: could not create image\n");
+            return false;
+        }
+        _XW_STAT_ADD(handle, requests[XW_STAT_IMAGE], 1);
+        _XW_STAT_ADD(handle, bytes_uploaded, (uint64_t)width * height * 4);
+        XPutImage(handle->display, handle->blend_pixmap, handle->blend_gc, image, 0, 0, 0, 0,
+                  width, height);
+        XFree(image); // The buffer is not owned by the image
+        XRenderComposite(handle->display, PictOpOver, handle->blend_picture, None,
+                         handle->picture, 0, 0, 0, 0, x, y, width, height);
+        return true;
+    }
+#endif // XWRAP_RENDER
+    XImage* image =
+        XCreateImage(handle->display, visual, 24, ZPixmap, 0, (char*)buffer, width, height, 32, 0);
+    if (image == NULL) {
+        fprintf(stderr, "ERROR: could not create image\n");
+        return false;
+    }
+    _XW_STAT_ADD(handle, requests[XW_STAT_IMAGE], 1);
+    _XW_STAT_ADD(handle, bytes_uploaded, (uint64_t)width * height * 4);
+    XPutImage(handle->display, handle->window, handle->gc, image, 0, 0, x, y, width, height);
+    XFree(image);
+    return true;
+}
+
+
+XW_DEF bool xw_present_enable(xw_handle* handle)
+{
+    _XW_CALL(handle);
+#ifdef XWRAP_PRESENT
+    if (handle->present_events != NULL) {
+        return true;
+    }
+    if (handle->image == NULL) {
+        fprintf(stderr, "ERROR: connect an image before enabling present\n");
+        return false;
+    }
+    if (handle->xcb == NULL
+#ifdef XWRAP_AUTO_LINK
+        || !_xw_d_link_extension(&dl_present)
+#endif // XWRAP_AUTO_LINK
+    ) {
+        fprintf(stderr, "WARNING: could not link with xcb-present, using 'xw_draw'\n");
+        return false;
+    }
+    const xcb_query_extension_reply_t* extension =
+        xcb_get_extension_data(handle->xcb, _XW_PRESENT_ID);
+    if (extension == NULL || !extension->present) {
+        fprintf(stderr, "WARNING: Present is missing, using 'xw_draw'\n");
+        return false;
+    }
+
+    handle->present_eid = xcb_generate_id(handle->xcb);
+    xcb_present_select_input(handle->xcb, handle->present_eid, handle->window,
+                             XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY |
+                                 XCB_PRESENT_EVENT_MASK_IDLE_NOTIFY);
+    handle->present_events =
+        xcb_register_for_special_xge(handle->xcb, _XW_PRESENT_ID, handle->present_eid, NULL);
+    for (int i = 0; i < 2; i++) {
+        handle->present_pixmaps[i] =
+            XCreatePixmap(handle->display, handle->window, handle->width, handle->height, 24);
+        handle->present_busy[i] = false;
+    }
+    handle->present_serial = 0;
+    return true;
+#else
+    fprintf(stderr, "WARNING: compiled without XWRAP_PRESENT, using 'xw_draw'\n");
+    return false;
+#endif // XWRAP_PRESENT
+}
+
+XW_DEF bool xw_present(xw_handle* handle, uint64_t target_msc, uint32_t* serial)
+{
+    _XW_CALL(handle);
+#ifdef XWRAP_PRESENT
+    if (handle->present_events != NULL) {
+        _XW_CLOCK(start);
+        _XW_STAT_FRAME(handle, start);
+        _XW_TRACE_FRAME(handle);
+        const uint64_t overlay_start = handle->overlay != NULL ? _xw_now_ns() : 0;
+        // The server may still read the last two frames
+        _xw_present_poll(handle, false);
+        while (handle->present_busy[0] && handle->present_busy[1]) {
+            _xw_present_poll(handle, true);
+        }
+        const int i = handle->present_busy[0] ? 1 : 0;
+
+        _xw_put_image(handle, handle->present_pixmaps[i],
+                      (xw_rect){.width = handle->width, .height = handle->height}, 0, 0);
+#ifdef XWRAP_RECORD
+        if (handle->recorder != NULL) {
+            _xw_record_frame(handle);
+        }
+#endif // XWRAP_RECORD
+        if (handle->overlay != NULL) {
+            _xw_overlay_draw(handle, handle->present_pixmaps[i], overlay_start, _xw_now_ns());
+        }
+        handle->present_busy[i] = true;
+        handle->present_serial++;
+        xcb_present_pixmap(handle->xcb, handle->window, handle->present_pixmaps[i],
+                           handle->present_serial, 0, 0, 0, 0, 0, 0, 0, 0, target_msc, 0, 0, 0,
+                           NULL);
+        if (serial != NULL) {
+            *serial = handle->present_serial;
+        }
+        _XW_STAT_ADD(handle, flushes, 1);
+        xcb_flush(handle->xcb);
+        _XW_STAT_TIME(handle, draw_ns, start);
+        _XW_TRACE("xw_present", start, handle);
+        return true;
+    }
+#else
+    (void)target_msc;
+#endif // XWRAP_PRESENT
+    if (serial != NULL) {
+        *serial = 0;
+    }
+    return xw_draw(handle);
+}
+
+/* Shared framebuffer */
+#define XW_SHARED_MAGIC 0x48535758u // "XWSH"
+#define XW_SHARED_PIXELS 4096       // Offset of the pixels, a page keeps them aligned
+
+typedef struct {
+    uint32_t magic;
+    uint16_t width, height;
+    uint32_t state; // Futex, 0 while the producer writes, 1 while the consumer reads
+    uint32_t pad0;
+    uint64_t frames;
+} _xw_shared_header;
+
+struct _xw_shared {
+    int fd;
+    size_t size;
+    _xw_shared_header* header;
+    uint32_t* pixels;
+};
+
+static xw_shared* _xw_shared_map(int fd, size_t size)
+{
+    xw_shared* shared = (xw_shared*)malloc(sizeof(xw_shared));
+    if (shared == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        return NULL;
+    }
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        fprintf(stderr, "ERROR: could not map the shared framebuffer\n");
+        free(shared);
+        return NULL;
+    }
+    shared->fd     = fd;
+    shared->size   = size;
+    shared->header = (_xw_shared_header*)memory;
+    shared->pixels = (uint32_t*)((char*)memory + XW_SHARED_PIXELS);
+    return shared;
+}
+
+// Waits until 'state' is 'want', 0 timeout waits forever
+static bool _xw_shared_wait(xw_shared* shared, uint32_t want, uint64_t timeout)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000000u;
+    deadline.tv_nsec += (timeout % 1000000u) * 1000;
+
+    uint32_t* state = &shared->header->state;
+    for (;;) {
+        const uint32_t current = __atomic_load_n(state, __ATOMIC_ACQUIRE);
+        if (current == want) {
+            return true;
+        }
+        struct timespec left = {0};
+        if (timeout != 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            int64_t ns = (int64_t)(deadline.tv_sec - now.tv_sec) * 1000000000 +
+                         (deadline.tv_nsec - now.tv_nsec);
+            if (ns <= 0) {
+                return false;
+            }
+            left.tv_sec  = ns / 1000000000;
+            left.tv_nsec = ns % 1000000000;
+        }
+        // Not private, the other side is another process
+        if (syscall(SYS_futex, state, FUTEX_WAIT, current, timeout != 0 ? &left : NULL, NULL,
+                    0) == -1 &&
+            errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+            fprintf(stderr, "ERROR: could not wait for the shared framebuffer\n");
+            return false;
+        }
+    }
+}
+
+static void _xw_shared_set(xw_shared* shared, uint32_t state)
+{
+    __atomic_store_n(&shared->header->state, state, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &shared->header->state, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+XW_DEF xw_shared* xw_shared_create(uint16_t width, uint16_t height)
+{
+    const int fd = syscall(SYS_memfd_create, "xwrap", 0);
+    if (fd == -1) {
+        fprintf(stderr, "ERROR: could not create the shared framebuffer\n");
+        return NULL;
+    }
+    const size_t size = XW_SHARED_PIXELS + (size_t)width * height * sizeof(uint32_t);
+    if (ftruncate(fd, size) == -1) {
+        fprintf(stderr, "ERROR: could not size the shared framebuffer\n");
+        close(fd);
+        return NULL;
+    }
+    xw_shared* shared = _xw_shared_map(fd, size);
+    if (shared == NULL) {
+        close(fd);
+        return NULL;
+    }
+    shared->header->width  = width;
+    shared->header->height = height;
+    shared->header->state  = 0;
+    shared->header->frames = 0;
+    __atomic_store_n(&shared->header->magic, XW_SHARED_MAGIC, __ATOMIC_RELEASE);
+    return shared;
+}
+
+XW_DEF xw_shared* xw_shared_open(int fd)
+{
+    const off_t size = lseek(fd, 0, SEEK_END);
+    if (size < (off_t)XW_SHARED_PIXELS) {
+        fprintf(stderr, "ERROR: not a shared framebuffer\n");
+        return NULL;
+    }
+    xw_shared* shared = _xw_shared_map(fd, size);
+    if (shared == NULL) {
+        return NULL;
+    }
+    const _xw_shared_header* header = shared->header;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != XW_SHARED_MAGIC ||
+        XW_SHARED_PIXELS + (size_t)header->width * header->height * sizeof(uint32_t) >
+            (size_t)size) {
+        fprintf(stderr, "ERROR: not a shared framebuffer\n");
+        munmap(shared->header, shared->size);
+        free(shared);
+        return NULL;
+    }
+    return shared;
+}
+
+XW_DEF void xw_shared_free(xw_shared* shared)
+{
+    munmap(shared->header, shared->size);
+    close(shared->fd);
+    free(shared);
+}
+
+XW_DEF int xw_shared_fd(xw_shared* shared)
+{
+    return shared->fd;
+}
+
+XW_DEF uint32_t* xw_shared_pixels(xw_shared* shared, uint16_t* width, uint16_t* height)
+{
+    if (width != NULL) {
+        *width = shared->header->width;
+    }
+    if (height != NULL) {
+        *height = shared->header->height;
+    }
+    return shared->pixels;
+}
+
+XW_DEF bool xw_image_connect_shared(xw_handle* handle, xw_shared* shared)
+{
+    _XW_CALL(handle);
+    if (!xw_image_connect(handle, shared->pixels, shared->header->width,
+                          shared->header->height)) {
+        return false;
+    }
+#ifdef XWRAP_SHM
+    // 'attach_fd' is MIT-SHM 1.2, older servers only take SysV segments
+    xcb_shm_query_version_reply_t* version = NULL;
+    if (handle->xcb != NULL
+#ifdef XWRAP_AUTO_LINK
+        && _xw_d_link_extension(&dl_shm)
+#endif // XWRAP_AUTO_LINK
+    ) {
+        const xcb_query_extension_reply_t* extension =
+            xcb_get_extension_data(handle->xcb, _XW_SHM_ID);
+        if (extension != NULL && extension->present) {
+            version = xcb_shm_query_version_reply(handle->xcb, xcb_shm_query_version(handle->xcb),
+                                                  NULL);
+        }
+    }
+    if (version == NULL || version->major_version < 1 ||
+        (version->major_version == 1 && version->minor_version < 2)) {
+        fprintf(stderr, "WARNING: MIT-SHM is missing, using 'XPutImage'\n");
+        free(version);
+        return true;
+    }
+    free(version);
+
+    // XCB closes the descriptor it sends
+    const int fd = dup(shared->fd);
+    if (fd == -1) {
+        fprintf(stderr, "WARNING: could not share the framebuffer, using 'XPutImage'\n");
+        return true;
+    }
+    // The server may refuse the descriptor (e.g. a remote display), check it once here
+    const xcb_shm_seg_t seg    = xcb_generate_id(handle->xcb);
+    xcb_generic_error_t* error =
+        xcb_request_check(handle->xcb, xcb_shm_attach_fd_checked(handle->xcb, seg, fd, true));
+    if (error != NULL) {
+        fprintf(stderr, "WARNING: could not share the framebuffer, using 'XPutImage'\n");
+        free(error);
+        return true;
+    }
+    handle->shm_seg    = seg;
+    handle->shm_offset = XW_SHARED_PIXELS;
+#endif // XWRAP_SHM
+    return true;
+}
+
+XW_DEF bool xw_shared_submit(xw_shared* shared)
+{
+    __atomic_add_fetch(&shared->header->frames, 1, __ATOMIC_RELAXED);
+    _xw_shared_set(shared, 1);
+    return true;
+}
+
+XW_DEF bool xw_shared_wait_ready(xw_shared* shared, uint64_t timeout)
+{
+    return _xw_shared_wait(shared, 1, timeout);
+}
+
+XW_DEF bool xw_shared_release(xw_handle* handle, xw_shared* shared)
+{
+    // The server may read the pixels after 'xw_draw' returns
+    if (handle != NULL) {
+        XSync(handle->display, false);
+    }
+    _xw_shared_set(shared, 0);
+    return true;
+}
+
+XW_DEF bool xw_shared_wait_consumed(xw_shared* shared, uint64_t timeout)
+{
+    return _xw_shared_wait(shared, 0, timeout);
+}
+
+/* Recorder */
+#ifdef XWRAP_RECORD
+#define XW_RECORD_RING 8
+
+typedef struct {
+    uint32_t* pixels;
+    uint64_t time_us;
+} _xw_record_slot;
+
+struct _xw_recorder {
+    FILE* file;
+    xw_record_format format;
+    uint16_t width, height;
+    struct timespec start;
+
+    // Filled by the drawing thread at 'head', emptied by the writer at 'tail'
+    _xw_record_slot* ring;
+    unsigned int ring_len;
+    unsigned int head, tail, count;
+    uint64_t dropped;
+    bool stop, failed;
+
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_t writer;
+};
+
+// BT.601 limited range, same rounding as the SSE2 path
+static inline uint8_t _xw_luma(uint32_t p)
+{
+    const int b = p & 0xFF, g = (p >> 8) & 0xFF, r = (p >> 16) & 0xFF;
+    return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+static inline uint8_t _xw_avg8(int a, int b)
+{
+    return (a + b + 1) >> 1;
+}
+
+// The average of a 2x2 block, vertical first like '_mm_avg_epu8'
+static inline void _xw_chroma(uint32_t p0, uint32_t p1, uint32_t q0, uint32_t q1, uint8_t* u,
+                              uint8_t* v)
+{
+    int c[3];
+    for (int i = 0; i < 3; i++) {
+        const int shift = 8 * i;
+        c[i] = _xw_avg8(_xw_avg8((p0 >> shift) & 0xFF, (q0 >> shift) & 0xFF),
+                        _xw_avg8((p1 >> shift) & 0xFF, (q1 >> shift) & 0xFF));
+    }
+    *u = ((-38 * c[2] - 74 * c[1] + 112 * c[0] + 128) >> 8) + 128;
+    *v = ((112 * c[2] - 94 * c[1] - 18 * c[0] + 128) >> 8) + 128;
+}
+
+#if defined(__SSE2__)
+// The dot product of 4 BGRX pixels with (b, g, r, 0) coefficients as int32
+static inline __m128i _xw_dot4(__m128i px, __m128i coef)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 lo    = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(px, zero), coef));
+    const __m128 hi    = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(px, zero), coef));
+    return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0))),
+                         _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+static inline __m128i _xw_scale4(__m128i dot, __m128i offset)
+{
+    return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(dot, _mm_set1_epi32(128)), 8), offset);
+}
+#endif // __SSE2__
+
+static void _xw_bgrx_to_i420(const uint32_t* src, int width, int height, uint8_t* y_plane,
+                             uint8_t* u_plane, uint8_t* v_plane)
+{
+    const int chroma_width = (width + 1) / 2;
+    for (int y = 0; y < height; y++) {
+        const uint32_t* row = src + (size_t)y * width;
+        uint8_t* out        = y_plane + (size_t)y * width;
+        int x               = 0;
+#if defined(__SSE2__)
+        const __m128i coef   = _mm_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0);
+        const __m128i offset = _mm_set1_epi32(16);
+        for (; x + 16 <= width; x += 16) {
+            __m128i l[4];
+            for (int i = 0; i < 4; i++) {
+                l[i] = _xw_scale4(_xw_dot4(_mm_loadu_si128((const __m128i*)(row + x + 4 * i)), coef),
+                                  offset);
+            }
+            _mm_storeu_si128((__m128i*)(out + x),
+                             _mm_packus_epi16(_mm_packs_epi32(l[0], l[1]),
+                                              _mm_packs_epi32(l[2], l[3])));
+        }
+#endif // __SSE2__
+        for (; x < width; x++) {
+            out[x] = _xw_luma(row[x]);
+        }
+    }
+
+    for (int y = 0; y < height; y += 2) {
+        const uint32_t* row0 = src + (size_t)y * width;
+        const uint32_t* row1 = y + 1 < height ? row0 + width : row0;
+        uint8_t* u           = u_plane + (size_t)(y / 2) * chroma_width;
+        uint8_t* v           = v_plane + (size_t)(y / 2) * chroma_width;
+        int x                = 0;
+#if defined(__SSE2__)
+        const __m128i u_coef = _mm_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0);
+        const __m128i v_coef = _mm_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0);
+        const __m128i offset = _mm_set1_epi32(128);
+        for (; x + 8 <= width; x += 8) {
+            __m128i h[2];
+            for (int i = 0; i < 2; i++) {
+                const __m128i a = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(row0 + x + 4 * i)),
+                                               _mm_loadu_si128((const __m128i*)(row1 + x + 4 * i)));
+                h[i]            = _mm_avg_epu8(a, _mm_srli_si128(a, 4));
+            }
+            // The even pixels hold the 2x2 averages
+            const __m128i px = _mm_castps_si128(_mm_shuffle_ps(
+                _mm_castsi128_ps(h[0]), _mm_castsi128_ps(h[1]), _MM_SHUFFLE(2, 0, 2, 0)));
+            const __m128i u4 = _xw_scale4(_xw_dot4(px, u_coef), offset);
+            const __m128i v4 = _xw_scale4(_xw_dot4(px, v_coef), offset);
+            const __m128i uv = _mm_packus_epi16(_mm_packs_epi32(u4, v4), _mm_setzero_si128());
+            const uint32_t packed_u = _mm_cvtsi128_si32(uv);
+            const uint32_t packed_v = _mm_cvtsi128_si32(_mm_srli_si128(uv, 4));
+            memcpy(u + x / 2, &packed_u, 4);
+            memcpy(v + x / 2, &packed_v, 4);
+        }
+#endif // __SSE2__
+        for (; x < width; x += 2) {
+            const int next = x + 1 < width ? x + 1 : x;
+            _xw_chroma(row0[x], row0[next], row1[x], row1[next], &u[x / 2], &v[x / 2]);
+        }
+    }
+}
+
+static void* _xw_record_writer(void* arg)
+{
+    struct _xw_recorder* rec = arg;
+    const size_t pixels      = (size_t)rec->width * rec->height;
+    const size_t chroma      = (size_t)((rec->width + 1) / 2) * ((rec->height + 1) / 2);
+    uint8_t* yuv             = NULL;
+    if (rec->format == XW_RECORD_Y4M) {
+        yuv = malloc(pixels + 2 * chroma);
+        if (yuv == NULL) {
+            fprintf(stderr, "ERROR: Buy more ram\n");
+            rec->failed = true;
+        }
+    }
+
+    pthread_mutex_lock(&rec->lock);
+    for (;;) {
+        while (rec->count == 0 && !rec->stop) {
+            pthread_cond_wait(&rec->ready, &rec->lock);
+        }
+        if (rec->count == 0) {
+            break;
+        }
+        _xw_record_slot* slot = &rec->ring[rec->tail];
+        pthread_mutex_unlock(&rec->lock);
+
+        // The slot stays ours until 'tail' moves
+        if (!rec->failed) {
+            bool ok = true;
+            if (rec->format == XW_RECORD_Y4M) {
+                _xw_bgrx_to_i420(slot->pixels, rec->width, rec->height, yuv, yuv + pixels,
+                                 yuv + pixels + chroma);
+                ok = fprintf(rec->file, "FRAME Xus=%llu\n", (unsigned long long)slot->time_us) > 0 &&
+                     fwrite(yuv, 1, pixels + 2 * chroma, rec->file) == pixels + 2 * chroma;
+            } else {
+                ok = fwrite(&slot->time_us, sizeof(slot->time_us), 1, rec->file) == 1 &&
+                     fwrite(slot->pixels, sizeof(uint32_t), pixels, rec->file) == pixels;
+            }
+            if (!ok) {
+                fprintf(stderr, "ERROR: Could not write the recording\n");
+                rec->failed = true;
+            }
+        }
+
+        pthread_mutex_lock(&rec->lock);
+        rec->tail = (rec->tail + 1) % rec->ring_len;
+        rec->count--;
+    }
+    pthread_mutex_unlock(&rec->lock);
+    free(yuv);
+    return NULL;
+}
+
+static void _xw_record_free(struct _xw_recorder* rec)
+{
+    if (rec->ring != NULL) {
+        for (unsigned int i = 0; i < rec->ring_len; i++) {
+            free(rec->ring[i].pixels);
+        }
+        free(rec->ring);
+    }
+    free(rec);
+}
+
+// Never blocks on the writer, a full ring drops the frame
+static void _xw_record_frame(xw_handle* handle)
+{
+    struct _xw_recorder* rec = handle->recorder;
+    pthread_mutex_lock(&rec->lock);
+    const bool full = rec->count == rec->ring_len;
+    if (full || handle->width != rec->width || handle->height != rec->height) {
+        rec->dropped++;
+        pthread_mutex_unlock(&rec->lock);
+        return;
+    }
+    _xw_record_slot* slot = &rec->ring[rec->head];
+    pthread_mutex_unlock(&rec->lock);
+
+    // The writer does not touch the slot until it is counted
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    slot->time_us = (uint64_t)(now.tv_sec - rec->start.tv_sec) * 1000000u +
+                    (now.tv_nsec - rec->start.tv_nsec) / 1000;
+    for (int y = 0; y < rec->height; y++) {
+        memcpy(slot->pixels + (size_t)y * rec->width, handle->buffer + (size_t)y * handle->stride,
+               rec->width * sizeof(uint32_t));
+    }
+
+    pthread_mutex_lock(&rec->lock);
+    rec->head = (rec->head + 1) % rec->ring_len;
+    rec->count++;
+    pthread_cond_signal(&rec->ready);
+    pthread_mutex_unlock(&rec->lock);
+}
+#endif // XWRAP_RECORD
+
+XW_DEF bool xw_record_start(xw_handle* handle, const char* path, xw_record_format format,
+                            unsigned int fps, unsigned int ring_frames)
+{
+#ifdef XWRAP_RECORD
+    if (handle->recorder != NULL) {
+        fprintf(stderr, "ERROR: Already recording\n");
+        return false;
+    }
+    if (handle->buffer == NULL) {
+        fprintf(stderr, "ERROR: Connect an image before recording\n");
+        return false;
+    }
+
+    struct _xw_recorder* rec = calloc(1, sizeof(*rec));
+    if (rec == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        return false;
+    }
+    rec->format   = format;
+    rec->width    = handle->width;
+    rec->height   = handle->height;
+    rec->ring_len = ring_frames > 0 ? ring_frames : XW_RECORD_RING;
+    rec->ring     = calloc(rec->ring_len, sizeof(*rec->ring));
+    if (rec->ring == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        _xw_record_free(rec);
+        return false;
+    }
+    // Allocated up front, so drawing never waits for malloc
+    for (unsigned int i = 0; i < rec->ring_len; i++) {
+        rec->ring[i].pixels = malloc((size_t)rec->width * rec->height * sizeof(uint32_t));
+        if (rec->ring[i].pixels == NULL) {
+            fprintf(stderr, "ERROR: Buy more ram\n");
+            _xw_record_free(rec);
+            return false;
+        }
+    }
+
+    rec->file = fopen(path, "wb");
+    if (rec->file == NULL) {
+        fprintf(stderr, "ERROR: Could not open '%s'\n", path);
+        _xw_record_free(rec);
+        return false;
+    }
+    if (format == XW_RECORD_Y4M) {
+        fprintf(rec->file, "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+                rec->width, rec->height, fps > 0 ? fps : 1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &rec->start);
+
+    pthread_mutex_init(&rec->lock, NULL);
+    pthread_cond_init(&rec->ready, NULL);
+    if (pthread_create(&rec->writer, NULL, _xw_record_writer, rec) != 0) {
+        fprintf(stderr, "ERROR: Could not start the recording thread\n");
+        pthread_cond_destroy(&rec->ready);
+        pthread_mutex_destroy(&rec->lock);
+        fclose(rec->file);
+        _xw_record_free(rec);
+        return false;
+    }
+    handle->recorder = rec;
+    return true;
+#else
+    (void)handle;
+    (void)path;
+    (void)format;
+    (void)fps;
+    (void)ring_frames;
+    fprintf(stderr, "ERROR: compiled without XWRAP_RECORD\n");
+    return false;
+#endif // XWRAP_RECORD
+}
+
+XW_DEF bool xw_record_stop(xw_handle* handle, uint64_t* dropped)
+{
+#ifdef XWRAP_RECORD
+    struct _xw_recorder* rec = handle->recorder;
+    if (rec == NULL) {
+        if (dropped != NULL) {
+            *dropped = 0;
+        }
+        return false;
+    }
+    handle->recorder = NULL;
+
+    pthread_mutex_lock(&rec->lock);
+    rec->stop = true;
+    pthread_cond_signal(&rec->ready);
+    pthread_mutex_unlock(&rec->lock);
+    pthread_join(rec->writer, NULL);
+
+    bool ok = !rec->failed;
+    if (fclose(rec->file) != 0) {
+        fprintf(stderr, "ERROR: Could not write the recording\n");
+        ok = false;
+    }
+    if (dropped != NULL) {
+        *dropped = rec->dropped;
+    }
+    pthread_cond_destroy(&rec->ready);
+    pthread_mutex_destroy(&rec->lock);
+    _xw_record_free(rec);
+    return ok;
+#else
+    (void)handle;
+    if (dropped != NULL) {
+        *dropped = 0;
+    }
+    return false;
+#endif // XWRAP_RECORD
+}
+
+XW_DEF uint64_t xw_record_dropped(xw_handle* handle)
+{
+#ifdef XWRAP_RECORD
+    if (handle->recorder != NULL) {
+        pthread_mutex_lock(&handle->recorder->lock);
+        const uint64_t dropped = handle->recorder->dropped;
+        pthread_mutex_unlock(&handle->recorder->lock);
+        return dropped;
+    }
+#else
+    (void)handle;
+#endif // XWRAP_RECORD
+    return 0;
+}
+
+/* Stats */
+XW_DEF xw_stats xw_get_stats(xw_handle* handle)
+{
+#ifdef XWRAP_STATS
+    xw_stats stats = handle->stats;
+    stats.free_ns  = _xw_free_ns;
+#ifdef XWRAP_AUTO_LINK
+    stats.link_ns = _xw_link_ns;
+#endif // XWRAP_AUTO_LINK
+    return stats;
+#else
+    (void)handle;
+    xw_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    return stats;
+#endif // XWRAP_STATS
+}
+
+XW_DEF void xw_reset_stats(xw_handle* handle)
+{
+#ifdef XWRAP_STATS
+    const uint64_t create_ns = handle->stats.create_ns;
+    memset(&handle->stats, 0, sizeof(handle->stats));
+    handle->stats.create_ns = create_ns;
+    handle->last_frame_ns   = 0;
+#else
+    (void)handle;
+#endif // XWRAP_STATS
+}
+
+XW_DEF uint64_t xw_stats_frame_percentile(const xw_stats* stats, double percentile)
+{
+    if (stats->frames == 0) {
+        return 0;
+    }
+    const double rank = stats->frames * percentile / 100;
+    uint64_t seen     = 0;
+    for (unsigned int i = 0; i < XW_STATS_BUCKETS; i++) {
+        seen += stats->frame_histogram[i];
+        if (seen >= rank && seen > 0) {
+            // The upper bound of the bucket, clamped to what was seen
+            uint64_t upper = i < 4 ? i : ((uint64_t)(4 + (i & 3) + 1) << (i / 4 - 1)) - 1;
+            upper          = upper > stats->frame_max_us ? stats->frame_max_us : upper;
+            return upper < stats->frame_min_us ? stats->frame_min_us : upper;
+        }
+    }
+    return stats->frame_max_us;
+}
+
+XW_DEF size_t xw_get_errors(xw_handle* handle, xw_error* errors, size_t max)
+{
+    size_t count = 0;
+    while (count < max && handle->errors_len > 0) {
+        errors[count++]     = handle->errors[handle->errors_head];
+        handle->errors_head = (handle->errors_head + 1) % XW_ERROR_RING;
+        handle->errors_len--;
+    }
+    return count;
+}
+
+XW_DEF uint64_t xw_errors_lost(xw_handle* handle)
+{
+    return handle->errors_lost;
+}
+
+XW_DEF void xw_error_text(xw_handle* handle, const xw_error* error, char* buffer, int length)
+{
+    char text[128];
+    XGetErrorText(handle->display, error->error_code, text, sizeof(text));
+    snprintf(buffer, length, "%s in '%s' (request %u.%u, serial %lu, resource 0x%lx)", text,
+             error->call[0] != '\0' ? error->call : "?", error->request_code, error->minor_code,
+             error->serial, error->resource);
+}
+
+/* Overlay */
+static inline unsigned short _xw_overlay_bar(uint32_t us)
+{
+    return (us >= XW_OVERLAY_SCALE_US ? XW_OVERLAY_SCALE_US : us) * XW_OVERLAY_HEIGHT /
+           XW_OVERLAY_SCALE_US;
+}
+
+// Measures the frame then draws the graph, 'start' to 'uploaded' is the image upload
+static void _xw_overlay_draw(xw_handle* handle, Drawable drawable, uint64_t start,
+                             uint64_t uploaded)
+{
+    struct _xw_overlay* overlay = handle->overlay;
+    if (overlay->last_frame_ns != 0) {
+        const size_t i        = overlay->next;
+        overlay->frame_us[i]  = (start - overlay->last_frame_ns) / 1000;
+        overlay->upload_us[i] = (uploaded - start) / 1000;
+        overlay->events[i]    = overlay->frame_events;
+        overlay->next         = (i + 1) % XW_OVERLAY_SAMPLES;
+        overlay->len += overlay->len < XW_OVERLAY_SAMPLES;
+    }
+    overlay->last_frame_ns = start;
+    overlay->frame_events  = 0;
+
+    const short x0   = 8, y0 = 8;                    // Of the panel
+    const short base = y0 + 4 + XW_OVERLAY_HEIGHT; // Of the bars
+    XRectangle slow[XW_OVERLAY_SAMPLES], fast[XW_OVERLAY_SAMPLES], upload[XW_OVERLAY_SAMPLES];
+    int slow_len = 0, fast_len = 0, upload_len = 0;
+    uint64_t frame_sum = 0, upload_sum = 0, events_sum = 0;
+    for (size_t n = 0; n < overlay->len; n++) {
+        // Oldest on the left
+        const size_t i =
+            (overlay->next + XW_OVERLAY_SAMPLES - overlay->len + n) % XW_OVERLAY_SAMPLES;
+        const short x             = x0 + 4 + (XW_OVERLAY_SAMPLES - overlay->len) + n;
+        const unsigned short high = _xw_overlay_bar(overlay->frame_us[i]);
+        const unsigned short low  = _xw_overlay_bar(overlay->upload_us[i]);
+        const XRectangle bar      = {.x = x, .y = base - high, .width = 1, .height = high};
+        if (overlay->frame_us[i] > XW_OVERLAY_BUDGET_US) {
+            slow[slow_len++] = bar;
+        } else {
+            fast[fast_len++] = bar;
+        }
+        if (low > 0) {
+            upload[upload_len++] = (XRectangle){.x = x, .y = base - low, .width = 1, .height = low};
+        }
+        frame_sum += overlay->frame_us[i];
+        upload_sum += overlay->upload_us[i];
+        events_sum += overlay->events[i];
+    }
+
+    char text[96];
+    const double frames = overlay->len > 0 ? overlay->len : 1;
+    const int length =
+        snprintf(text, sizeof(text), "%.1f fps %.2f ms up %.2f ms ev %.1f ov %u us",
+                 frame_sum > 0 ? 1e6 * overlay->len / frame_sum : 0.0, frame_sum / frames / 1e3,
+                 upload_sum / frames / 1e3, events_sum / frames, overlay->cost_us);
+
+    // One request per color, flushed with the frame
+    XSetForeground(handle->display, handle->gc, 0x202020);
+    XFillRectangle(handle->display, drawable, handle->gc, x0, y0, XW_OVERLAY_WIDTH,
+                   XW_OVERLAY_HEIGHT + 24);
+    XSetForeground(handle->display, handle->gc, 0x40C040);
+    XFillRectangles(handle->display, drawable, handle->gc, fast, fast_len);
+    XSetForeground(handle->display, handle->gc, 0xE04040);
+    XFillRectangles(handle->display, drawable, handle->gc, slow, slow_len);
+    XSetForeground(handle->display, handle->gc, 0x4080FF);
+    XFillRectangles(handle->display, drawable, handle->gc, upload, upload_len);
+    XSetForeground(handle->display, handle->gc, 0xC0C040);
+    XFillRectangle(handle->display, drawable, handle->gc, x0 + 4,
+                   base - _xw_overlay_bar(XW_OVERLAY_BUDGET_US), XW_OVERLAY_SAMPLES, 1);
+    XSetForeground(handle->display, handle->gc, 0xFFFFFF);
+    XDrawString(handle->display, drawable, handle->gc, x0 + 4, base + 14, text, length);
+
+    overlay->cost_us = (_xw_now_ns() - uploaded) / 1000;
+}
+
+XW_DEF bool xw_overlay_enable(xw_handle* handle, bool enable)
+{
+    if (!enable) {
+        free(handle->overlay);
+        handle->overlay = NULL;
+        return true;
+    }
+    if (handle->overlay == NULL) {
+        handle->overlay = (struct _xw_overlay*)calloc(1, sizeof(struct _xw_overlay));
+        if (handle->overlay == NULL) {
+            fprintf(stderr, "ERROR: Buy more ram\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Trace */
+#ifdef XWRAP_TRACE
+static char* _xw_trace_exit_path = NULL;
+
+static void _xw_trace_exit(void)
+{
+    xw_trace_dump(_xw_trace_exit_path);
+    free(_xw_trace_exit_path);
+    _xw_trace_exit_path = NULL;
+}
+#endif // XWRAP_TRACE
+
+XW_DEF bool xw_trace_dump(const char* path)
+{
+#ifdef XWRAP_TRACE
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: Could not open '%s'\n", path);
+        return false;
+    }
+
+    const long pid   = getpid();
+    uint64_t dropped = 0;
+    bool first       = true;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (_xw_trace_buffer* buffer = __atomic_load_n(&_xw_trace_buffers, __ATOMIC_ACQUIRE);
+         buffer != NULL; buffer = buffer->next) {
+        const size_t len = __atomic_load_n(&buffer->len, __ATOMIC_ACQUIRE);
+        for (size_t i = 0; i < len; i++) {
+            const _xw_trace_event* event = &buffer->events[i];
+            fprintf(file,
+                    "%s\n{\"name\":\"%s\",\"cat\":\"xwrap\",\"ph\":\"X\",\"ts\":%.3f,"
+                    "\"dur\":%.3f,\"pid\":%ld,\"tid\":%ld,\"args\":{\"window\":%llu,"
+                    "\"frame\":%llu}}",
+                    first ? "" : ",", event->name, event->begin_ns / 1e3,
+                    (event->end_ns - event->begin_ns) / 1e3, pid, buffer->tid,
+                    (unsigned long long)event->window, (unsigned long long)event->frame);
+            first = false;
+        }
+        dropped += __atomic_load_n(&buffer->dropped, __ATOMIC_RELAXED);
+    }
+    fprintf(file, "\n]}\n");
+
+    if (dropped > 0) {
+        fprintf(stderr, "WARNING: %llu trace spans dropped, the buffers are full\n",
+                (unsigned long long)dropped);
+    }
+    if (fclose(file) != 0) {
+        fprintf(stderr, "ERROR: Could not write '%s'\n", path);
+        return false;
+    }
+    return true;
+#else
+    (void)path;
+    fprintf(stderr, "ERROR: compiled without XWRAP_TRACE\n");
+    return false;
+#endif // XWRAP_TRACE
+}
+
+XW_DEF bool xw_trace_dump_at_exit(const char* path)
+{
+#ifdef XWRAP_TRACE
+    const bool registered = _xw_trace_exit_path != NULL;
+    char* copy            = (char*)malloc(strlen(path) + 1);
+    if (copy == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        return false;
+    }
+    strcpy(copy, path);
+    free(_xw_trace_exit_path);
+    _xw_trace_exit_path = copy;
+    return registered || atexit(_xw_trace_exit) == 0;
+#else
+    (void)path;
+    fprintf(stderr, "ERROR: compiled without XWRAP_TRACE\n");
+    return false;
+#endif // XWRAP_TRACE
+}
+
+XW_DEF uint64_t xw_trace_begin(void)
+{
+#ifdef XWRAP_TRACE
+    return _xw_now_ns();
+#else
+    return 0;
+#endif // XWRAP_TRACE
+}
+
+XW_DEF void xw_trace_end(xw_handle* handle, const char* name, uint64_t begin)
+{
+#ifdef XWRAP_TRACE
+    if (handle != NULL) {
+        _XW_TRACE(name, begin, handle);
+    } else {
+        _XW_TRACE_GLOBAL(name, begin);
+    }
+#else
+    (void)handle;
+    (void)name;
+    (void)begin;
+#endif // XWRAP_TRACE
+}
+
+/* Plot */
+#define XW_PLOT_FANOUT 8 // Samples per block of the first pyramid level, blocks per block after
+#define XW_PLOT_LEVELS 16
+
+struct _xw_plot {
+    const float* samples;
+    size_t count;
+    bool pyramid;
+    // Level 'l' keeps the min and max of blocks of 8^l samples, level 0 is 'samples'
+    float* min[XW_PLOT_LEVELS];
+    float* max[XW_PLOT_LEVELS];
+    size_t len[XW_PLOT_LEVELS];
+    int levels;
+};
+
+static void _xw_minmax(const float* values, size_t count, float* min, float* max)
+{
+    size_t i = 0;
+    float lo = *min, hi = *max;
+#if defined(__SSE2__)
+    if (count >= 4) {
+        // The second operand is kept when one is NaN, so NaN values are skipped
+        __m128 vlo = _mm_set1_ps(lo);
+        __m128 vhi = _mm_set1_ps(hi);
+        for (; i + 4 <= count; i += 4) {
+            const __m128 v = _mm_loadu_ps(values + i);
+            vlo            = _mm_min_ps(v, vlo);
+            vhi            = _mm_max_ps(v, vhi);
+        }
+        float l[4], h[4];
+        _mm_storeu_ps(l, vlo);
+        _mm_storeu_ps(h, vhi);
+        for (int j = 0; j < 4; j++) {
+            lo = l[j] < lo ? l[j] : lo;
+            hi = h[j] > hi ? h[j] : hi;
+        }
+    }
+#endif // __SSE2__
+    for (; i < count; i++) {
+        lo = values[i] < lo ? values[i] : lo;
+        hi = values[i] > hi ? values[i] : hi;
+    }
+    *min = lo;
+    *max = hi;
+}
+
+static void _xw_plot_free_levels(xw_plot* plot)
+{
+    for (int l = 1; l < plot->levels; l++) {
+        free(plot->min[l]);
+        free(plot->max[l]);
+    }
+    plot->levels = 1;
+}
+
+// Min and max of the samples [first, end), each level takes the unaligned ends
+static void _xw_plot_range(const xw_plot* plot, size_t first, size_t end, float* min,
+                           float* max)
+{
+    *min = plot->samples[first];
+    *max = plot->samples[first];
+    size_t block = 1;
+    for (int l = 0;; l++) {
+        const size_t parent = block * XW_PLOT_FANOUT;
+        if (l + 1 >= plot->levels || end - first < 2 * parent) {
+            if (l == 0) {
+                _xw_minmax(plot->samples + first, end - first, min, max);
+            } else {
+                _xw_minmax(plot->min[l] + first / block, (end - first) / block, min, max);
+                _xw_minmax(plot->max[l] + first / block, (end - first) / block, min, max);
+            }
+            return;
+        }
+        const size_t head = (parent - first % parent) % parent;
+        const size_t tail = end % parent;
+        if (l == 0) {
+            _xw_minmax(plot->samples + first, head, min, max);
+            _xw_minmax(plot->samples + end - tail, tail, min, max);
+        } else {
+            _xw_minmax(plot->min[l] + first / block, head / block, min, max);
+            _xw_minmax(plot->max[l] + first / block, head / block, min, max);
+            _xw_minmax(plot->min[l] + (end - tail) / block, tail / block, min, max);
+            _xw_minmax(plot->max[l] + (end - tail) / block, tail / block, min, max);
+        }
+        first += head;
+        end -= tail;
+        block = parent;
+    }
+}
+
+XW_DEF xw_plot* xw_plot_create(const float* samples, size_t count, bool pyramid)
+{
+    xw_plot* plot = (xw_plot*)calloc(1, sizeof(xw_plot));
+    if (plot == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        return NULL;
+    }
+    plot->pyramid = pyramid;
+    plot->levels  = 1;
+    if (!xw_plot_update(plot, samples, count)) {
+        free(plot);
+        return NULL;
+    }
+    return plot;
+}
+
+XW_DEF void xw_plot_free(xw_plot* plot)
+{
+    _xw_plot_free_levels(plot);
+    free(plot);
+}
+
+XW_DEF bool xw_plot_update(xw_plot* plot, const float* samples, size_t count)
+{
+    _xw_plot_free_levels(plot);
+    plot->samples = samples;
+    plot->count   = count;
+    plot->len[0]  = count;
+    if (!plot->pyramid) {
+        return true;
+    }
+
+    // Only whole blocks, the rest is read from the level below
+    const float* below_min = samples;
+    const float* below_max = samples;
+    size_t below_len       = count;
+    while (plot->levels < XW_PLOT_LEVELS && below_len >= 2 * XW_PLOT_FANOUT) {
+        const int l  = plot->levels;
+        plot->len[l] = below_len / XW_PLOT_FANOUT;
+        plot->min[l] = (float*)malloc(plot->len[l] * sizeof(float));
+        plot->max[l] = (float*)malloc(plot->len[l] * sizeof(float));
+        if (plot->min[l] == NULL || plot->max[l] == NULL) {
+            fprintf(stderr, "ERROR: Buy more ram\n");
+            free(plot->min[l]);
+            free(plot->max[l]);
+            _xw_plot_free_levels(plot);
+            return false;
+        }
+        plot->levels++;
+        for (size_t i = 0; i < plot->len[l]; i++) {
+            float lo = below_min[i * XW_PLOT_FANOUT], hi = below_max[i * XW_PLOT_FANOUT];
+            _xw_minmax(below_min + i * XW_PLOT_FANOUT, XW_PLOT_FANOUT, &lo, &hi);
+            if (below_max != below_min) {
+                _xw_minmax(below_max + i * XW_PLOT_FANOUT, XW_PLOT_FANOUT, &lo, &hi);
+            }
+            plot->min[l][i] = lo;
+            plot->max[l][i] = hi;
+        }
+        below_min = plot->min[l];
+        below_max = plot->max[l];
+        below_len = plot->len[l];
+    }
+    return true;
+}
+
+// X11 coordinates are 16 bits
+static inline short _xw_short(double value)
+{
+    return (short)(value < INT16_MIN ? INT16_MIN : (value > INT16_MAX ? INT16_MAX : value));
+}
+
+static inline int _xw_plot_y(const xw_plot_view* view, float value)
+{
+    const float t = (view->high - value) / (view->high - view->low);
+    const int y   = view->area.y + (int)(t * (view->area.height - 1) + 0.5f);
+    const int top = view->area.y, bottom = view->area.y + view->area.height - 1;
+    return y < top ? top : (y > bottom ? bottom : y);
+}
+
+// Calls 'emit' with the vertical span of every pixel column, joined to the column before
+static bool _xw_plot_columns(const xw_plot* plot, const xw_plot_view* view,
+                             void (*emit)(void* user, int x, int y0, int y1), void* user)
+{
+    if (plot->count == 0 || view->area.width <= 0 || view->area.height <= 0 ||
+        view->last <= view->first || view->high == view->low) {
+        return false;
+    }
+    const double step = (view->last - view->first) / view->area.width;
+    int prev_top = 0, prev_bottom = 0;
+    bool joined  = false;
+    for (int c = 0; c < (int)view->area.width; c++) {
+        const double a = view->first + c * step;
+        const double b = a + step;
+        if (b <= 0 || a >= plot->count) {
+            joined = false;
+            continue;
+        }
+        size_t first = a <= 0 ? 0 : (size_t)a;
+        size_t end   = b >= plot->count ? plot->count : (size_t)b;
+        end          = end > first ? end : first + 1;
+
+        float min, max;
+        _xw_plot_range(plot, first, end, &min, &max);
+        int top = _xw_plot_y(view, max), bottom = _xw_plot_y(view, min);
+        if (joined) {
+            top    = top > prev_bottom ? prev_bottom : top;
+            bottom = bottom < prev_top ? prev_top : bottom;
+        }
+        emit(user, view->area.x + c, top, bottom);
+        prev_top    = _xw_plot_y(view, max);
+        prev_bottom = _xw_plot_y(view, min);
+        joined      = true;
+    }
+    return true;
+}
+
+typedef struct {
+    XSegment* segments;
+    int len;
+} _xw_plot_segments;
+
+static void _xw_plot_emit_segment(void* user, int x, int y0, int y1)
+{
+    _xw_plot_segments* out    = (_xw_plot_segments*)user;
+    out->segments[out->len++] = (XSegment){
+        .x1 = _xw_short(x), .y1 = _xw_short(y0), .x2 = _xw_short(x), .y2 = _xw_short(y1)};
+}
+
+XW_DEF bool xw_draw_plot(xw_handle* handle, const xw_plot* plot, xw_plot_view view,
+                         uint32_t color)
+{
+    _XW_CALL(handle);
+    XSetLineAttributes(handle->display, handle->gc, 0, LineSolid, CapButt, JoinMiter);
+    XSetForeground(handle->display, handle->gc, color);
+    _XW_STAT_ADD(handle, requests[XW_STAT_PLOT], 1);
+
+    const double step = (view.last - view.first) / (view.area.width > 0 ? view.area.width : 1);
+    if (step < 1 && plot->count > 0 && view.high != view.low) {
+        // Zoomed in, fewer samples than columns
+        const size_t first = view.first <= 0 ? 0 : (size_t)view.first;
+        size_t end         = (size_t)(view.last + 2);
+        end                = end > plot->count ? plot->count : end;
+        if (end <= first) {
+            return true;
+        }
+        XPoint* points = (XPoint*)malloc((end - first) * sizeof(XPoint));
+        if (points == NULL) {
+            fprintf(stderr, "ERROR: Buy more ram\n");
+            return false;
+        }
+        // The first and last samples are outside of the area, their segments are cut at its edges
+        const double left  = view.area.x;
+        const double right = view.area.x + view.area.width - 1;
+        int len            = 0;
+        double prev_x = 0, prev_y = 0;
+        for (size_t i = first; i < end; i++) {
+            double x0 = prev_x, y0 = prev_y;
+            double x1 = view.area.x + (i - view.first) / step;
+            double y1 = _xw_plot_y(&view, plot->samples[i]);
+            prev_x    = x1;
+            prev_y    = y1;
+            if (i == first || x1 < left || x0 > right) {
+                continue;
+            }
+            if (x0 < left) {
+                y0 += (y1 - y0) * (left - x0) / (x1 - x0);
+                x0 = left;
+            }
+            if (x1 > right) {
+                y1 = y0 + (y1 - y0) * (right - x0) / (x1 - x0);
+                x1 = right;
+            }
+            if (len == 0) {
+                points[len++] = (XPoint){.x = _xw_short(x0), .y = _xw_short(y0)};
+            }
+            points[len++] = (XPoint){.x = _xw_short(x1), .y = _xw_short(y1)};
+        }
+        XDrawLines(handle->display, handle->window, handle->gc, points, len, CoordModeOrigin);
+        free(points);
+        return true;
+    }
+
+    _xw_plot_segments out = {.segments = (XSegment*)malloc(
+                                 (view.area.width > 0 ? view.area.width : 1) * sizeof(XSegment)),
+                             .len      = 0};
+    if (out.segments == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        return false;
+    }
+    _xw_plot_columns(plot, &view, _xw_plot_emit_segment, &out);
+    XDrawSegments(handle->display, handle->window, handle->gc, out.segments, out.len);
+    free(out.segments);
+    return true;
+}
+
+typedef struct {
+    _xw_surface surface;
+    uint32_t color;
+} _xw_plot_pixels;
+
+static void _xw_plot_emit_pixels(void* user, int x, int y0, int y1)
+{
+    const _xw_plot_pixels* out = (const _xw_plot_pixels*)user;
+    const _xw_surface* surface = &out->surface;
+    if (x < 0 || x >= surface->width) {
+        return;
+    }
+    y0 = y0 < 0 ? 0 : y0;
+    y1 = y1 >= surface->height ? surface->height - 1 : y1;
+    uint32_t* pixel = surface->pixels + (size_t)y0 * surface->stride + x;
+    for (int y = y0; y <= y1; y++, pixel += surface->stride) {
+        *pixel = out->color;
+    }
+}
+
+XW_DEF bool xw_draw_plot_image(xw_handle* handle, const xw_plot* plot, xw_plot_view view,
+                               uint32_t color)
+{
+    _xw_plot_pixels out = {.color = color};
+    if (!_xw_image_surface(handle, &out.surface)) {
+        return false;
+    }
+    // Zoomed in columns join like a polyline
+    _xw_plot_columns(plot, &view, _xw_plot_emit_pixels, &out);
+    return true;
+}
+
+/* Threads */
+#ifdef XWRAP_THREADS
+#define XW_THREADS_MAX 16
+#define XW_THREADS_MIN_PIXELS (1 << 16) // Smaller jobs are not worth waking the threads
+#define XW_THREADS_CHUNK_PIXELS (1 << 14)
+
+// Workers started on first use, the caller works too
+static struct {
+    pthread_mutex_t run; // One job at a time
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+    pthread_once_t once;
+    int workers, busy;
+    uint64_t generation;
+    void (*rows)(void* user, int first, int end);
+    void* user;
+    int height, chunk;
+    int next; // Atomic, the first row not taken
+} _xw_pool = {
+    .run  = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .once = PTHREAD_ONCE_INIT,
+};
+
+static void _xw_pool_take(void)
+{
+    for (;;) {
+        const int first = __atomic_fetch_add(&_xw_pool.next, _xw_pool.chunk, __ATOMIC_RELAXED);
+        if (first >= _xw_pool.height) {
+            return;
+        }
+        const int end = first + _xw_pool.chunk;
+        _xw_pool.rows(_xw_pool.user, first, end > _xw_pool.height ? _xw_pool.height : end);
+    }
+}
+
+static void* _xw_pool_worker(void* arg)
+{
+    uint64_t seen = 0;
+    pthread_mutex_lock(&_xw_pool.lock);
+    for (;;) {
+        while (_xw_pool.generation == seen) {
+            pthread_cond_wait(&_xw_pool.work, &_xw_pool.lock);
+        }
+        seen = _xw_pool.generation;
+        pthread_mutex_unlock(&_xw_pool.lock);
+        _xw_pool_take();
+        pthread_mutex_lock(&_xw_pool.lock);
+        if (--_xw_pool.busy == 0) {
+            pthread_cond_signal(&_xw_pool.done);
+        }
+    }
+    return arg;
+}
+
+static void _xw_pool_start(void)
+{
+    long cpus   = sysconf(_SC_NPROCESSORS_ONLN);
+    cpus        = cpus > XW_THREADS_MAX ? XW_THREADS_MAX : cpus;
+    int workers = 0;
+    for (; workers < cpus - 1; workers++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, _xw_pool_worker, NULL) != 0) {
+            fprintf(stderr, "WARNING: could not start a thread, using %d\n", workers + 1);
+            break;
+        }
+        pthread_detach(thread);
+    }
+    _xw_pool.workers = workers;
+}
+#endif // XWRAP_THREADS
+
+// Calls 'rows' over [0, height) in chunks, on the threads when the job is big enough
+static void _xw_parallel_rows(int height, int width, void (*rows)(void* user, int first, int end),
+                              void* user)
+{
+#ifdef XWRAP_THREADS
+    if ((size_t)height * width >= XW_THREADS_MIN_PIXELS) {
+        pthread_once(&_xw_pool.once, _xw_pool_start);
+    }
+    if ((size_t)height * width < XW_THREADS_MIN_PIXELS || _xw_pool.workers == 0) {
+        rows(user, 0, height);
+        return;
+    }
+
+    pthread_mutex_lock(&_xw_pool.run);
+    pthread_mutex_lock(&_xw_pool.lock);
+    const int chunk = XW_THREADS_CHUNK_PIXELS / (width > 0 ? width : 1);
+    _xw_pool.rows   = rows;
+    _xw_pool.user   = user;
+    _xw_pool.height = height;
+    _xw_pool.chunk  = chunk > 0 ? chunk : 1;
+    _xw_pool.next   = 0;
+    _xw_pool.busy   = _xw_pool.workers;
+    _xw_pool.generation++;
+    pthread_cond_broadcast(&_xw_pool.work);
+    pthread_mutex_unlock(&_xw_pool.lock);
+
+    _xw_pool_take();
+
+    pthread_mutex_lock(&_xw_pool.lock);
+    while (_xw_pool.busy > 0) {
+        pthread_cond_wait(&_xw_pool.done, &_xw_pool.lock);
+    }
+    pthread_mutex_unlock(&_xw_pool.lock);
+    pthread_mutex_unlock(&_xw_pool.run);
+#else
+    (void)width;
+    rows(user, 0, height);
+#endif // XWRAP_THREADS
+}
+
+/* Colormap */
+typedef struct {
+    xw_scalar_grid grid;
+    const uint32_t* lut;
+    int last;            // The last index of the lut
+    float scale, bias;   // index = value * scale + bias, the bias rounds
+    uint32_t table[256]; // Colors of the 8 bit values
+    uint32_t* pixels;
+    size_t stride;
+    xw_rect dest;        // Clipped to the image
+    const int* columns;  // The grid column of each 'dest' column, NULL when not scaled
+    int rows_from, rows; // The unclipped 'dest' top and height, for the grid rows
+} _xw_colormap_job;
+
+static inline uint32_t _xw_colormap_color(const _xw_colormap_job* job, float value)
+{
+    float index = value * job->scale + job->bias;
+    index       = index > 0 ? index : 0; // NaN too
+    index       = index < job->last ? index : job->last;
+    return job->lut[(int)index];
+}
+
+static void _xw_colormap_row_f32(const _xw_colormap_job* job, const float* values,
+                                 uint32_t* out, int width)
+{
+    int x = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(job->scale);
+    const __m128 bias  = _mm_set1_ps(job->bias);
+    const __m128 last  = _mm_set1_ps((float)job->last);
+    const __m128 zero  = _mm_setzero_ps();
+    for (; x + 4 <= width; x += 4) {
+        __m128 index = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(values + x), scale), bias);
+        index        = _mm_min_ps(_mm_max_ps(index, zero), last); // NaN takes the zero
+        int i[4];
+        _mm_storeu_si128((__m128i*)i, _mm_cvttps_epi32(index));
+        out[x + 0] = job->lut[i[0]];
+        out[x + 1] = job->lut[i[1]];
+        out[x + 2] = job->lut[i[2]];
+        out[x + 3] = job->lut[i[3]];
+    }
+#endif // __SSE2__
+    for (; x < width; x++) {
+        out[x] = _xw_colormap_color(job, values[x]);
+    }
+}
+
+static void _xw_colormap_row_u16(const _xw_colormap_job* job, const uint16_t* values,
+                                 uint32_t* out, int width)
+{
+    int x = 0;
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(job->scale);
+    const __m128 bias  = _mm_set1_ps(job->bias);
+    const __m128 last  = _mm_set1_ps((float)job->last);
+    const __m128 zero  = _mm_setzero_ps();
+    for (; x + 8 <= width; x += 8) {
+        const __m128i v       = _mm_loadu_si128((const __m128i*)(values + x));
+        const __m128i half[2] = {_mm_unpacklo_epi16(v, _mm_setzero_si128()),
+                                 _mm_unpackhi_epi16(v, _mm_setzero_si128())};
+        for (int h = 0; h < 2; h++) {
+            __m128 index = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(half[h]), scale), bias);
+            index        = _mm_min_ps(_mm_max_ps(index, zero), last);
+            int i[4];
+            _mm_storeu_si128((__m128i*)i, _mm_cvttps_epi32(index));
+            uint32_t* dst = out + x + h * 4;
+            dst[0]        = job->lut[i[0]];
+            dst[1]        = job->lut[i[1]];
+            dst[2]        = job->lut[i[2]];
+            dst[3]        = job->lut[i[3]];
+        }
+    }
+#endif // __SSE2__
+    for (; x < width; x++) {
+        out[x] = _xw_colormap_color(job, values[x]);
+    }
+}
+
+static void _xw_colormap_rows(void* user, int first, int end)
+{
+    const _xw_colormap_job* job = (const _xw_colormap_job*)user;
+    const xw_scalar_grid* grid  = &job->grid;
+    for (int y = first; y < end; y++) {
+        const int row =
+            (int)((int64_t)(job->dest.y + y - job->rows_from) * grid->height / job->rows);
+        uint32_t* out   = job->pixels + (size_t)(job->dest.y + y) * job->stride + job->dest.x;
+        const size_t at = (size_t)row * grid->stride;
+
+        if (job->columns != NULL) {
+            for (unsigned int x = 0; x < job->dest.width; x++) {
+                const size_t i = at + job->columns[x];
+                switch (grid->type) {
+                    case XW_SCALAR_U8:
+                        out[x] = job->table[((const uint8_t*)grid->values)[i]];
+                        break;
+                    case XW_SCALAR_U16:
+                        out[x] = _xw_colormap_color(job, ((const uint16_t*)grid->values)[i]);
+                        break;
+                    case XW_SCALAR_F32:
+                        out[x] = _xw_colormap_color(job, ((const float*)grid->values)[i]);
+                        break;
+                }
+            }
+            continue;
+        }
+
+        switch (grid->type) {
+            case XW_SCALAR_U8: {
+                const uint8_t* values = (const uint8_t*)grid->values + at;
+                for (unsigned int x = 0; x < job->dest.width; x++) {
+                    out[x] = job->table[values[x]];
+                }
+                break;
+            }
+            case XW_SCALAR_U16:
+                _xw_colormap_row_u16(job, (const uint16_t*)grid->values + at, out, job->dest.width);
+                break;
+            case XW_SCALAR_F32:
+                _xw_colormap_row_f32(job, (const float*)grid->values + at, out, job->dest.width);
+                break;
+        }
+    }
+}
+
+XW_DEF void xw_colormap_gradient(uint32_t* lut, int size, const uint32_t* stops, int count)
+{
+    for (int i = 0; i < size; i++) {
+        const float t    = count > 1 && size > 1 ? (float)i * (count - 1) / (size - 1) : 0;
+        const int stop   = (int)t < count - 1 ? (int)t : count - 1;
+        const uint32_t a = stops[stop];
+        const uint32_t b = stops[stop + 1 < count ? stop + 1 : stop];
+        const float f    = t - stop;
+        uint32_t color   = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            const float ca = (a >> shift) & 0xFF, cb = (b >> shift) & 0xFF;
+            color |= (uint32_t)(ca + (cb - ca) * f + 0.5f) << shift;
+        }
+        lut[i] = color;
+    }
+}
+
+XW_DEF void xw_scalar_grid_range(xw_scalar_grid grid, float* low, float* high)
+{
+    const size_t stride = grid.stride != 0 ? grid.stride : (size_t)grid.width;
+    float lo = 1.0f / 0.0f, hi = -1.0f / 0.0f;
+    for (int y = 0; y < grid.height && grid.width > 0; y++) {
+        switch (grid.type) {
+            case XW_SCALAR_U8: {
+                const uint8_t* values = (const uint8_t*)grid.values + y * stride;
+                uint8_t row_lo = values[0], row_hi = values[0];
+                for (int x = 1; x < grid.width; x++) {
+                    row_lo = values[x] < row_lo ? values[x] : row_lo;
+                    row_hi = values[x] > row_hi ? values[x] : row_hi;
+                }
+                lo = row_lo < lo ? row_lo : lo;
+                hi = row_hi > hi ? row_hi : hi;
+                break;
+            }
+            case XW_SCALAR_U16: {
+                const uint16_t* values = (const uint16_t*)grid.values + y * stride;
+                uint16_t row_lo = values[0], row_hi = values[0];
+                for (int x = 1; x < grid.width; x++) {
+                    row_lo = values[x] < row_lo ? values[x] : row_lo;
+                    row_hi = values[x] > row_hi ? values[x] : row_hi;
+                }
+                lo = row_lo < lo ? row_lo : lo;
+                hi = row_hi > hi ? row_hi : hi;
+                break;
+            }
+            case XW_SCALAR_F32:
+                _xw_minmax((const float*)grid.values + y * stride, grid.width, &lo, &hi);
+                break;
+        }
+    }
+    *low  = lo <= hi ? lo : 0;
+    *high = lo <= hi ? hi : 0;
+}
+
+XW_DEF bool xw_draw_colormap(xw_handle* handle, xw_scalar_grid grid, const xw_colormap* colormap,
+                             xw_rect dest)
+{
+    _XW_TRACE_CLOCK(start);
+    _xw_surface surface;
+    if (!_xw_image_surface(handle, &surface)) {
+        return false;
+    }
+    if (colormap->size < 1 || grid.width <= 0 || grid.height <= 0) {
+        fprintf(stderr, "ERROR: empty colormap or grid\n");
+        return false;
+    }
+
+    _xw_colormap_job job = {
+        .grid      = grid,
+        .lut       = colormap->lut,
+        .last      = colormap->size - 1,
+        .pixels    = surface.pixels,
+        .stride    = surface.stride,
+        .columns   = NULL,
+        .rows_from = dest.y,
+        .rows      = dest.height,
+    };
+    job.grid.stride = grid.stride != 0 ? grid.stride : (size_t)grid.width;
+
+    float low = colormap->low, high = colormap->high;
+    if (colormap->auto_range) {
+        xw_scalar_grid_range(grid, &low, &high);
+    }
+    job.scale = high > low ? job.last / (high - low) : 0;
+    job.bias  = 0.5f - low * job.scale;
+    if (grid.type == XW_SCALAR_U8) {
+        for (int i = 0; i < 256; i++) {
+            job.table[i] = _xw_colormap_color(&job, i);
+        }
+    }
+
+    // Clip to the image
+    const int x0 = dest.x < 0 ? 0 : dest.x;
+    const int y0 = dest.y < 0 ? 0 : dest.y;
+    const int x1 =
+        dest.x + (int)dest.width > surface.width ? surface.width : dest.x + (int)dest.width;
+    const int y1 =
+        dest.y + (int)dest.height > surface.height ? surface.height : dest.y + (int)dest.height;
+    if (x0 >= x1 || y0 >= y1) {
+        return true;
+    }
+    job.dest = (xw_rect){.x = x0, .y = y0, .width = x1 - x0, .height = y1 - y0};
+
+    int* columns = NULL;
+    if ((int)dest.width != grid.width || dest.x != x0) {
+        columns = (int*)malloc(job.dest.width * sizeof(int));
+        if (columns == NULL) {
+            fprintf(stderr, "ERROR: Buy more ram\n");
+            return false;
+        }
+        for (int x = x0; x < x1; x++) {
+            columns[x - x0] = (int)((int64_t)(x - dest.x) * grid.width / dest.width);
+        }
+        job.columns = columns;
+    }
+
+    _xw_parallel_rows(job.dest.height, job.dest.width, _xw_colormap_rows, &job);
+    free(columns);
+    _XW_TRACE("colormap", start, handle);
+    return true;
+}
+
+/* YUV */
+typedef struct {
+    const xw_yuv_frame* frame;
+    int16_t y_offset, y_scale, rv, gu, gv, bu; // In 1/64
+    uint32_t* pixels;
+    size_t stride;
+    int x, y;           // Where the frame goes in the image
+    int from_x, from_y; // The first visible pixel of the frame
+    int width;          // Visible columns
+} _xw_yuv_job;
+
+static inline uint32_t _xw_yuv_pixel(const _xw_yuv_job* job, int y, int u, int v)
+{
+    const int luma = (y - job->y_offset) * job->y_scale + 32;
+    u -= 128;
+    v -= 128;
+    int c[3] = {
+        (luma + job->bu * u) >> 6,
+        (luma - job->gu * u - job->gv * v) >> 6,
+        (luma + job->rv * v) >> 6,
+    };
+    uint32_t color = 0xFF000000;
+    for (int i = 0; i < 3; i++) {
+        color |= (uint32_t)(c[i] < 0 ? 0 : (c[i] > 255 ? 255 : c[i])) << (8 * i);
+    }
+    return color;
+}
+
+#if defined(__SSE2__)
+// 16 pixels from 16 luma and 8 of each chroma as int16
+static inline void _xw_yuv_store16(const _xw_yuv_job* job, __m128i y8, __m128i u8, __m128i v8,
+                                   uint32_t* out)
+{
+    const __m128i zero   = _mm_setzero_si128();
+    const __m128i offset = _mm_set1_epi16(job->y_offset);
+    const __m128i round  = _mm_set1_epi16(32);
+    const __m128i half   = _mm_set1_epi16(128);
+    u8                   = _mm_sub_epi16(u8, half);
+    v8                   = _mm_sub_epi16(v8, half);
+
+    // Every chroma covers two pixels
+    const __m128i y_lanes[2] = {_mm_unpacklo_epi8(y8, zero), _mm_unpackhi_epi8(y8, zero)};
+    const __m128i u_lanes[2] = {_mm_unpacklo_epi16(u8, u8), _mm_unpackhi_epi16(u8, u8)};
+    const __m128i v_lanes[2] = {_mm_unpacklo_epi16(v8, v8), _mm_unpackhi_epi16(v8, v8)};
+
+    __m128i b[2], g[2], r[2];
+    for (int i = 0; i < 2; i++) {
+        // Saturating adds, anything past the int16 range is past the 8 bit range too
+        const __m128i luma = _mm_add_epi16(
+            _mm_mullo_epi16(_mm_sub_epi16(y_lanes[i], offset), _mm_set1_epi16(job->y_scale)),
+            round);
+        b[i] = _mm_adds_epi16(luma, _mm_mullo_epi16(u_lanes[i], _mm_set1_epi16(job->bu)));
+        g[i] = _mm_subs_epi16(
+            _mm_subs_epi16(luma, _mm_mullo_epi16(u_lanes[i], _mm_set1_epi16(job->gu))),
+            _mm_mullo_epi16(v_lanes[i], _mm_set1_epi16(job->gv)));
+        r[i] = _mm_adds_epi16(luma, _mm_mullo_epi16(v_lanes[i], _mm_set1_epi16(job->rv)));
+        b[i] = _mm_srai_epi16(b[i], 6);
+        g[i] = _mm_srai_epi16(g[i], 6);
+        r[i] = _mm_srai_epi16(r[i], 6);
+    }
+    const __m128i b8 = _mm_packus_epi16(b[0], b[1]);
+    const __m128i g8 = _mm_packus_epi16(g[0], g[1]);
+    const __m128i r8 = _mm_packus_epi16(r[0], r[1]);
+    const __m128i a8 = _mm_set1_epi8((char)0xFF);
+
+    const __m128i bg[2] = {_mm_unpacklo_epi8(b8, g8), _mm_unpackhi_epi8(b8, g8)};
+    const __m128i ra[2] = {_mm_unpacklo_epi8(r8, a8), _mm_unpackhi_epi8(r8, a8)};
+    for (int i = 0; i < 2; i++) {
+        _mm_storeu_si128((__m128i*)(out + 8 * i), _mm_unpacklo_epi16(bg[i], ra[i]));
+        _mm_storeu_si128((__m128i*)(out + 8 * i + 4), _mm_unpackhi_epi16(bg[i], ra[i]));
+    }
+}
+#endif // __SSE2__
+
+static void _xw_yuv_rows(void* user, int first, int end)
+{
+    const _xw_yuv_job* job    = (const _xw_yuv_job*)user;
+    const xw_yuv_frame* frame = job->frame;
+    for (int row = first; row < end; row++) {
+        const int src_y  = job->from_y + row;
+        const uint8_t* y = frame->planes[0] + (size_t)src_y * frame->strides[0];
+        const uint8_t* u = NULL;
+        const uint8_t* v = NULL;
+        int step         = 1; // Bytes from a chroma to the next
+        switch (frame->format) {
+            case XW_YUV_I420:
+                u = frame->planes[1] + (size_t)(src_y / 2) * frame->strides[1];
+                v = frame->planes[2] + (size_t)(src_y / 2) * frame->strides[2];
+                break;
+            case XW_YUV_NV12:
+                u    = frame->planes[1] + (size_t)(src_y / 2) * frame->strides[1];
+                v    = u + 1;
+                step = 2;
+                break;
+            case XW_YUV_YUYV:
+                u    = y + 1;
+                v    = y + 3;
+                step = 4;
+                break;
+        }
+        const int y_step = frame->format == XW_YUV_YUYV ? 2 : 1;
+        uint32_t* out    = job->pixels + (size_t)(job->y + src_y) * job->stride + job->x;
+
+        int x       = job->from_x;
+        const int e = job->from_x + job->width;
+        // Scalar until the chroma pairs line up
+        for (; x < e && (x & 1) != 0; x++) {
+            out[x] = _xw_yuv_pixel(job, y[x * y_step], u[x / 2 * step], v[x / 2 * step]);
+        }
+#if defined(__SSE2__)
+        const __m128i low = _mm_set1_epi16(0xFF);
+        for (; x + 16 <= e; x += 16) {
+            __m128i y8, u8, v8;
+            switch (frame->format) {
+                case XW_YUV_I420:
+                    y8 = _mm_loadu_si128((const __m128i*)(y + x));
+                    u8 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(u + x / 2)),
+                                           _mm_setzero_si128());
+                    v8 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(v + x / 2)),
+                                           _mm_setzero_si128());
+                    break;
+                case XW_YUV_NV12: {
+                    const __m128i uv = _mm_loadu_si128((const __m128i*)(u + x));
+                    y8               = _mm_loadu_si128((const __m128i*)(y + x));
+                    u8               = _mm_and_si128(uv, low);
+                    v8               = _mm_srli_epi16(uv, 8);
+                    break;
+                }
+                case XW_YUV_YUYV:
+                default: {
+                    const __m128i a  = _mm_loadu_si128((const __m128i*)(y + 2 * x));
+                    const __m128i b  = _mm_loadu_si128((const __m128i*)(y + 2 * x + 16));
+                    const __m128i uv = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+                    y8 = _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low));
+                    u8 = _mm_and_si128(uv, low);
+                    v8 = _mm_srli_epi16(uv, 8);
+                    break;
+                }
+            }
+            _xw_yuv_store16(job, y8, u8, v8, out + x);
+        }
+#endif // __SSE2__
+        for (; x < e; x++) {
+            out[x] = _xw_yuv_pixel(job, y[x * y_step], u[x / 2 * step], v[x / 2 * step]);
+        }
+    }
+}
+
+XW_DEF bool xw_draw_yuv(xw_handle* handle, const xw_yuv_frame* frame, int x, int y)
+{
+    _XW_TRACE_CLOCK(start);
+    _xw_surface surface;
+    if (!_xw_image_surface(handle, &surface)) {
+        return false;
+    }
+
+    // Clip to the image
+    const int from_x = x < 0 ? -x : 0;
+    const int from_y = y < 0 ? -y : 0;
+    const int to_x   = x + frame->width > surface.width ? surface.width - x : frame->width;
+    const int to_y   = y + frame->height > surface.height ? surface.height - y : frame->height;
+    if (from_x >= to_x || from_y >= to_y) {
+        return true;
+    }
+
+    // Y'CbCr to R'G'B' from the luma weights of red and blue
+    const bool bt709   = frame->matrix == XW_YUV_BT709;
+    const float kr     = bt709 ? 0.2126f : 0.299f;
+    const float kb     = bt709 ? 0.0722f : 0.114f;
+    const float kg     = 1 - kr - kb;
+    const float luma   = frame->full_range ? 64 : 64 * 255.0f / 219;
+    const float chroma = frame->full_range ? 64 : 64 * 255.0f / 224;
+
+    _xw_yuv_job job = {
+        .frame    = frame,
+        .y_offset = frame->full_range ? 0 : 16,
+        .y_scale  = (int16_t)(luma + 0.5f),
+        .rv       = (int16_t)(2 * (1 - kr) * chroma + 0.5f),
+        .gu       = (int16_t)(2 * (1 - kb) * kb / kg * chroma + 0.5f),
+        .gv       = (int16_t)(2 * (1 - kr) * kr / kg * chroma + 0.5f),
+        .bu       = (int16_t)(2 * (1 - kb) * chroma + 0.5f),
+        .pixels   = surface.pixels,
+        .stride   = surface.stride,
+        .x        = x,
+        .y        = y,
+        .from_x   = from_x,
+        .from_y   = from_y,
+        .width    = to_x - from_x,
+    };
+    // The rows of the job are visible rows, counted from 'from_y'
+    _xw_parallel_rows(to_y - from_y, to_x - from_x, _xw_yuv_rows, &job);
+    _XW_TRACE("yuv", start, handle);
+    return true;
+}
+
+/* Tiles */
+#define XW_TILE 256
+#define XW_TILES_LEVELS 24
+#define XW_TILES_HEADER 4096      // The pyramid file starts with '_xw_tiles_header'
+#define XW_TILES_MAGIC 0x50595758u // "XWYP"
+#define XW_TILES_PREFETCH 128
+
+// level << 48 | ty << 24 | tx
+#define _XW_TILE_KEY(level, tx, ty) ((uint64_t)(level) << 48 | (uint64_t)(ty) << 24 | (tx))
+#define _XW_TILE_EMPTY UINT64_MAX
+
+typedef struct {
+    uint32_t magic, width, height, levels, complete, reserved;
+    uint64_t source_size;
+    int64_t source_mtime;
+} _xw_tiles_header;
+
+typedef struct {
+    uint64_t key;
+    uint64_t last_used; // The frame that used it last
+    bool loading;       // Filled by the prefetch thread, not usable yet
+    uint32_t* pixels;
+} _xw_tile_slot;
+
+struct _xw_tiles {
+    int fd;
+    const uint8_t* raw;
+    size_t raw_size, stride;
+    int levels;
+    uint32_t width[XW_TILES_LEVELS], height[XW_TILES_LEVELS]; // Of every level
+    size_t offset[XW_TILES_LEVELS];                           // Of the levels in the pyramid
+    int pyramid_fd;
+    uint8_t* pyramid;
+    size_t pyramid_size;
+    _xw_tile_slot* slots;
+    size_t slots_len;
+    uint32_t* cache;   // The pixels of all slots
+    uint32_t* scratch; // A tile for when the cache is full
+    int* columns;
+    size_t columns_len;
+    uint64_t frame;
+#ifdef XWRAP_THREADS
+    pthread_t prefetcher;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool started; // Joined by 'xw_tiles_close'
+    bool stop;
+    uint64_t wanted[XW_TILES_PREFETCH]; // The tiles to prefetch, most wanted first
+    int wanted_len, wanted_next;
+#endif // XWRAP_THREADS
+};
+
+static inline int64_t _xw_floor(double v)
+{
+    const int64_t i = (int64_t)v;
+    return i > v ? i - 1 : i;
+}
+
+static inline int64_t _xw_ceil(double v)
+{
+    const int64_t i = (int64_t)v;
+    return i < v ? i + 1 : i;
+}
+
+static inline uint32_t _xw_tiles_across(const xw_tiles* tiles, int level)
+{
+    return (tiles->width[level] + XW_TILE - 1) / XW_TILE;
+}
+
+static inline uint32_t _xw_tiles_down(const xw_tiles* tiles, int level)
+{
+    return (tiles->height[level] + XW_TILE - 1) / XW_TILE;
+}
+
+static inline const uint32_t* _xw_tiles_pyramid_tile(const xw_tiles* tiles, int level, uint32_t tx,
+                                                     uint32_t ty)
+{
+    const size_t index = (size_t)ty * _xw_tiles_across(tiles, level) + tx;
+    return (const uint32_t*)(tiles->pyramid + tiles->offset[level]) + index * XW_TILE * XW_TILE;
+}
+
+// Copies a region of a level, the pixels past the edges repeat the edges
+static void _xw_tiles_copy(const xw_tiles* tiles, int level, uint32_t x, uint32_t y, int width,
+                           int height, uint32_t* out, size_t out_stride)
+{
+    const uint32_t level_width = tiles->width[level], level_height = tiles->height[level];
+    const int inside = x + width > level_width ? (int)(level_width - x) : width;
+    for (int row = 0; row < height; row++) {
+        const uint32_t sy = y + row < level_height ? y + row : level_height - 1;
+        uint32_t* dst     = out + (size_t)row * out_stride;
+        if (level == 0) {
+            memcpy(dst, tiles->raw + sy * tiles->stride + (size_t)x * sizeof(uint32_t),
+                   inside * sizeof(uint32_t));
+        } else {
+            for (int done = 0; done < inside;) {
+                const uint32_t sx   = x + done;
+                const uint32_t* src =
+                    _xw_tiles_pyramid_tile(tiles, level, sx / XW_TILE, sy / XW_TILE);
+                int run = XW_TILE - sx % XW_TILE;
+                run     = run < inside - done ? run : inside - done;
+                memcpy(dst + done, src + (sy % XW_TILE) * XW_TILE + sx % XW_TILE,
+                       run * sizeof(uint32_t));
+                done += run;
+            }
+        }
+        for (int i = inside; i < width; i++) {
+            dst[i] = dst[inside - 1];
+        }
+    }
+}
+
+// The rounded up average of each byte, like '_mm_avg_epu8'
+static inline uint32_t _xw_avg_bytes(uint32_t a, uint32_t b)
+{
+    return (a | b) - ((a ^ b) >> 1 & 0x7F7F7F7F);
+}
+
+// Halves two rows of 2 tiles into one row of a tile, 2x2 box filter
+static void _xw_tiles_halve(const uint32_t* row0, const uint32_t* row1, uint32_t* out)
+{
+#if defined(__SSE2__)
+    for (int x = 0; x < XW_TILE; x += 4) {
+        __m128i h[2];
+        for (int i = 0; i < 2; i++) {
+            const __m128i a = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(row0 + 2 * x + 4 * i)),
+                                           _mm_loadu_si128((const __m128i*)(row1 + 2 * x + 4 * i)));
+            h[i]            = _mm_avg_epu8(a, _mm_srli_si128(a, 4));
+        }
+        // The even pixels hold the 2x2 averages
+        _mm_storeu_si128((__m128i*)(out + x),
+                         _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(h[0]),
+                                                         _mm_castsi128_ps(h[1]),
+                                                         _MM_SHUFFLE(2, 0, 2, 0))));
+    }
+#else
+    for (int x = 0; x < XW_TILE; x++) {
+        out[x] = _xw_avg_bytes(_xw_avg_bytes(row0[2 * x], row1[2 * x]),
+                               _xw_avg_bytes(row0[2 * x + 1], row1[2 * x + 1]));
+    }
+#endif // __SSE2__
+}
+
+static bool _xw_tiles_build(xw_tiles* tiles)
+{
+    uint32_t* block = (uint32_t*)malloc(sizeof(uint32_t) * 4 * XW_TILE * XW_TILE);
+    if (block == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        return false;
+    }
+    // Every tile halves a 2x2 block of tiles of the level below, the levels go from big to small
+    for (int level = 1; level < tiles->levels; level++) {
+        for (uint32_t ty = 0; ty < _xw_tiles_down(tiles, level); ty++) {
+            for (uint32_t tx = 0; tx < _xw_tiles_across(tiles, level); tx++) {
+                _xw_tiles_copy(tiles, level - 1, tx * 2 * XW_TILE, ty * 2 * XW_TILE, 2 * XW_TILE,
+                               2 * XW_TILE, block, 2 * XW_TILE);
+                uint32_t* tile = (uint32_t*)_xw_tiles_pyramid_tile(tiles, level, tx, ty);
+                for (int y = 0; y < XW_TILE; y++) {
+                    _xw_tiles_halve(block + (size_t)(2 * y) * 2 * XW_TILE,
+                                    block + (size_t)(2 * y + 1) * 2 * XW_TILE, tile + y * XW_TILE);
+                }
+            }
+        }
+    }
+    free(block);
+    msync(tiles->pyramid, tiles->pyramid_size, MS_SYNC);
+    ((_xw_tiles_header*)tiles->pyramid)->complete = 1;
+    return true;
+}
+
+// Maps the pyramid file, builds it when it is missing or out of date
+static bool _xw_tiles_open_pyramid(xw_tiles* tiles, const char* path, const struct stat* source)
+{
+    tiles->pyramid_fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (tiles->pyramid_fd == -1) {
+        fprintf(stderr, "ERROR: could not open the pyramid '%s'\n", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(tiles->pyramid_fd, &st) == -1) {
+        fprintf(stderr, "ERROR: could not read the pyramid '%s'\n", path);
+        return false;
+    }
+    const bool resize = (size_t)st.st_size != tiles->pyramid_size;
+    if (resize && ftruncate(tiles->pyramid_fd, 0) == -1) {
+        fprintf(stderr, "ERROR: could not size the pyramid '%s'\n", path);
+        return false;
+    }
+    if (resize && ftruncate(tiles->pyramid_fd, tiles->pyramid_size) == -1) {
+        fprintf(stderr, "ERROR: could not size the pyramid '%s'\n", path);
+        return false;
+    }
+    void* map = mmap(NULL, tiles->pyramid_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     tiles->pyramid_fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "ERROR: could not map the pyramid '%s'\n", path);
+        return false;
+    }
+    tiles->pyramid = (uint8_t*)map;
+
+    _xw_tiles_header* header = (_xw_tiles_header*)tiles->pyramid;
+    const _xw_tiles_header current = {
+        .magic        = XW_TILES_MAGIC,
+        .width        = tiles->width[0],
+        .height       = tiles->height[0],
+        .levels       = tiles->levels,
+        .complete     = 1,
+        .source_size  = source->st_size,
+        .source_mtime = source->st_mtime,
+    };
+    if (memcmp(header, &current, sizeof(current)) == 0) {
+        return true;
+    }
+    *header          = current;
+    header->complete = 0;
+    return _xw_tiles_build(tiles);
+}
+
+static _xw_tile_slot* _xw_tiles_find(xw_tiles* tiles, uint64_t key, bool loading)
+{
+    for (size_t i = 0; i < tiles->slots_len; i++) {
+        if (tiles->slots[i].key == key && (loading || !tiles->slots[i].loading)) {
+            return &tiles->slots[i];
+        }
+    }
+    return NULL;
+}
+
+// The least recently used slot that the current frame does not use
+static _xw_tile_slot* _xw_tiles_victim(xw_tiles* tiles)
+{
+    _xw_tile_slot* victim = NULL;
+    for (size_t i = 0; i < tiles->slots_len; i++) {
+        _xw_tile_slot* slot = &tiles->slots[i];
+        if (slot->loading || (slot->key != _XW_TILE_EMPTY && slot->last_used >= tiles->frame)) {
+            continue;
+        }
+        if (slot->key == _XW_TILE_EMPTY) {
+            return slot;
+        }
+        victim = victim == NULL || slot->last_used < victim->last_used ? slot : victim;
+    }
+    return victim;
+}
+
+static void _xw_tiles_fill(const xw_tiles* tiles, uint64_t key, uint32_t* pixels)
+{
+    const int level   = key >> 48;
+    const uint32_t ty = (key >> 24) & 0xFFFFFF;
+    const uint32_t tx = key & 0xFFFFFF;
+    if (level == 0) {
+        _xw_tiles_copy(tiles, 0, tx * XW_TILE, ty * XW_TILE, XW_TILE, XW_TILE, pixels, XW_TILE);
+    } else {
+        memcpy(pixels, _xw_tiles_pyramid_tile(tiles, level, tx, ty),
+               sizeof(uint32_t) * XW_TILE * XW_TILE);
+    }
+}
+
+static inline void _xw_tiles_lock(xw_tiles* tiles)
+{
+#ifdef XWRAP_THREADS
+    pthread_mutex_lock(&tiles->lock);
+#else
+    (void)tiles;
+#endif // XWRAP_THREADS
+}
+
+static inline void _xw_tiles_unlock(xw_tiles* tiles)
+{
+#ifdef XWRAP_THREADS
+    pthread_mutex_unlock(&tiles->lock);
+#else
+    (void)tiles;
+#endif // XWRAP_THREADS
+}
+
+#ifdef XWRAP_THREADS
+// Copies the wanted tiles into the cache, the page faults of the files happen here
+static void* _xw_tiles_prefetch(void* arg)
+{
+    xw_tiles* tiles = (xw_tiles*)arg;
+    pthread_mutex_lock(&tiles->lock);
+    while (!tiles->stop) {
+        if (tiles->wanted_next == tiles->wanted_len) {
+            pthread_cond_wait(&tiles->wake, &tiles->lock);
+            continue;
+        }
+        const uint64_t key = tiles->wanted[tiles->wanted_next++];
+        if (_xw_tiles_find(tiles, key, true) != NULL) {
+            continue;
+        }
+        _xw_tile_slot* slot = _xw_tiles_victim(tiles);
+        if (slot == NULL) {
+            tiles->wanted_next = tiles->wanted_len; // The cache is full of visible tiles
+            continue;
+        }
+        slot->key       = key;
+        slot->loading   = true;
+        slot->last_used = tiles->frame;
+        pthread_mutex_unlock(&tiles->lock);
+        _xw_tiles_fill(tiles, key, slot->pixels);
+        pthread_mutex_lock(&tiles->lock);
+        slot->loading = false;
+    }
+    pthread_mutex_unlock(&tiles->lock);
+    return NULL;
+}
+#endif // XWRAP_THREADS
+
+// Asks for a tile that is not cached, the most wanted first
+static void _xw_tiles_want(xw_tiles* tiles, int level, int64_t tx, int64_t ty)
+{
+    if (tx < 0 || ty < 0 || tx >= _xw_tiles_across(tiles, level) ||
+        ty >= _xw_tiles_down(tiles, level)) {
+        return;
+    }
+    const uint64_t key = _XW_TILE_KEY(level, tx, ty);
+#ifdef XWRAP_THREADS
+    if (tiles->wanted_len < XW_TILES_PREFETCH && _xw_tiles_find(tiles, key, true) == NULL) {
+        tiles->wanted[tiles->wanted_len++] = key;
+    }
+#else
+    // The kernel reads the pyramid tiles ahead, the rows of the image are too scattered for it
+    if (level > 0 && _xw_tiles_find(tiles, key, false) == NULL) {
+        const uintptr_t page  = sysconf(_SC_PAGESIZE);
+        const uintptr_t start = (uintptr_t)_xw_tiles_pyramid_tile(tiles, level, tx, ty);
+        madvise((void*)(start & ~(page - 1)), sizeof(uint32_t) * XW_TILE * XW_TILE + page,
+                MADV_WILLNEED);
+    }
+#endif // XWRAP_THREADS
+}
+
+XW_DEF xw_tiles* xw_tiles_open(const char* path, uint32_t width, uint32_t height, size_t stride,
+                               const char* pyramid_path, size_t cache_mb)
+{
+    xw_tiles* tiles = (xw_tiles*)calloc(1, sizeof(xw_tiles));
+    if (tiles == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        return NULL;
+    }
+    tiles->pyramid_fd = -1;
+    tiles->stride     = stride != 0 ? stride : (size_t)width * sizeof(uint32_t);
+    tiles->fd         = open(path, O_RDONLY);
+    struct stat source;
+    if (tiles->fd == -1 || fstat(tiles->fd, &source) == -1 || width == 0 || height == 0 ||
+        (size_t)source.st_size < tiles->stride * (height - 1) + (size_t)width * sizeof(uint32_t)) {
+        fprintf(stderr, "ERROR: '%s' is not a %ux%u image\n", path, width, height);
+        xw_tiles_close(tiles);
+        return NULL;
+    }
+    tiles->raw_size = source.st_size;
+    void* raw       = mmap(NULL, tiles->raw_size, PROT_READ, MAP_SHARED, tiles->fd, 0);
+    if (raw == MAP_FAILED) {
+        fprintf(stderr, "ERROR: could not map '%s'\n", path);
+        xw_tiles_close(tiles);
+        return NULL;
+    }
+    tiles->raw = (const uint8_t*)raw;
+
+    // Halve until a tile holds the level
+    tiles->levels    = 1;
+    tiles->width[0]  = width;
+    tiles->height[0] = height;
+    size_t offset    = XW_TILES_HEADER;
+    while (pyramid_path != NULL && tiles->levels < XW_TILES_LEVELS &&
+           (tiles->width[tiles->levels - 1] > XW_TILE ||
+            tiles->height[tiles->levels - 1] > XW_TILE)) {
+        const int level      = tiles->levels++;
+        tiles->width[level]  = (tiles->width[level - 1] + 1) / 2;
+        tiles->height[level] = (tiles->height[level - 1] + 1) / 2;
+        tiles->offset[level] = offset;
+        offset += sizeof(uint32_t) * XW_TILE * XW_TILE * _xw_tiles_across(tiles, level) *
+                  _xw_tiles_down(tiles, level);
+    }
+    tiles->pyramid_size = offset;
+    if (tiles->levels > 1 && !_xw_tiles_open_pyramid(tiles, pyramid_path, &source)) {
+        xw_tiles_close(tiles);
+        return NULL;
+    }
+
+    tiles->slots_len = cache_mb * 1024 * 1024 / (sizeof(uint32_t) * XW_TILE * XW_TILE);
+    tiles->slots_len = tiles->slots_len > 4 ? tiles->slots_len : 4;
+    tiles->slots     = (_xw_tile_slot*)calloc(tiles->slots_len, sizeof(_xw_tile_slot));
+    tiles->cache     = (uint32_t*)malloc(sizeof(uint32_t) * XW_TILE * XW_TILE * tiles->slots_len);
+    tiles->scratch   = (uint32_t*)malloc(sizeof(uint32_t) * XW_TILE * XW_TILE);
+    if (tiles->slots == NULL || tiles->cache == NULL || tiles->scratch == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        xw_tiles_close(tiles);
+        return NULL;
+    }
+    for (size_t i = 0; i < tiles->slots_len; i++) {
+        tiles->slots[i].key    = _XW_TILE_EMPTY;
+        tiles->slots[i].pixels = tiles->cache + i * XW_TILE * XW_TILE;
+    }
+
+#ifdef XWRAP_THREADS
+    pthread_mutex_init(&tiles->lock, NULL);
+    pthread_cond_init(&tiles->wake, NULL);
+    if (pthread_create(&tiles->prefetcher, NULL, _xw_tiles_prefetch, tiles) != 0) {
+        fprintf(stderr, "ERROR: could not start the prefetch thread\n");
+        pthread_mutex_destroy(&tiles->lock);
+        pthread_cond_destroy(&tiles->wake);
+        xw_tiles_close(tiles);
+        return NULL;
+    }
+    tiles->started = true;
+#endif // XWRAP_THREADS
+    return tiles;
+}
+
+XW_DEF void xw_tiles_close(xw_tiles* tiles)
+{
+#ifdef XWRAP_THREADS
+    if (tiles->started) {
+        pthread_mutex_lock(&tiles->lock);
+        tiles->stop = true;
+        pthread_cond_signal(&tiles->wake);
+        pthread_mutex_unlock(&tiles->lock);
+        pthread_join(tiles->prefetcher, NULL);
+        pthread_mutex_destroy(&tiles->lock);
+        pthread_cond_destroy(&tiles->wake);
+    }
+#endif // XWRAP_THREADS
+    if (tiles->pyramid != NULL) {
+        munmap(tiles->pyramid, tiles->pyramid_size);
+    }
+    if (tiles->pyramid_fd != -1) {
+        close(tiles->pyramid_fd);
+    }
+    if (tiles->raw != NULL) {
+        munmap((void*)tiles->raw, tiles->raw_size);
+    }
+    if (tiles->fd != -1) {
+        close(tiles->fd);
+    }
+    free(tiles->slots);
+    free(tiles->cache);
+    free(tiles->scratch);
+    free(tiles->columns);
+    free(tiles);
+}
+
+// Nearest samples of a cached tile into a rectangle of the surface
+static void _xw_tiles_blit(xw_tiles* tiles, const _xw_surface* surface, const uint32_t* tile,
+                           int level, uint32_t tx, uint32_t ty, double x, double y, double zoom,
+                           xw_rect dest)
+{
+    // Level pixels per surface pixel, sampled at the center of the surface pixels
+    const double step    = 1.0 / (zoom * ((uint64_t)1 << level));
+    const double level_x = x / ((uint64_t)1 << level) - (double)tx * XW_TILE;
+    const double level_y = y / ((uint64_t)1 << level) - (double)ty * XW_TILE;
+    for (unsigned int i = 0; i < dest.width; i++) {
+        const int64_t column = _xw_floor(level_x + (dest.x + i + 0.5) * step);
+        tiles->columns[i]    = column < 0 ? 0 : (column >= XW_TILE ? XW_TILE - 1 : column);
+    }
+    for (unsigned int j = 0; j < dest.height; j++) {
+        int64_t row         = _xw_floor(level_y + (dest.y + j + 0.5) * step);
+        row                 = row < 0 ? 0 : (row >= XW_TILE ? XW_TILE - 1 : row);
+        const uint32_t* src = tile + row * XW_TILE;
+        uint32_t* out       = surface->pixels + (size_t)(dest.y + j) * surface->stride + dest.x;
+        for (unsigned int i = 0; i < dest.width; i++) {
+            out[i] = src[tiles->columns[i]];
+        }
+    }
+}
 
-    return XFillPolygon(handle->display, handle->window, handle->gc, points, npoints, shape, mode);
+// The surface pixels whose centers fall in [from, to) of the image
+static inline void _xw_tiles_span(double view, double zoom, double from, double to, int limit,
+                                  int* first, int* end)
+{
+    const int64_t a = _xw_ceil((from - view) * zoom - 0.5);
+    const int64_t b = _xw_ceil((to - view) * zoom - 0.5);
+    *first          = a < 0 ? 0 : (a > limit ? limit : a);
+    *end            = b < 0 ? 0 : (b > limit ? limit : b);
 }
 
-XW_DEF int xw_event_pending(xw_handle* handle)
+XW_DEF bool xw_draw_tiles(xw_handle* handle, xw_tiles* tiles, double x, double y, double zoom)
 {
-    return XPending(handle->display);
+    _XW_TRACE_CLOCK(start);
+    _xw_surface surface;
+    if (!_xw_image_surface(handle, &surface)) {
+        return false;
+    }
+    if (zoom <= 0) {
+        fprintf(stderr, "ERROR: zoom must be positive\n");
+        return false;
+    }
+    if (tiles->columns_len < (size_t)surface.width) {
+        free(tiles->columns);
+        tiles->columns     = (int*)malloc(sizeof(int) * surface.width);
+        tiles->columns_len = tiles->columns != NULL ? surface.width : 0;
+        if (tiles->columns == NULL) {
+            fprintf(stderr, "ERROR: Buy more ram\n");
+            return false;
+        }
+    }
+
+    // The level with at most one of its pixels per surface pixel
+    int level = 0;
+    while (level + 1 < tiles->levels && zoom * ((uint64_t)2 << level) <= 1) {
+        level++;
+    }
+
+    // Clear around the image
+    int image_x0, image_x1, image_y0, image_y1;
+    _xw_tiles_span(x, zoom, 0, tiles->width[0], surface.width, &image_x0, &image_x1);
+    _xw_tiles_span(y, zoom, 0, tiles->height[0], surface.height, &image_y0, &image_y1);
+    for (int j = 0; j < surface.height; j++) {
+        uint32_t* row = surface.pixels + (size_t)j * surface.stride;
+        if (j < image_y0 || j >= image_y1) {
+            memset(row, 0, sizeof(uint32_t) * surface.width);
+            continue;
+        }
+        memset(row, 0, sizeof(uint32_t) * image_x0);
+        memset(row + image_x1, 0, sizeof(uint32_t) * (surface.width - image_x1));
+    }
+
+    const double size = (double)XW_TILE * ((uint64_t)1 << level); // Image pixels per tile
+    const int64_t tx0 = _xw_floor(x / size);
+    const int64_t ty0 = _xw_floor(y / size);
+    const int64_t tx1 = _xw_floor((x + surface.width / zoom) / size);
+    const int64_t ty1 = _xw_floor((y + surface.height / zoom) / size);
+
+    _xw_tiles_lock(tiles);
+    tiles->frame++;
+#ifdef XWRAP_THREADS
+    tiles->wanted_len  = 0;
+    tiles->wanted_next = 0;
+#endif // XWRAP_THREADS
+    for (int64_t ty = ty0 < 0 ? 0 : ty0; ty <= ty1 && ty < _xw_tiles_down(tiles, level); ty++) {
+        for (int64_t tx = tx0 < 0 ? 0 : tx0; tx <= tx1 && tx < _xw_tiles_across(tiles, level);
+             tx++) {
+            int dx0, dx1, dy0, dy1;
+            const double right  = (tx + 1) * size < tiles->width[0] ? (tx + 1) * size
+                                                                    : tiles->width[0];
+            const double bottom = (ty + 1) * size < tiles->height[0] ? (ty + 1) * size
+                                                                     : tiles->height[0];
+            _xw_tiles_span(x, zoom, tx * size, right, surface.width, &dx0, &dx1);
+            _xw_tiles_span(y, zoom, ty * size, bottom, surface.height, &dy0, &dy1);
+            if (dx0 >= dx1 || dy0 >= dy1) {
+                continue;
+            }
+            const xw_rect dest = {.x = dx0, .y = dy0, .width = dx1 - dx0, .height = dy1 - dy0};
+
+            _xw_tile_slot* slot = _xw_tiles_find(tiles, _XW_TILE_KEY(level, tx, ty), false);
+            if (slot != NULL) {
+                slot->last_used = tiles->frame;
+                _xw_tiles_blit(tiles, &surface, slot->pixels, level, tx, ty, x, y, zoom, dest);
+                continue;
+            }
+#ifdef XWRAP_THREADS
+            // Stand in with a smaller level until the prefetch thread has the tile
+            _xw_tiles_want(tiles, level, tx, ty);
+            for (int up = level + 1; up < tiles->levels && slot == NULL; up++) {
+                const int shift = up - level;
+                slot = _xw_tiles_find(tiles, _XW_TILE_KEY(up, tx >> shift, ty >> shift), false);
+                if (slot != NULL) {
+                    slot->last_used = tiles->frame;
+                    _xw_tiles_blit(tiles, &surface, slot->pixels, up, tx >> shift, ty >> shift, x,
+                                   y, zoom, dest);
+                }
+            }
+            if (slot != NULL) {
+                continue;
+            }
+#endif // XWRAP_THREADS
+            slot               = _xw_tiles_victim(tiles);
+            const uint64_t key = _XW_TILE_KEY(level, tx, ty);
+            uint32_t* pixels   = slot != NULL ? slot->pixels : tiles->scratch;
+            _xw_tiles_fill(tiles, key, pixels);
+            if (slot != NULL) {
+                slot->key       = key;
+                slot->last_used = tiles->frame;
+            }
+            _xw_tiles_blit(tiles, &surface, pixels, level, tx, ty, x, y, zoom, dest);
+        }
+    }
+
+    // The ring around the view for panning, and the next level for zooming out
+    for (int64_t tx = tx0 - 1; tx <= tx1 + 1; tx++) {
+        _xw_tiles_want(tiles, level, tx, ty0 - 1);
+        _xw_tiles_want(tiles, level, tx, ty1 + 1);
+    }
+    for (int64_t ty = ty0; ty <= ty1; ty++) {
+        _xw_tiles_want(tiles, level, tx0 - 1, ty);
+        _xw_tiles_want(tiles, level, tx1 + 1, ty);
+    }
+    if (level + 1 < tiles->levels) {
+        for (int64_t ty = ty0 >> 1; ty <= ty1 >> 1; ty++) {
+            for (int64_t tx = tx0 >> 1; tx <= tx1 >> 1; tx++) {
+                _xw_tiles_want(tiles, level + 1, tx, ty);
+            }
+        }
+    }
+#ifdef XWRAP_THREADS
+    pthread_cond_signal(&tiles->wake);
+#endif // XWRAP_THREADS
+    _xw_tiles_unlock(tiles);
+    _XW_TRACE("tiles", start, handle);
+    return true;
 }
+/* Command buffers */
+#define XW_CMD_CHUNK (64 * 1024)
+#define XW_CMD_BATCH 1024 // Shapes per request when consecutive commands share the state
 
-XW_DEF bool xw_get_next_event(xw_handle* handle, xw_event* event)
+typedef enum {
+    _XW_CMD_TEXT,
+    _XW_CMD_RECTANGLE,
+    _XW_CMD_FILL_RECTANGLE,
+    _XW_CMD_LINE,
+    _XW_CMD_CIRCLE,
+    _XW_CMD_FILL_CIRCLE,
+    _XW_CMD_PIXEL,
+    _XW_CMD_TRIANGLE,
+} _xw_cmd_type;
+
+typedef struct {
+    uint16_t type;
+    uint16_t size; // Of the command with its text, keeps the next one aligned
+    uint32_t color;
+    int32_t args[6];
+    // The text follows
+} _xw_cmd;
+
+typedef struct _xw_cmd_chunk {
+    struct _xw_cmd_chunk* next;
+    size_t used;
+    uint8_t data[XW_CMD_CHUNK];
+} _xw_cmd_chunk;
+
+// Chunks are kept when reset, a warm arena does not allocate
+typedef struct {
+    _xw_cmd_chunk* first;
+    _xw_cmd_chunk* current;
+} _xw_cmd_arena;
+
+struct _xw_cmdbuf {
+    xw_handle* handle;
+    int order;
+    _xw_cmd_arena arenas[2];
+    int recording;    // The arena of the recording thread
+    uint32_t pending; // Futex, 1 + the arena waiting for 'xw_draw', 0 when none
+    xw_cmdbuf* next;
+};
+
+static _xw_cmd* _xw_cmd_alloc(xw_cmdbuf* cmdbuf, _xw_cmd_type type, uint32_t color, size_t text)
 {
-    XEvent* Xevent = (XEvent*)event->original_event;
-    bool ret       = XNextEvent(handle->display, Xevent);
-    event->type    = Xevent->type;
+    const size_t size    = (sizeof(_xw_cmd) + text + 7) & ~(size_t)7;
+    _xw_cmd_arena* arena = &cmdbuf->arenas[cmdbuf->recording];
+    if (size > XW_CMD_CHUNK) {
+        fprintf(stderr, "ERROR: command of %zu bytes is too big\n", size);
+        return NULL;
+    }
+    if (arena->current == NULL || arena->current->used + size > XW_CMD_CHUNK) {
+        _xw_cmd_chunk* chunk = arena->current != NULL ? arena->current->next : arena->first;
+        if (chunk == NULL) {
+            chunk = (_xw_cmd_chunk*)malloc(sizeof(_xw_cmd_chunk));
+            if (chunk == NULL) {
+                fprintf(stderr, "ERROR: Buy more ram\n");
+                return NULL;
+            }
+            chunk->next = NULL;
+            if (arena->current != NULL) {
+                arena->current->next = chunk;
+            } else {
+                arena->first = chunk;
+            }
+        }
+        chunk->used    = 0;
+        arena->current = chunk;
+    }
+    _xw_cmd* cmd = (_xw_cmd*)(arena->current->data + arena->current->used);
+    arena->current->used += size;
+    cmd->type  = type;
+    cmd->size  = size;
+    cmd->color = color;
+    return cmd;
+}
 
-    switch (event->type) {
-        case MotionNotify:
-        case ButtonRelease:
-        case ButtonPress: {
-            event->mouse.button = Xevent->xbutton.button;
-            event->mouse.x      = Xevent->xbutton.x;
-            event->mouse.y      = Xevent->xbutton.y;
-            event->mouse.y_root = Xevent->xbutton.y_root;
-            event->mouse.x_root = Xevent->xbutton.x_root;
-        } break;
+static inline _xw_cmd* _xw_cmd_next(_xw_cmd_chunk** chunk, _xw_cmd* cmd)
+{
+    uint8_t* next = (uint8_t*)cmd + cmd->size;
+    if (next < (*chunk)->data + (*chunk)->used) {
+        return (_xw_cmd*)next;
+    }
+    // Chunks after the last used one are empty
+    *chunk = (*chunk)->next;
+    return *chunk != NULL && (*chunk)->used > 0 ? (_xw_cmd*)(*chunk)->data : NULL;
+}
 
-        case KeyPress:
-        case KeyRelease: {
-            event->button.key_code = Xevent->xkey.keycode;
-        } break;
+XW_DEF xw_cmdbuf* xw_cmdbuf_create(xw_handle* handle, int order)
+{
+    xw_cmdbuf* cmdbuf = (xw_cmdbuf*)calloc(1, sizeof(xw_cmdbuf));
+    if (cmdbuf == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        return NULL;
+    }
+    cmdbuf->handle = handle;
+    cmdbuf->order  = order;
 
-        default:
-            fprintf(stderr, __FILE__ ":%d WARNING: unreachable code\n", __LINE__);
+    // Sorted by order, after the buffers of the same order
+    xw_cmdbuf** at = &handle->cmdbufs;
+    while (*at != NULL && (*at)->order <= order) {
+        at = &(*at)->next;
+    }
+    cmdbuf->next = *at;
+    *at          = cmdbuf;
+    return cmdbuf;
+}
+
+XW_DEF void xw_cmdbuf_free(xw_cmdbuf* cmdbuf)
+{
+    for (xw_cmdbuf** at = &cmdbuf->handle->cmdbufs; *at != NULL; at = &(*at)->next) {
+        if (*at == cmdbuf) {
+            *at = cmdbuf->next;
             break;
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        for (_xw_cmd_chunk* chunk = cmdbuf->arenas[i].first; chunk != NULL;) {
+            _xw_cmd_chunk* next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
     }
+    free(cmdbuf);
+}
 
-    return ret;
+XW_DEF void xw_cmdbuf_submit(xw_cmdbuf* cmdbuf)
+{
+    uint32_t pending;
+    while ((pending = __atomic_load_n(&cmdbuf->pending, __ATOMIC_ACQUIRE)) != 0) {
+        syscall(SYS_futex, &cmdbuf->pending, FUTEX_WAIT_PRIVATE, pending, NULL, NULL, 0);
+    }
+    __atomic_store_n(&cmdbuf->pending, 1 + cmdbuf->recording, __ATOMIC_RELEASE);
+    // 'xw_draw' reset the other arena before it cleared 'pending'
+    cmdbuf->recording ^= 1;
 }
 
-XW_DEF bool xw_push_back_event(xw_handle* handle, xw_event event)
+XW_DEF bool xw_cmd_text(xw_cmdbuf* cmdbuf, int x, int y, const char* string, uint32_t color)
 {
-    return XPutBackEvent(handle->display, (XEvent*)event.original_event);
+    const size_t length = strlen(string);
+    _xw_cmd* cmd        = _xw_cmd_alloc(cmdbuf, _XW_CMD_TEXT, color, length + 1);
+    if (cmd == NULL) {
+        return false;
+    }
+    cmd->args[0] = x;
+    cmd->args[1] = y;
+    cmd->args[2] = length;
+    memcpy(cmd + 1, string, length + 1);
+    return true;
 }
 
-XW_DEF xw_dimensions xw_get_dimensions(xw_handle* handle)
+XW_DEF bool xw_cmd_rectangle(xw_cmdbuf* cmdbuf, int x, int y, unsigned int width,
+                             unsigned int height, bool fill, uint32_t color)
 {
-    XWindowAttributes window_attributes_return = {0};
-    XGetWindowAttributes(handle->display, handle->window, &window_attributes_return);
+    _xw_cmd* cmd =
+        _xw_cmd_alloc(cmdbuf, fill ? _XW_CMD_FILL_RECTANGLE : _XW_CMD_RECTANGLE, color, 0);
+    if (cmd == NULL) {
+        return false;
+    }
+    cmd->args[0] = x;
+    cmd->args[1] = y;
+    cmd->args[2] = width;
+    cmd->args[3] = height;
+    return true;
+}
 
-    xw_dimensions ret = {.width  = window_attributes_return.width,
-                         .height = window_attributes_return.height,
-                         .x_pos  = window_attributes_return.x,
-                         .y_pos  = window_attributes_return.y};
-    return ret;
+XW_DEF bool xw_cmd_line(xw_cmdbuf* cmdbuf, int x0, int y0, int x1, int y1, uint16_t width,
+                        uint32_t color)
+{
+    _xw_cmd* cmd = _xw_cmd_alloc(cmdbuf, _XW_CMD_LINE, color, 0);
+    if (cmd == NULL) {
+        return false;
+    }
+    cmd->args[0] = x0;
+    cmd->args[1] = y0;
+    cmd->args[2] = x1;
+    cmd->args[3] = y1;
+    cmd->args[4] = width;
+    return true;
 }
 
-XW_DEF void xw_sleep_us(unsigned long nanoseconds)
+XW_DEF bool xw_cmd_circle(xw_cmdbuf* cmdbuf, int x, int y, int r, bool fill, uint32_t color)
 {
-    struct timespec ts;
-    ts.tv_sec  = nanoseconds / 1000000ul;
-    ts.tv_nsec = (nanoseconds % 1000000ul) * 1000;
-    nanosleep(&ts, NULL);
+    _xw_cmd* cmd = _xw_cmd_alloc(cmdbuf, fill ? _XW_CMD_FILL_CIRCLE : _XW_CMD_CIRCLE, color, 0);
+    if (cmd == NULL) {
+        return false;
+    }
+    cmd->args[0] = x;
+    cmd->args[1] = y;
+    cmd->args[2] = r;
+    return true;
 }
 
-XW_DEF void xw_sleep_ms(unsigned long milliseconds)
+XW_DEF bool xw_cmd_pixel(xw_cmdbuf* cmdbuf, int x, int y, uint32_t color)
 {
-    xw_sleep_us(1000 * milliseconds);
+    _xw_cmd* cmd = _xw_cmd_alloc(cmdbuf, _XW_CMD_PIXEL, color, 0);
+    if (cmd == NULL) {
+        return false;
+    }
+    cmd->args[0] = x;
+    cmd->args[1] = y;
+    return true;
 }
 
-XW_DEF bool xw_wait_for_esc(xw_handle* handle, uint64_t timeout)
+XW_DEF bool xw_cmd_triangle(xw_cmdbuf* cmdbuf, int x0, int y0, int x1, int y1, int x2, int y2,
+                            uint32_t color)
 {
-    uint64_t total = 0;
-    uint64_t wait  = 50;
-    if (timeout > wait && timeout != 0) {
-        wait = timeout;
+    _xw_cmd* cmd = _xw_cmd_alloc(cmdbuf, _XW_CMD_TRIANGLE, color, 0);
+    if (cmd == NULL) {
+        return false;
     }
+    cmd->args[0] = x0;
+    cmd->args[1] = y0;
+    cmd->args[2] = x1;
+    cmd->args[3] = y1;
+    cmd->args[4] = x2;
+    cmd->args[5] = y2;
+    return true;
+}
 
-    for (;;) {
-        bool found_event        = false;
-        const int event_pending = xw_event_pending(handle);
-        xw_event events[event_pending];
-        size_t pos = 0;
-        for (size_t i = 0; i < event_pending; i++) {
-            xw_get_next_event(handle, &events[pos]);
-            if (events[pos].type == KeyPress && events[pos].button.key_code == 9) {
-                found_event = true;
+// Runs of filled rectangles, pixels and lines of one color and width become one request each
+static _xw_cmd* _xw_cmd_batch(xw_handle* handle, _xw_cmd_chunk** chunk, _xw_cmd* cmd)
+{
+    union {
+        XRectangle rectangles[XW_CMD_BATCH];
+        XPoint points[XW_CMD_BATCH];
+        XSegment segments[XW_CMD_BATCH];
+    } batch;
+    const _xw_cmd first = *cmd;
+    int count           = 0;
+    for (; cmd != NULL && count < XW_CMD_BATCH; cmd = _xw_cmd_next(chunk, cmd)) {
+        if (cmd->type != first.type || cmd->color != first.color ||
+            (first.type == _XW_CMD_LINE && cmd->args[4] != first.args[4])) {
+            break;
+        }
+        const int32_t* a = cmd->args;
+        switch (first.type) {
+            case _XW_CMD_FILL_RECTANGLE:
+                batch.rectangles[count++] =
+                    (XRectangle){.x = a[0], .y = a[1], .width = a[2], .height = a[3]};
+                break;
+            case _XW_CMD_PIXEL:
+                batch.points[count++] = (XPoint){.x = a[0], .y = a[1]};
+                break;
+            default:
+                batch.segments[count++] =
+                    (XSegment){.x1 = a[0], .y1 = a[1], .x2 = a[2], .y2 = a[3]};
                 break;
-            } else {
-                pos++;
-            }
         }
-        // put back on the event stack - (in the doc they said queue but...)
-        for (int i = pos - 1; i >= 0; i--) {
-            xw_push_back_event(handle, events[i]);
+    }
+
+    XSetForeground(handle->display, handle->gc, first.color);
+    switch (first.type) {
+        case _XW_CMD_FILL_RECTANGLE:
+            _XW_STAT_ADD(handle, requests[XW_STAT_RECTANGLE], 1);
+            XFillRectangles(handle->display, handle->window, handle->gc, batch.rectangles, count);
+            break;
+        case _XW_CMD_PIXEL:
+            _XW_STAT_ADD(handle, requests[XW_STAT_PIXEL], 1);
+            XDrawPoints(handle->display, handle->window, handle->gc, batch.points, count,
+                        CoordModeOrigin);
+            break;
+        default:
+            _XW_STAT_ADD(handle, requests[XW_STAT_LINE], 1);
+            XSetLineAttributes(handle->display, handle->gc, first.args[4], LineSolid, CapButt,
+                               JoinMiter);
+            XDrawSegments(handle->display, handle->window, handle->gc, batch.segments, count);
+            break;
+    }
+    return cmd;
+}
+
+static void _xw_cmdbuf_replay(xw_handle* handle, _xw_cmd_arena* arena)
+{
+    _xw_cmd_chunk* chunk = arena->first;
+    _xw_cmd* cmd         = chunk != NULL && chunk->used > 0 ? (_xw_cmd*)chunk->data : NULL;
+    while (cmd != NULL) {
+        const int32_t* a = cmd->args;
+        switch (cmd->type) {
+            case _XW_CMD_FILL_RECTANGLE:
+            case _XW_CMD_PIXEL:
+            case _XW_CMD_LINE:
+                cmd = _xw_cmd_batch(handle, &chunk, cmd);
+                continue;
+            case _XW_CMD_TEXT:
+                xw_draw_text(handle, a[0], a[1], (char*)(cmd + 1), cmd->color);
+                break;
+            case _XW_CMD_RECTANGLE:
+                xw_draw_rectangle(handle, a[0], a[1], a[2], a[3], false, cmd->color);
+                break;
+            case _XW_CMD_CIRCLE:
+            case _XW_CMD_FILL_CIRCLE:
+                xw_draw_circle(handle, a[0], a[1], a[2], cmd->type == _XW_CMD_FILL_CIRCLE,
+                               cmd->color);
+                break;
+            case _XW_CMD_TRIANGLE:
+                xw_draw_triangle(handle, a[0], a[1], a[2], a[3], a[4], a[5], cmd->color);
+                break;
         }
-        if (found_event) {
-            return true;
+        cmd = _xw_cmd_next(&chunk, cmd);
+    }
+    for (chunk = arena->first; chunk != NULL; chunk = chunk->next) {
+        chunk->used = 0;
+    }
+    arena->current = NULL;
+}
+
+// Sends the submitted buffers in order, the recording threads do not wait on each other
+static void _xw_cmdbufs_replay(xw_handle* handle)
+{
+    for (xw_cmdbuf* cmdbuf = handle->cmdbufs; cmdbuf != NULL; cmdbuf = cmdbuf->next) {
+        const uint32_t pending = __atomic_load_n(&cmdbuf->pending, __ATOMIC_ACQUIRE);
+        if (pending == 0) {
+            continue;
         }
+        _xw_cmdbuf_replay(handle, &cmdbuf->arenas[pending - 1]);
+        __atomic_store_n(&cmdbuf->pending, 0, __ATOMIC_RELEASE);
+        syscall(SYS_futex, &cmdbuf->pending, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
 
-        xw_sleep_us(wait);
-        total += wait;
+/* Input */
+#define XW_INPUT_MAGIC 0x4E495758u // "XWIN"
 
-        if (total > timeout && timeout != 0) {
-            return false;
+typedef struct {
+    uint32_t magic;
+    uint32_t record_size; // Of '_xw_input_record', another size is another format
+} _xw_input_header;
+
+typedef struct {
+    uint64_t time_ns; // Since the start of the record
+    uint32_t poll;    // Empty 'xw_event_pending' calls before the event
+    int32_t type;
+    int32_t fields[6]; // Depend on the type
+} _xw_input_record;
+
+struct _xw_input {
+    bool replay;
+    bool realtime;
+    FILE* file;                // When recording
+    _xw_input_record* records; // When replaying, the whole log
+    size_t count;
+    size_t next;
+    uint64_t start_ns;
+    uint32_t polls; // 'xw_event_pending' calls that found nothing
+};
+
+static void _xw_input_encode(const xw_event* event, _xw_input_record* record)
+{
+    int32_t* fields = record->fields;
+    record->type    = event->type;
+    switch (event->type) {
+        case LeaveNotify:
+        case MotionNotify:
+        case ButtonRelease:
+        case ButtonPress:
+            fields[0] = event->mouse.button;
+            fields[1] = event->mouse.x;
+            fields[2] = event->mouse.y;
+            fields[3] = event->mouse.x_root;
+            fields[4] = event->mouse.y_root;
+            break;
+        case KeyPress:
+        case KeyRelease:
+            fields[0] = event->button.key_code;
+            break;
+        case Expose:
+            fields[0] = event->expose.rect.x;
+            fields[1] = event->expose.rect.y;
+            fields[2] = event->expose.rect.width;
+            fields[3] = event->expose.rect.height;
+            break;
+        case XW_EVENT_RESIZE:
+        case XW_EVENT_MOVE:
+            fields[0] = event->configure.dimensions.width;
+            fields[1] = event->configure.dimensions.height;
+            fields[2] = event->configure.dimensions.x_pos;
+            fields[3] = event->configure.dimensions.y_pos;
+            break;
+    }
+}
+
+static void _xw_input_decode(const _xw_input_record* record, xw_event* event)
+{
+    const int32_t* fields = record->fields;
+    memset(event, 0, sizeof(*event));
+    event->type = record->type;
+    switch (record->type) {
+        case LeaveNotify:
+        case MotionNotify:
+        case ButtonRelease:
+        case ButtonPress:
+            event->mouse.button = fields[0];
+            event->mouse.x      = fields[1];
+            event->mouse.y      = fields[2];
+            event->mouse.x_root = fields[3];
+            event->mouse.y_root = fields[4];
+            break;
+        case KeyPress:
+        case KeyRelease:
+            event->button.key_code = fields[0];
+            break;
+        case Expose:
+            event->expose.rect = (xw_rect){
+                .x = fields[0], .y = fields[1], .width = fields[2], .height = fields[3]};
+            break;
+        case XW_EVENT_RESIZE:
+        case XW_EVENT_MOVE:
+            event->configure.dimensions = (xw_dimensions){
+                .width = fields[0], .height = fields[1], .x_pos = fields[2], .y_pos = fields[3]};
+            break;
+    }
+}
+
+static int _xw_input_pending(xw_handle* handle)
+{
+    struct _xw_input* input = handle->input;
+    int pending             = 0;
+    if (!input->replay) {
+        pending = _xw_x_pending(handle);
+    } else {
+        // The X11 queue is still read to keep the real dimensions, its events are dropped
+        for (int i = _xw_x_pending(handle); i > 0; --i) {
+            xw_event dropped;
+            _xw_next_x_event(handle, &dropped);
+        }
+        const uint64_t now = _xw_now_ns() - input->start_ns;
+        for (size_t i = input->next; i < input->count; ++i) {
+            const _xw_input_record* record = &input->records[i];
+            if (input->realtime ? record->time_ns > now : record->poll > input->polls) {
+                break;
+            }
+            pending++;
+        }
+    }
+    // Counts the loops of the application, the fast replay gives each one its events
+    if (pending == 0 && handle->queue_len == 0) {
+        input->polls++;
+    }
+    return pending;
+}
+
+static bool _xw_input_next(xw_handle* handle, xw_event* event)
+{
+    struct _xw_input* input = handle->input;
+    if (!input->replay) {
+        const bool ret          = _xw_next_x_event(handle, event);
+        _xw_input_record record = {.time_ns = _xw_now_ns() - input->start_ns, .poll = input->polls};
+        _xw_input_encode(event, &record);
+        fwrite(&record, sizeof(record), 1, input->file);
+        return ret;
+    }
+
+    if (input->next == input->count) {
+        event->type = 0;
+        return false;
+    }
+    // Like 'XNextEvent', waits for an event that is not due yet
+    const _xw_input_record* record = &input->records[input->next++];
+    if (input->realtime) {
+        const uint64_t now = _xw_now_ns() - input->start_ns;
+        if (record->time_ns > now) {
+            xw_sleep_us((record->time_ns - now) / 1000);
+        }
+    } else if (record->poll > input->polls) {
+        input->polls = record->poll;
+    }
+    _xw_input_decode(record, event);
+    _XW_STAT_ADD(handle, events, 1);
+    return true;
+}
+
+XW_DEF bool xw_input_record_start(xw_handle* handle, const char* path)
+{
+    if (handle->input != NULL) {
+        fprintf(stderr, "ERROR: the input is already recorded or replayed\n");
+        return false;
+    }
+    struct _xw_input* input = (struct _xw_input*)calloc(1, sizeof(struct _xw_input));
+    if (input == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        return false;
+    }
+    input->file = fopen(path, "wb");
+    if (input->file == NULL) {
+        fprintf(stderr, "ERROR: could not open '%s'\n", path);
+        free(input);
+        return false;
+    }
+    const _xw_input_header header = {.magic       = XW_INPUT_MAGIC,
+                                     .record_size = sizeof(_xw_input_record)};
+    fwrite(&header, sizeof(header), 1, input->file);
+    input->start_ns = _xw_now_ns();
+    handle->input   = input;
+    return true;
+}
+
+XW_DEF bool xw_input_replay_start(xw_handle* handle, const char* path, bool realtime)
+{
+    if (handle->input != NULL) {
+        fprintf(stderr, "ERROR: the input is already recorded or replayed\n");
+        return false;
+    }
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: could not open '%s'\n", path);
+        return false;
+    }
+    _xw_input_header header;
+    struct stat info;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != XW_INPUT_MAGIC ||
+        header.record_size != sizeof(_xw_input_record) || fstat(fileno(file), &info) != 0) {
+        fprintf(stderr, "ERROR: '%s' is not an input log\n", path);
+        fclose(file);
+        return false;
+    }
+
+    // One more record, malloc may return NULL for an empty log
+    const size_t count        = (info.st_size - sizeof(header)) / sizeof(_xw_input_record);
+    struct _xw_input* input   = (struct _xw_input*)calloc(1, sizeof(struct _xw_input));
+    _xw_input_record* records = (_xw_input_record*)calloc(count + 1, sizeof(_xw_input_record));
+    if (input == NULL || records == NULL) {
+        fprintf(stderr, "ERROR: Buy more ram\n");
+        fclose(file);
+        free(input);
+        free(records);
+        return false;
+    }
+    if (fread(records, sizeof(_xw_input_record), count, file) != count) {
+        fprintf(stderr, "ERROR: could not read '%s'\n", path);
+        fclose(file);
+        free(input);
+        free(records);
+        return false;
+    }
+    fclose(file);
+
+    input->replay   = true;
+    input->realtime = realtime;
+    input->records  = records;
+    input->count    = count;
+    input->start_ns = _xw_now_ns();
+    handle->input   = input;
+    return true;
+}
+
+XW_DEF bool xw_input_replaying(xw_handle* handle)
+{
+    return handle->input != NULL && handle->input->replay &&
+           handle->input->next < handle->input->count;
+}
+
+XW_DEF bool xw_input_stop(xw_handle* handle)
+{
+    struct _xw_input* input = handle->input;
+    if (input == NULL) {
+        return true;
+    }
+    bool ok = true;
+    if (input->file != NULL) {
+        ok = !ferror(input->file);
+        ok = fclose(input->file) == 0 && ok;
+        if (!ok) {
+            fprintf(stderr, "ERROR: could not write the input log\n");
         }
     }
+    free(input->records);
+    free(input);
+    handle->input = NULL;
+    return ok;
 }
+
 #endif // XWRAP_IMPLEMENTATION
 
 #ifdef __cplusplus
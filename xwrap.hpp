@@ -0,0 +1,423 @@
+/* xwrap.hpp - C++17 front end of xwrap.h
+
+use example:
+
+    // The implementation stays C, build it in *one* C file:
+    //     #define XWRAP_IMPLEMENTATION
+    //     #include "xwrap.h"
+    #include "xwrap.hpp"
+
+    // The window frees itself and the image it owns
+    xw::window window("example", width, height);
+    window.connect(xw::image<xw::xrgb8888>(width, height));
+
+    // The format, blend and clipping are template arguments, the loops have no branches on them
+    xw::fill_rect<xw::xrgb8888, xw::blend_alpha>(window.pixels(), 10, 10, 100, 50, 0x80FF0000);
+    window.draw();
+
+    NOTE:
+        - Colors are always 0xAARRGGBB, the format packs them.
+        - With 'Clip' false the caller keeps the shapes inside the surface.
+        - The C API stays available on 'window.handle()'.
+
+  */
+#ifndef XWRAP_INCLUDE_HPP
+#define XWRAP_INCLUDE_HPP
+#include "xwrap.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace xw
+{
+
+// The X11 core types of 'xw_event', the declarations of xwrap.h do not include Xlib
+enum event_type {
+    key_press      = 2,
+    key_release    = 3,
+    button_press   = 4,
+    button_release = 5,
+    motion_notify  = 6,
+    leave_notify   = 8,
+    expose         = 12,
+};
+
+/* Pixel formats */
+
+// 0x00RRGGBB, the format of the window image
+struct xrgb8888 {
+    using pixel = uint32_t;
+    static constexpr pixel pack(uint32_t argb) { return argb & 0x00FFFFFF; }
+    static constexpr uint32_t unpack(pixel p) { return p | 0xFF000000; }
+};
+
+// 0xAARRGGBB with straight alpha, like the sprites of 'xw_atlas_add'
+struct argb8888 {
+    using pixel = uint32_t;
+    static constexpr pixel pack(uint32_t argb) { return argb; }
+    static constexpr uint32_t unpack(pixel p) { return p; }
+};
+
+// 5:6:5 bits, half the memory for offscreen layers
+struct rgb565 {
+    using pixel = uint16_t;
+    static constexpr pixel pack(uint32_t argb)
+    {
+        return (pixel)(((argb >> 8) & 0xF800) | ((argb >> 5) & 0x07E0) | ((argb >> 3) & 0x001F));
+    }
+    static constexpr uint32_t unpack(pixel p)
+    {
+        const uint32_t r = (p >> 11) & 0x1F;
+        const uint32_t g = (p >> 5) & 0x3F;
+        const uint32_t b = p & 0x1F;
+        return 0xFF000000 | (r << 3 | r >> 2) << 16 | (g << 2 | g >> 4) << 8 | (b << 3 | b >> 2);
+    }
+};
+
+/* Blend modes */
+
+// Each mode makes a functor from the color once, it is called for every pixel of the shape
+
+// Replaces the pixels
+struct blend_copy {
+    template <typename Format>
+    struct op {
+        typename Format::pixel packed;
+
+        explicit constexpr op(uint32_t color) : packed(Format::pack(color)) {}
+        constexpr typename Format::pixel operator()(typename Format::pixel) const { return packed; }
+    };
+};
+
+// Source over with the color alpha, rounds like 'xw_draw_sprites'
+struct blend_alpha {
+    template <typename Format>
+    struct op {
+        uint32_t rb, ag; // The color times its alpha, plus the rounding
+        uint32_t inverse;
+
+        explicit constexpr op(uint32_t color)
+            : rb((color & 0x00FF00FF) * (color >> 24) + 0x00800080),
+              ag((((color | 0xFF000000) >> 8) & 0x00FF00FF) * (color >> 24) + 0x00800080),
+              inverse(255 - (color >> 24))
+        {
+        }
+        // Two channels in each 32 bits, x / 255 is (x + (x >> 8)) >> 8 after the rounding
+        constexpr typename Format::pixel operator()(typename Format::pixel dst) const
+        {
+            const uint32_t d = Format::unpack(dst);
+            uint32_t lo      = (d & 0x00FF00FF) * inverse + rb;
+            uint32_t hi      = ((d >> 8) & 0x00FF00FF) * inverse + ag;
+            lo               = ((lo + ((lo >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+            hi               = (hi + ((hi >> 8) & 0x00FF00FF)) & 0xFF00FF00;
+            return Format::pack(lo | hi);
+        }
+    };
+};
+
+// Adds the color to the pixels, each channel saturates at 255
+struct blend_add {
+    template <typename Format>
+    struct op {
+        uint32_t rb, ag;
+
+        explicit constexpr op(uint32_t color)
+            : rb(color & 0x00FF00FF), ag((color >> 8) & 0x00FF00FF)
+        {
+        }
+        // A channel that carries into bit 8 becomes 0xFF
+        constexpr typename Format::pixel operator()(typename Format::pixel dst) const
+        {
+            const uint32_t d = Format::unpack(dst);
+            uint32_t lo      = (d & 0x00FF00FF) + rb;
+            uint32_t hi      = ((d >> 8) & 0x00FF00FF) + ag;
+            lo               = (lo | (0x01000100 - ((lo >> 8) & 0x00010001))) & 0x00FF00FF;
+            hi               = (hi | (0x01000100 - ((hi >> 8) & 0x00010001))) & 0x00FF00FF;
+            return Format::pack(lo | hi << 8);
+        }
+    };
+};
+
+/* Surfaces */
+
+template <typename Format>
+struct surface {
+    typename Format::pixel* pixels;
+    int width, height;
+    size_t stride; // In pixels
+
+    typename Format::pixel* row(int y) const { return pixels + (size_t)y * stride; }
+};
+
+/**
+ * @brief An image in memory, freed with the object
+ * @note The rows are padded to 64 bytes
+ */
+template <typename Format>
+class image
+{
+public:
+    image() = default;
+    image(int width, int height)
+        : stride_((((size_t)width * sizeof(pixel) + 63) & ~(size_t)63) / sizeof(pixel)),
+          pixels_(new (std::nothrow) pixel[stride_ * height]()), width_(width), height_(height)
+    {
+    }
+
+    explicit operator bool() const { return pixels_ != nullptr; }
+    surface<Format> view() const { return {pixels_.get(), width_, height_, stride_}; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+private:
+    using pixel = typename Format::pixel;
+
+    size_t stride_ = 0;
+    std::unique_ptr<pixel[]> pixels_;
+    int width_  = 0;
+    int height_ = 0;
+};
+
+/**
+ * @brief A window, freed with the object
+ * @note Moving keeps the handle and the pixels of the connected image
+ */
+class window
+{
+public:
+    window(const char* name, uint16_t width, uint16_t height)
+        : handle_(xw_create_window(name, width, height))
+    {
+    }
+    ~window()
+    {
+        if (handle_ != nullptr) {
+            xw_free_window(handle_);
+        }
+    }
+    window(window&& other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr)), image_(std::move(other.image_))
+    {
+    }
+    window& operator=(window&& other) noexcept
+    {
+        std::swap(handle_, other.handle_);
+        std::swap(image_, other.image_);
+        return *this;
+    }
+    window(const window&)            = delete;
+    window& operator=(const window&) = delete;
+
+    explicit operator bool() const { return handle_ != nullptr; }
+    xw_handle* handle() const { return handle_; }
+
+    /**
+     * @brief Connects the image, the window keeps it until it is freed
+     * @note The image must fit in 65535x65535, the limit of 'xw_image_connect_strided'
+     * @return bool true if OK, false if failed
+     */
+    bool connect(image<xrgb8888>&& connected)
+    {
+        const surface<xrgb8888> view = connected.view();
+        if (view.width > UINT16_MAX || view.height > UINT16_MAX) {
+            fprintf(stderr, "ERROR: image of %dx%d is too big\n", view.width, view.height);
+            return false;
+        }
+        if (!connected || !xw_image_connect_strided(handle_, view.pixels, view.width, view.height,
+                                                    view.stride * sizeof(uint32_t))) {
+            return false;
+        }
+        image_ = std::move(connected);
+        return true;
+    }
+    surface<xrgb8888> pixels() const { return image_.view(); }
+    bool draw() { return xw_draw(handle_); }
+
+    // 'xw_event_pending' and 'xw_get_next_event' in one call
+    bool poll(xw_event& event)
+    {
+        return xw_event_pending(handle_) > 0 && xw_get_next_event(handle_, &event);
+    }
+
+private:
+    xw_handle* handle_;
+    image<xrgb8888> image_;
+};
+
+/* Drawing */
+
+/**
+ * @brief Fills the pixels from x0 to x1 (excluded) of a row
+ */
+template <typename Format, typename Blend = blend_copy, bool Clip = true>
+inline void fill_span(const surface<Format>& dst, int x0, int x1, int y, uint32_t color)
+{
+    if constexpr (Clip) {
+        if (y < 0 || y >= dst.height) {
+            return;
+        }
+        x0 = std::max(x0, 0);
+        x1 = std::min(x1, dst.width);
+    }
+    if (x0 >= x1) {
+        return;
+    }
+    typename Format::pixel* row = dst.row(y);
+    const typename Blend::template op<Format> op(color);
+    if constexpr (std::is_same_v<Blend, blend_copy>) {
+        std::fill(row + x0, row + x1, op.packed);
+    } else {
+        for (int x = x0; x < x1; ++x) {
+            row[x] = op(row[x]);
+        }
+    }
+}
+
+/**
+ * @brief Fills a rectangle, like 'xw_draw_rectangle' with 'fill' set
+ */
+template <typename Format, typename Blend = blend_copy, bool Clip = true>
+inline void fill_rect(const surface<Format>& dst, int x, int y, int width, int height,
+                      uint32_t color)
+{
+    int y0 = y;
+    int y1 = y + height;
+    if constexpr (Clip) {
+        y0 = std::max(y0, 0);
+        y1 = std::min(y1, dst.height);
+    }
+    for (int row = y0; row < y1; ++row) {
+        // The rows are in the surface, only x is clipped
+        fill_span<Format, Blend, false>(dst, Clip ? std::max(x, 0) : x,
+                                        Clip ? std::min(x + width, dst.width) : x + width, row,
+                                        color);
+    }
+}
+
+/**
+ * @brief Draws the one pixel border of a rectangle, like 'xw_draw_rectangle' without 'fill'
+ */
+template <typename Format, typename Blend = blend_copy, bool Clip = true>
+inline void draw_rect(const surface<Format>& dst, int x, int y, int width, int height,
+                      uint32_t color)
+{
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    fill_span<Format, Blend, Clip>(dst, x, x + width, y, color);
+    if (height > 1) {
+        fill_span<Format, Blend, Clip>(dst, x, x + width, y + height - 1, color);
+    }
+    fill_rect<Format, Blend, Clip>(dst, x, y + 1, 1, height - 2, color);
+    if (width > 1) {
+        fill_rect<Format, Blend, Clip>(dst, x + width - 1, y + 1, 1, height - 2, color);
+    }
+}
+
+/**
+ * @brief Fills a circle, like 'xw_draw_circle' with 'fill' set
+ */
+template <typename Format, typename Blend = blend_copy, bool Clip = true>
+inline void fill_circle(const surface<Format>& dst, int x, int y, int r, uint32_t color)
+{
+    // Half width of each row, it only shrinks going out from the center
+    int half = r;
+    for (int dy = 0; dy <= r; ++dy) {
+        while (half * half + dy * dy > r * r) {
+            --half;
+        }
+        fill_span<Format, Blend, Clip>(dst, x - half, x + half + 1, y + dy, color);
+        if (dy != 0) {
+            fill_span<Format, Blend, Clip>(dst, x - half, x + half + 1, y - dy, color);
+        }
+    }
+}
+
+template <typename Format, typename Blend, bool Clip>
+inline void _plot(const surface<Format>& dst, int x, int y,
+                  const typename Blend::template op<Format>& op)
+{
+    if constexpr (Clip) {
+        if ((unsigned)x >= (unsigned)dst.width || (unsigned)y >= (unsigned)dst.height) {
+            return;
+        }
+    }
+    typename Format::pixel* pixel = dst.row(y) + x;
+    *pixel                        = op(*pixel);
+}
+
+/**
+ * @brief Draws the one pixel border of a circle, like 'xw_draw_circle' without 'fill'
+ */
+template <typename Format, typename Blend = blend_copy, bool Clip = true>
+inline void draw_circle(const surface<Format>& dst, int x, int y, int r, uint32_t color)
+{
+    const typename Blend::template op<Format> op(color);
+    // Midpoint circle, each step draws the 8 symmetric pixels
+    int dx  = r;
+    int dy  = 0;
+    int err = 1 - r;
+    while (dx >= dy) {
+        _plot<Format, Blend, Clip>(dst, x + dx, y + dy, op);
+        _plot<Format, Blend, Clip>(dst, x - dx, y + dy, op);
+        if (dy != 0) {
+            _plot<Format, Blend, Clip>(dst, x + dx, y - dy, op);
+            _plot<Format, Blend, Clip>(dst, x - dx, y - dy, op);
+        }
+        if (dx != dy) {
+            _plot<Format, Blend, Clip>(dst, x + dy, y + dx, op);
+            _plot<Format, Blend, Clip>(dst, x + dy, y - dx, op);
+            if (dy != 0) {
+                _plot<Format, Blend, Clip>(dst, x - dy, y + dx, op);
+                _plot<Format, Blend, Clip>(dst, x - dy, y - dx, op);
+            }
+        }
+        ++dy;
+        if (err < 0) {
+            err += 2 * dy + 1;
+        } else {
+            --dx;
+            err += 2 * (dy - dx) + 1;
+        }
+    }
+}
+
+/**
+ * @brief Draws a line with both ends, like 'xw_draw_line'
+ */
+template <typename Format, typename Blend = blend_copy, bool Clip = true>
+inline void draw_line(const surface<Format>& dst, int x1, int y1, int x2, int y2, uint32_t color)
+{
+    const typename Blend::template op<Format> op(color);
+    // Bresenham
+    const int dx = x2 > x1 ? x2 - x1 : x1 - x2;
+    const int dy = y2 > y1 ? y1 - y2 : y2 - y1;
+    const int sx = x1 < x2 ? 1 : -1;
+    const int sy = y1 < y2 ? 1 : -1;
+    int err      = dx + dy;
+    for (;;) {
+        _plot<Format, Blend, Clip>(dst, x1, y1, op);
+        if (x1 == x2 && y1 == y2) {
+            return;
+        }
+        const int err2 = 2 * err;
+        if (err2 >= dy) {
+            err += dy;
+            x1 += sx;
+        }
+        if (err2 <= dx) {
+            err += dx;
+            y1 += sy;
+        }
+    }
+}
+
+} // namespace xw
+
+#endif // XWRAP_INCLUDE_HPP